@@ -0,0 +1,139 @@
+/**
+ * @file reader_bench.cpp
+ * @brief Reader throughput in MB/s
+ *
+ * reader_bench [FILE]
+ * Reads every form of FILE, or of a generated data file of about 32 MB,
+ * through an mmap'd file, a std::ifstream read in blocks, and an in-memory
+ * string, then reads and parses every form into Expr trees that are kept
+ * until the end, reporting the heap those trees occupy. Nothing is evaluated.
+ */
+
+#include "syntax.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// 一行一个记录: 嵌套表、整数、有理数、符号、带转义的字符串和注释
+std::string generate(size_t bytes) {
+    std::string s;
+    s.reserve(bytes + 256);
+    for (size_t i = 0; s.size() < bytes; i++) {
+        s += "(record " + std::to_string(i) + " -" + std::to_string(i * 7 % 1000) + " 3/4 #t #f";
+        s += " (tags alpha beta-" + std::to_string(i % 97) + " gamma?) [vec 1 2 3]";
+        s += " \"row " + std::to_string(i) + " said \\\"hi\\\"\\n\" '(quoted sym)) ; note\n";
+    }
+    return s;
+}
+
+size_t readAll(Reader &in) {
+    size_t forms = 0;
+    while (!in.atEnd()) {
+        in.read();
+        forms++;
+    }
+    return forms;
+}
+
+template <typename F>
+void measure(const char *name, size_t bytes, F run) {
+    // 先跑一遍热身, 取三次里最快的一次
+    run();
+    double best = 1e30;
+    size_t forms = 0;
+    for (int k = 0; k < 3; k++) {
+        Clock::time_point t0 = Clock::now();
+        forms = run();
+        double s = std::chrono::duration<double>(Clock::now() - t0).count();
+        if (s < best) best = s;
+    }
+    std::printf("%-10s %8zu forms  %8.1f MB/s\n", name, forms, bytes / 1e6 / best);
+}
+
+// 解析出的树全部留着, 用堆的增量估计树的大小
+void measureParse(size_t bytes, const std::string &path) {
+    double best = 1e30;
+    size_t live = 0;
+    size_t forms = 0;
+    for (int k = 0; k < 3; k++) {
+        malloc_trim(0);
+        size_t before = mallinfo2().uordblks;
+        Clock::time_point t0 = Clock::now();
+        std::vector<Expr> exprs;
+        {
+            Reader in(std::string_view{});
+            in.open(path);
+            Assoc env = empty();
+            // 和 load 一样: 整个文件的 Expr 放在一个 arena 里
+            std::shared_ptr<Arena> unit = Arena::make<ExprBase>();
+            Arena::Scope scope(ExprBase::arena, unit.get());
+            while (!in.atEnd()) {
+                Syntax stx = in.read();
+                exprs.push_back(stx->parse(env).retained());
+            }
+        }
+        double s = std::chrono::duration<double>(Clock::now() - t0).count();
+        live = mallinfo2().uordblks - before;
+        forms = exprs.size();
+        if (s < best) best = s;
+    }
+    std::printf("%-10s %8zu forms  %8.1f MB/s  %8.1f MB live\n", "parse", forms, bytes / 1e6 / best, live / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string path;
+    std::string text;
+    if (argc > 1) {
+        path = argv[1];
+        std::ifstream f(path, std::ios::binary);
+        if (!f) {
+            std::cerr << "reader_bench: cannot open " << path << std::endl;
+            return 1;
+        }
+        std::ostringstream ss;
+        ss << f.rdbuf();
+        text = ss.str();
+    } else {
+        text = generate(32u << 20);
+        path = "/tmp/reader_bench." + std::to_string(getpid()) + ".scm";
+        std::ofstream(path, std::ios::binary) << text;
+    }
+    std::printf("%s: %.1f MB\n", path.c_str(), text.size() / 1e6);
+
+    try {
+        measure("mmap", text.size(), [&] {
+            Reader in(std::string_view{});
+            in.open(path);
+            return readAll(in);
+        });
+        measure("ifstream", text.size(), [&] {
+            std::ifstream f(path, std::ios::binary);
+            Reader in(f);
+            return readAll(in);
+        });
+        measure("string", text.size(), [&] {
+            Reader in(text);
+            return readAll(in);
+        });
+        measureParse(text.size(), path);
+    } catch (const RuntimeError &e) {
+        std::cerr << "reader_bench: " << e.message() << std::endl;
+        return 1;
+    }
+    if (argc <= 1) std::remove(path.c_str());
+    return 0;
+}
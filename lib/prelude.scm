@@ -0,0 +1,106 @@
+; 标准库里用 Scheme 写的部分
+; 构建时由 tools/mkprelude 求值, 做成镜像编进 code, 启动时不再解析 (见 src/prelude.hpp)
+; 只放定义, 不要和原语重名
+
+; ---- 序对 ----
+
+(define (caar x) (car (car x)))
+(define (cadr x) (car (cdr x)))
+(define (cdar x) (cdr (car x)))
+(define (cddr x) (cdr (cdr x)))
+(define (caddr x) (car (cdr (cdr x))))
+(define (cdddr x) (cdr (cdr (cdr x))))
+(define (cadddr x) (car (cdr (cdr (cdr x)))))
+
+; ---- 表 ----
+
+(define (length lst)
+  (if (null? lst) 0 (+ 1 (length (cdr lst)))))
+
+(define (append a b)
+  (if (null? a) b (cons (car a) (append (cdr a) b))))
+
+(define (reverse lst)
+  (letrec ((loop (lambda (lst acc)
+                   (if (null? lst) acc (loop (cdr lst) (cons (car lst) acc))))))
+    (loop lst '())))
+
+(define (list-tail lst k)
+  (if (= k 0) lst (list-tail (cdr lst) (- k 1))))
+
+(define (list-ref lst k)
+  (car (list-tail lst k)))
+
+(define (last-pair lst)
+  (if (null? (cdr lst)) lst (last-pair (cdr lst))))
+
+(define (iota n)
+  (letrec ((loop (lambda (i acc)
+                   (if (< i 0) acc (loop (- i 1) (cons i acc))))))
+    (loop (- n 1) '())))
+
+; ---- 高阶函数 ----
+
+(define (map f lst)
+  (if (null? lst) '() (cons (f (car lst)) (map f (cdr lst)))))
+
+(define (for-each f lst)
+  (if (null? lst)
+      (void)
+      (begin (f (car lst)) (for-each f (cdr lst)))))
+
+(define (filter keep? lst)
+  (cond ((null? lst) '())
+        ((keep? (car lst)) (cons (car lst) (filter keep? (cdr lst))))
+        (else (filter keep? (cdr lst)))))
+
+(define (fold-left f init lst)
+  (if (null? lst) init (fold-left f (f init (car lst)) (cdr lst))))
+
+(define (fold-right f init lst)
+  (if (null? lst) init (f (car lst) (fold-right f init (cdr lst)))))
+
+(define (reduce f init lst)
+  (if (null? lst) init (fold-left f (car lst) (cdr lst))))
+
+; ---- 比较和查找 ----
+
+; 字符串转成符号比较, 符号是按名字比的
+(define (equal? a b)
+  (cond ((and (pair? a) (pair? b))
+         (and (equal? (car a) (car b)) (equal? (cdr a) (cdr b))))
+        ((and (number? a) (number? b)) (= a b))
+        ((and (string? a) (string? b)) (eq? (string->symbol a) (string->symbol b)))
+        ((and (vector? a) (vector? b)) (equal? (vector->list a) (vector->list b)))
+        (else (eq? a b))))
+
+(define (memq x lst)
+  (cond ((null? lst) #f)
+        ((eq? x (car lst)) lst)
+        (else (memq x (cdr lst)))))
+
+(define (member x lst)
+  (cond ((null? lst) #f)
+        ((equal? x (car lst)) lst)
+        (else (member x (cdr lst)))))
+
+(define (assq x alist)
+  (cond ((null? alist) #f)
+        ((eq? x (car (car alist))) (car alist))
+        (else (assq x (cdr alist)))))
+
+(define (assoc x alist)
+  (cond ((null? alist) #f)
+        ((equal? x (car (car alist))) (car alist))
+        (else (assoc x (cdr alist)))))
+
+; ---- 数 ----
+
+(define (zero? n) (= n 0))
+(define (positive? n) (> n 0))
+(define (negative? n) (< n 0))
+(define (even? n) (= (modulo n 2) 0))
+(define (odd? n) (not (even? n)))
+(define (abs n) (if (< n 0) (- 0 n) n))
+(define (min a b) (if (< b a) b a))
+(define (max a b) (if (> b a) b a))
@@ -0,0 +1,84 @@
+#!/bin/bash
+# 命令行选项的测试: 同一个程序带选项跑, 输出必须和不带选项时逐字节相同, 并且和 cli/NAME.out 一致
+# 用法: cli-test.sh [code]
+
+cd "$(dirname "$0")"
+BIN=${1:-../build/code}
+fail=""
+
+# same NAME 选项...
+same() {
+    name=$1
+    shift
+    $BIN < cli/$name.scm > cli/$name.plain 2>&1
+    $BIN "$@" < cli/$name.scm > cli/$name.actual 2>&1
+    if cmp -s cli/$name.plain cli/$name.actual && diff cli/$name.actual cli/$name.out > diff_output.txt; then
+        rm -f cli/$name.plain cli/$name.actual
+    else
+        echo "Wrong answer in CLI TEST" $name "$@"
+        fail="$fail $name"
+    fi
+}
+
+# 单核机器上线程池默认只有一个 worker, --parallel-args 根本不会并行; --threads 4 让它真的走并行的路
+# 有副作用的实参 (display, set!) 必须按顺序串行求值, 判定为纯的过程被重新 define 以后也一样
+same purity --parallel-args --threads 4
+
+# check NAME 退出码 期望的退出码: 比较 cli/NAME.actual 和 cli/NAME.out
+check() {
+    if [ "$2" = "$3" ] && diff cli/$1.actual cli/$1.out > diff_output.txt; then
+        rm -f cli/$1.actual
+    else
+        echo "Wrong answer in CLI TEST" $1 "(exit status $2)"
+        fail="$fail $1"
+    fi
+}
+
+# --batch: 第一个文件最慢, 输出照样按输入顺序; 文件之间不共享全局变量
+$BIN --batch --jobs 3 cli/batch-slow.scm cli/batch-define.scm cli/batch-isolated.scm > cli/batch.actual 2>&1
+check batch $? 0
+# 缺一个文件: 其余文件照常输出, 退出码 1
+$BIN --batch cli/batch-define.scm cli/no-such-file.scm > cli/batch-missing.actual 2>&1
+check batch-missing $? 1
+# 不认识的选项, 以及没有 --batch 时的文件名, 都要报错而不是被忽略
+$BIN --no-such-option < /dev/null > cli/bad-option.actual 2>&1
+check bad-option $? 2
+$BIN cli/batch-define.scm < /dev/null > cli/stray-file.actual 2>&1
+check stray-file $? 2
+# --lazy-lambda: 函数体里的语法错误到第一次调用才报, 以后每次调用都报; 不带选项时 define 当场就报
+$BIN --lazy-lambda < cli/lazy.scm > cli/lazy.actual 2>&1
+check lazy $? 0
+$BIN < cli/lazy.scm > cli/lazy-eager.actual 2>&1
+check lazy-eager $? 0
+# --image: 存下来的函数体按存映像时绑定的名字解析, 装进来以后重新定义 car 不影响它调用的 car
+$BIN < cli/image-save.scm > /dev/null 2>&1
+$BIN --image cli/saved.img --batch cli/image-use.scm > cli/image.actual 2>&1
+check image $? 0
+rm -f cli/saved.img
+# 读取器: 比一个 64KB 的块大得多的文件, 表单和长字符串会跨块; 超过 1MB, --batch 会分成几段并行读
+# --batch 走 mmap, 重定向的普通文件和管道走分块读 fd; 去掉提示符以后都要是小文件输出的 400 份
+for i in $(seq 400); do cat cli/reader.scm; done > cli/reader-big.scm
+for i in $(seq 400); do cat cli/reader.out; done > cli/reader-big.out
+# big 标签 选项...: 带着这些选项把大文件三种方式各读一遍
+big() {
+    tag=$1
+    shift
+    $BIN "$@" --batch cli/reader-big.scm > cli/reader-mmap.actual 2>&1
+    $BIN "$@" < cli/reader-big.scm 2>&1 | sed 's/scm> //g' > cli/reader-file.actual
+    cat cli/reader-big.scm | $BIN "$@" 2>&1 | sed 's/scm> //g' > cli/reader-pipe.actual
+    for how in mmap file pipe; do
+        if cmp -s cli/reader-$how.actual cli/reader-big.out; then
+            rm -f cli/reader-$how.actual
+        else
+            echo "Wrong answer in CLI TEST reader ($tag, $how)"
+            fail="$fail reader-$tag-$how"
+        fi
+    done
+}
+big sequential --threads 1
+# 只有一个硬件线程时 --pipeline 会被忽略, --threads 2 让它在单核机器上也真的开读线程
+big pipeline --pipeline --threads 2
+# 分段并行读同样在只有一个线程时不开
+big parallel --threads 4
+rm -f cli/reader-big.scm cli/reader-big.out
+echo "CLI FAIL:$fail"
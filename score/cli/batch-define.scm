@@ -0,0 +1,3 @@
+(define x 1)
+(display "define ")
+x
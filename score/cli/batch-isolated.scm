@@ -0,0 +1,5 @@
+(display "isolated ")
+x
+fib
+(define x 2)
+x
@@ -0,0 +1,3 @@
+(define (first x) (car x))
+(define base 10)
+(save-image "cli/saved.img")
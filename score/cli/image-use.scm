@@ -0,0 +1,3 @@
+(define (car x) (quote mine))
+(car 1)
+(first (list base 2))
@@ -0,0 +1,9 @@
+(define (broken x) (if x))
+(display "defined ")
+(broken 1)
+(broken 2)
+(define (later) (helper 20))
+(define (helper x) (+ x 1))
+(later)
+(define (quoted) '(if))
+(quoted)
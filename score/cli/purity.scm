@@ -0,0 +1,20 @@
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (repeat k f) (if (= k 0) 'done (begin (f k) (repeat (- k 1) f))))
+(define sums '())
+(define (add-pure k) (set! sums (cons (+ (fib 16) (fib 17)) sums)))
+(repeat 64 add-pure)
+(car sums)
+(define (noisy n) (display n) (fib n))
+(repeat 40 (lambda (k) (+ (noisy 15) (noisy 16))))
+(define trace '())
+(define (note-a n) (set! trace (cons 'a trace)) (fib n))
+(define (note-b n) (set! trace (cons 'b trace)) (fib n))
+(repeat 40 (lambda (i) (list (note-a 15) (note-b 15))))
+trace
+(define (work n) (fib n))
+(define (pair-up i) (list (work 16) (work 17)))
+(repeat 64 pair-up)
+(pair-up 0)
+(define (work n) (display n) (display " ") (fib n))
+(repeat 8 pair-up)
+(exit)
@@ -0,0 +1,5 @@
+(define (square x) (* x x))
+(define (head-of x) (car x))
+(define loaded (+ loaded 1))
+(display "lib ")
+(square 7)
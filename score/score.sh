@@ -41,7 +41,7 @@ EOF
 done
 
 L_EXTRA=1
-R_EXTRA=7
+R_EXTRA=22
 for ((i = $L_EXTRA; i <= $R_EXTRA; i = i + 1))
 do
     echo ""
@@ -0,0 +1,33 @@
+#!/bin/bash
+# --serve / --prefork 的端到端测试: serve_client 按 serve/NAME.in 逐行发请求, 回复和 serve/NAME.out 比较
+# 用法: serve-test.sh [code] [serve_client]
+
+cd "$(dirname "$0")"
+BIN=${1:-../build/code}
+CLIENT=${2:-../build/serve_client}
+SOCK=/tmp/scheme-serve-test-$$.sock
+fail=""
+
+# run NAME 服务器参数...
+run() {
+    name=$1
+    shift
+    # 服务器自成一个进程组, 结束时连 prefork 的 worker 一起杀掉
+    setsid $BIN --serve $SOCK --quiet --prelude serve/prelude.scm --max-steps 100000 "$@" &
+    pid=$!
+    timeout 60 $CLIENT $SOCK < serve/$name.in > serve/$name.actual 2>&1
+    kill -- -$pid
+    wait $pid 2>/dev/null
+    if diff -b serve/$name.actual serve/$name.out > diff_output.txt; then
+        rm -f serve/$name.actual
+    else
+        echo "Wrong answer in SERVE TEST" $name
+        fail="$fail $name"
+    fi
+}
+
+# 只有一个 worker: 只发了半个请求的连接不能卡住别的连接
+run threaded --jobs 1
+run prefork --prefork 1
+rm -f $SOCK
+echo "SERVE FAIL:$fail"
@@ -0,0 +1,2 @@
+(define base-val 10)
+(define (sq x) (* x x))
@@ -20,12 +20,36 @@
  * - Arithmetic: +, -, *, /, modulo, expt
  * - Comparison: <, <=, =, >=, >
  * - List operations: cons, car, cdr, list, set-car!, set-cdr!
+ * - Vector operations: vector, make-vector, vector-ref, vector-set!, vector-length,
+ *   vector->list, list->vector
+ * - String operations: string-append, substring, string-length, string-ref,
+ *   string->symbol, symbol->string, string->number, number->string,
+ *   string-index, string-search, make-string-builder, string-builder-append!,
+ *   string-builder->string
+ * - Persistent collections: make-pmap, pmap-set, pmap-ref, pmap-remove,
+ *   pmap-contains?, pmap-count, pmap->list, pvector, pvector-length,
+ *   pvector-ref, pvector-set, pvector-push, pvector->list
+ * - Promises and streams: force, make-promise, stream-car, stream-cdr
+ * - Futures: touch
+ * - Data-parallel operations: pmap, pfor-each, preduce, psort
+ * - Green threads: spawn, yield, task-join, make-channel, channel-send,
+ *   channel-recv, fd-wait, fd-read
+ * - Isolates: spawn-isolate, isolate-send!, isolate-receive, isolate-join,
+ *   isolate-parent
+ * - Remote workers: remote-apply, remote-map
+ * - Heap images: save-image
+ * - Loading source files: load
+ * - Native extensions: load-extension
+ * - Sorting: sort, list-sort, vector-sort! (stable, comparison procedure first)
  * - Logic: not, and, or (and/or support short-circuit evaluation)
- * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
- * - I/O: display
+ * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?, vector?,
+ *   pmap?, pvector?, promise?, future?, task?, channel?, isolate?, output-port?
+ * - I/O: display, write, write-string, newline (each with an optional port), flush-output
+ * - Output ports: open-output-file, open-output-string, get-output-string,
+ *   close-output-port, with-output-to-string
  * - Control: void, exit
  */
-std::map<std::string, ExprType> primitives = {
+const std::map<std::string, ExprType> primitives = {
     // Arithmetic operations
     {"+",        E_PLUS},
     {"-",        E_MINUS},
@@ -49,6 +73,95 @@ std::map<std::string, ExprType> primitives = {
     {"set-car!",  E_SETCAR},
     {"set-cdr!",  E_SETCDR},
 
+    // Vector operations
+    {"vector",        E_VECTOR},
+    {"make-vector",   E_MAKE_VECTOR},
+    {"vector-ref",    E_VECTOR_REF},
+    {"vector-set!",   E_VECTOR_SET},
+    {"vector-length", E_VECTOR_LENGTH},
+    {"vector->list",  E_VECTOR_TO_LIST},
+    {"list->vector",  E_LIST_TO_VECTOR},
+
+    // String operations
+    {"string-append",          E_STRING_APPEND},
+    {"substring",              E_SUBSTRING},
+    {"string-length",          E_STRING_LENGTH},
+    {"string-ref",             E_STRING_REF},
+    {"string->symbol",         E_STRING_TO_SYMBOL},
+    {"symbol->string",         E_SYMBOL_TO_STRING},
+    {"string->number",         E_STRING_TO_NUMBER},
+    {"number->string",         E_NUMBER_TO_STRING},
+    {"string-index",           E_STRING_INDEX},
+    {"string-search",          E_STRING_SEARCH},
+    {"make-string-builder",    E_MAKE_STRING_BUILDER},
+    {"string-builder-append!", E_STRING_BUILDER_APPEND},
+    {"string-builder->string", E_STRING_BUILDER_TO_STRING},
+
+    // Persistent collections
+    {"make-pmap",      E_MAKE_PMAP},
+    {"pmap-set",       E_PMAP_SET},
+    {"pmap-ref",       E_PMAP_REF},
+    {"pmap-remove",    E_PMAP_REMOVE},
+    {"pmap-contains?", E_PMAP_CONTAINS},
+    {"pmap-count",     E_PMAP_COUNT},
+    {"pmap->list",     E_PMAP_TO_LIST},
+    {"pvector",        E_PVECTOR},
+    {"pvector-length", E_PVECTOR_LENGTH},
+    {"pvector-ref",    E_PVECTOR_REF},
+    {"pvector-set",    E_PVECTOR_SET},
+    {"pvector-push",   E_PVECTOR_PUSH},
+    {"pvector->list",  E_PVECTOR_TO_LIST},
+
+    // Promises and streams
+    {"force",         E_FORCE},
+    {"make-promise",  E_MAKE_PROMISE},
+    {"stream-car",    E_STREAM_CAR},
+    {"stream-cdr",    E_STREAM_CDR},
+
+    // Futures
+    {"touch",         E_TOUCH},
+
+    // Data-parallel operations
+    {"pmap",          E_PAR_MAP},
+    {"pfor-each",     E_PAR_FOR_EACH},
+    {"preduce",       E_PAR_REDUCE},
+    {"psort",         E_PAR_SORT},
+
+    // Green threads
+    {"spawn",         E_SPAWN},
+    {"yield",         E_YIELD},
+    {"task-join",     E_TASK_JOIN},
+    {"make-channel",  E_MAKE_CHANNEL},
+    {"channel-send",  E_CHANNEL_SEND},
+    {"channel-recv",  E_CHANNEL_RECV},
+    {"fd-wait",       E_FD_WAIT},
+    {"fd-read",       E_FD_READ},
+
+    // Isolates
+    {"spawn-isolate",   E_SPAWN_ISOLATE},
+    {"isolate-send!",   E_ISOLATE_SEND},
+    {"isolate-receive", E_ISOLATE_RECEIVE},
+    {"isolate-join",    E_ISOLATE_JOIN},
+    {"isolate-parent",  E_ISOLATE_PARENT},
+
+    // Remote workers
+    {"remote-apply", E_REMOTE_APPLY},
+    {"remote-map",   E_REMOTE_MAP},
+
+    // Heap images
+    {"save-image", E_SAVE_IMAGE},
+
+    // Loading source files
+    {"load", E_LOAD},
+
+    // Native extensions
+    {"load-extension", E_LOAD_EXTENSION},
+
+    // Sorting
+    {"sort",          E_SORT},
+    {"list-sort",     E_SORT},
+    {"vector-sort!",  E_VECTOR_SORT},
+
     // Logic operations
     {"not",       E_NOT},
     {"and",       E_AND},
@@ -64,9 +177,29 @@ std::map<std::string, ExprType> primitives = {
     {"symbol?",    E_SYMBOLQ},
     {"list?",      E_LISTQ},
     {"string?",    E_STRINGQ},
+    {"vector?",    E_VECTORQ},
+    {"pmap?",      E_PMAPQ},
+    {"pvector?",   E_PVECTORQ},
+    {"promise?",   E_PROMISEQ},
+    {"future?",    E_FUTUREQ},
+    {"task?",      E_TASKQ},
+    {"channel?",   E_CHANNELQ},
+    {"isolate?",   E_ISOLATEQ},
+    {"output-port?", E_OUTPUT_PORTQ},
     
     // I/O operations
-    {"display",   E_DISPLAY},
+    {"display",      E_DISPLAY},
+    {"write",        E_WRITE},
+    {"write-string", E_WRITE_STRING},
+    {"newline",      E_NEWLINE},
+    {"flush-output", E_FLUSH_OUTPUT},
+
+    // Output ports
+    {"open-output-file",      E_OPEN_OUTPUT_FILE},
+    {"open-output-string",    E_OPEN_OUTPUT_STRING},
+    {"get-output-string",     E_GET_OUTPUT_STRING},
+    {"close-output-port",     E_CLOSE_OUTPUT_PORT},
+    {"with-output-to-string", E_WITH_OUTPUT_TO_STRING},
     
     // Special values and control
     {"void",      E_VOID},
@@ -84,14 +217,16 @@ std::map<std::string, ExprType> primitives = {
  * - Control flow constructs: begin, quote
  * - Conditional : if, cond
  * - Function definition: lambda
- * - Variable and function definition: define
+ * - Variable and function definition: define, define-record-type
  * - Binding constructs: let, letrec
  * - Assignment: set!
+ * - Lazy evaluation: delay, delay-force, cons-stream
+ * - Parallel evaluation: future, parallel-let
  * 
  * Note: and/or have been moved to primitives to support function-style usage
  * while maintaining their short-circuit evaluation behavior.
  */
-std::map<std::string, ExprType> reserved_words = {
+const std::map<std::string, ExprType> reserved_words = {
     // Control flow constructs
     {"begin",   E_BEGIN},    
     {"quote",   E_QUOTE},    
@@ -105,11 +240,21 @@ std::map<std::string, ExprType> reserved_words = {
 
     // Variable and function definition
     {"define",  E_DEFINE},   
+    {"define-record-type", E_DEFINE_RECORD},
 
     // Binding constructs
     {"let",     E_LET},      
     {"letrec",  E_LETREC},   
     
     // Assignment
-    {"set!",    E_SET}      
+    {"set!",    E_SET},
+
+    // Lazy evaluation
+    {"delay",       E_DELAY},
+    {"delay-force", E_DELAY_FORCE},
+    {"cons-stream", E_CONS_STREAM},
+
+    // Parallel evaluation
+    {"future",       E_FUTURE},
+    {"parallel-let", E_PARALLEL_LET}
 };
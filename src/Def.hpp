@@ -62,6 +62,101 @@ enum ExprType {
     E_SETCAR,          
     E_SETCDR,          
 
+    // Vector operations
+    E_VECTOR,
+    E_MAKE_VECTOR,
+    E_VECTOR_REF,
+    E_VECTOR_SET,
+    E_VECTOR_LENGTH,
+    E_VECTOR_TO_LIST,
+    E_LIST_TO_VECTOR,
+
+    // String operations
+    E_STRING_APPEND,
+    E_SUBSTRING,
+    E_STRING_LENGTH,
+    E_STRING_REF,
+    E_STRING_TO_SYMBOL,
+    E_SYMBOL_TO_STRING,
+    E_STRING_TO_NUMBER,
+    E_NUMBER_TO_STRING,
+    E_STRING_INDEX,
+    E_STRING_SEARCH,
+    E_MAKE_STRING_BUILDER,
+    E_STRING_BUILDER_APPEND,
+    E_STRING_BUILDER_TO_STRING,
+
+    // Persistent collections
+    E_MAKE_PMAP,
+    E_PMAP_SET,
+    E_PMAP_REF,
+    E_PMAP_REMOVE,
+    E_PMAP_CONTAINS,
+    E_PMAP_COUNT,
+    E_PMAP_TO_LIST,
+    E_PVECTOR,
+    E_PVECTOR_LENGTH,
+    E_PVECTOR_REF,
+    E_PVECTOR_SET,
+    E_PVECTOR_PUSH,
+    E_PVECTOR_TO_LIST,
+
+    // Promises and streams
+    E_FORCE,
+    E_MAKE_PROMISE,
+    E_STREAM_CAR,
+    E_STREAM_CDR,
+
+    // Futures
+    E_TOUCH,
+
+    // Data-parallel operations
+    E_PAR_MAP,
+    E_PAR_FOR_EACH,
+    E_PAR_REDUCE,
+    E_PAR_SORT,
+
+    // Green threads
+    E_SPAWN,
+    E_YIELD,
+    E_TASK_JOIN,
+    E_MAKE_CHANNEL,
+    E_CHANNEL_SEND,
+    E_CHANNEL_RECV,
+    E_FD_WAIT,
+    E_FD_READ,
+
+    // Isolates
+    E_SPAWN_ISOLATE,
+    E_ISOLATE_SEND,
+    E_ISOLATE_RECEIVE,
+    E_ISOLATE_JOIN,
+    E_ISOLATE_PARENT,
+
+    // Remote workers
+    E_REMOTE_APPLY,
+    E_REMOTE_MAP,
+
+    // Heap images
+    E_SAVE_IMAGE,
+
+    // Loading source files
+    E_LOAD,
+
+    // Native extensions
+    E_NATIVE,
+    E_LOAD_EXTENSION,
+
+    // Sorting
+    E_SORT,
+    E_VECTOR_SORT,
+
+    // Record operations (generated by define-record-type)
+    E_RECORD_CTOR,
+    E_RECORD_PRED,
+    E_RECORD_GET,
+    E_RECORD_SET,
+
     // Logic operations
     E_NOT,              
     E_AND,             
@@ -77,6 +172,15 @@ enum ExprType {
     E_SYMBOLQ,         
     E_LISTQ,                
     E_STRINGQ,          
+    E_VECTORQ,
+    E_PMAPQ,
+    E_PVECTORQ,
+    E_PROMISEQ,
+    E_FUTUREQ,
+    E_TASKQ,
+    E_CHANNELQ,
+    E_ISOLATEQ,
+    E_OUTPUT_PORTQ,
 
     // Control flow constructs
     E_BEGIN,          
@@ -91,6 +195,8 @@ enum ExprType {
     E_APPLY,           
     E_LAMBDA,         
     E_DEFINE,          
+    E_DEFINE_RECORD,
+    E_LAZY_BODY,
 
     // Binding constructs
     E_LET,            
@@ -99,8 +205,28 @@ enum ExprType {
     // Assignment
     E_SET,             
 
+    // Lazy evaluation
+    E_DELAY,
+    E_DELAY_FORCE,
+    E_CONS_STREAM,
+
+    // Parallel evaluation
+    E_FUTURE,
+    E_PARALLEL_LET,
+
     // I/O operations
     E_DISPLAY,         
+    E_WRITE,
+    E_WRITE_STRING,
+    E_NEWLINE,
+    E_FLUSH_OUTPUT,
+
+    // Output ports
+    E_OPEN_OUTPUT_FILE,
+    E_OPEN_OUTPUT_STRING,
+    E_GET_OUTPUT_STRING,
+    E_CLOSE_OUTPUT_PORT,
+    E_WITH_OUTPUT_TO_STRING,
 };
 
 /**
@@ -117,9 +243,27 @@ enum ValueType {
     V_NULL,             
     V_STRING,           
     V_PAIR,             
+    V_VECTOR,
+    V_STRING_BUILDER,
+    V_RECORD,
+    V_PMAP,
+    V_PVECTOR,
+    V_PROMISE,
+    V_FUTURE,
+    V_TASK,
+    V_CHANNEL,
+    V_ISOLATE,
+    V_PORT,
     V_PROC,             
     V_VOID,            
     V_TERMINATE        
 };
 
+/**
+ * @brief Name tables defined in Def.cpp
+ * Read-only after static initialization, so any thread may consult them.
+ */
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
+
 #endif // DEF_HPP
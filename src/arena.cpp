@@ -0,0 +1,93 @@
+#include "arena.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+每个节点前面一个头: 所在的 arena (堆上的节点是空) 和前一个节点,
+arena 销毁时顺着这条链从新到旧析构
+*/
+struct Arena::Header {
+    Arena *arena;
+    Header *prev;
+};
+
+namespace {
+
+const size_t ALIGN = alignof(std::max_align_t);
+const size_t HEADER = (sizeof(void*) * 2 + ALIGN - 1) / ALIGN * ALIGN;
+const size_t FIRST_CHUNK = 4096;
+const size_t MIN_CHUNK = 256;
+const size_t MAX_CHUNK = 1 << 20;
+
+std::atomic<size_t> live_bytes{0};
+
+inline size_t roundUp(size_t n) {
+    return (n + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+} // namespace
+
+Arena::Arena(Destroy destroy, size_t first_chunk)
+    : destroy(destroy), first_chunk(first_chunk ? roundUp(first_chunk) : FIRST_CHUNK) {
+    if (this->first_chunk < MIN_CHUNK) this->first_chunk = MIN_CHUNK;
+}
+
+Arena::~Arena() {
+    for (Header *h = last; h; h = h->prev)
+        if (h->arena)
+            destroy(reinterpret_cast<char*>(h) + HEADER);
+    for (char *c : chunks)
+        std::free(c);
+    live_bytes -= reserved;
+}
+
+size_t Arena::liveBytes() {
+    return live_bytes.load(std::memory_order_relaxed);
+}
+
+// 块从 first_chunk 起每次翻倍, 整个文件也不会分太多块
+void Arena::grow(size_t need) {
+    size_t size = chunks.empty() ? first_chunk : (size_t)(end - chunks.back()) * 2;
+    if (size > MAX_CHUNK) size = MAX_CHUNK;
+    if (size < need) size = need;
+    char *c = static_cast<char*>(std::malloc(size));
+    if (!c) throw std::bad_alloc();
+    chunks.push_back(c);
+    cur = c;
+    end = c + size;
+    reserved += size;
+    live_bytes += size;
+}
+
+void *Arena::allocate(Arena *a, size_t n) {
+    Header *h;
+    if (a) {
+        size_t need = HEADER + roundUp(n);
+        if ((size_t)(a->end - a->cur) < need)
+            a->grow(need);
+        h = reinterpret_cast<Header*>(a->cur);
+        a->cur += need;
+        h->arena = a;
+        h->prev = a->last;
+        a->last = h;
+    } else {
+        h = static_cast<Header*>(::operator new(HEADER + n));
+        h->arena = nullptr;
+        h->prev = nullptr;
+    }
+    return reinterpret_cast<char*>(h) + HEADER;
+}
+
+void Arena::release(void *p) {
+    if (!p) return;
+    Header *h = reinterpret_cast<Header*>(static_cast<char*>(p) - HEADER);
+    if (h->arena)
+        h->arena = nullptr;
+    else
+        ::operator delete(h);
+}
+
+Arena *Arena::of(const void *p) {
+    return reinterpret_cast<const Header*>(static_cast<const char*>(p) - HEADER)->arena;
+}
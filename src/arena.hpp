@@ -0,0 +1,118 @@
+#ifndef ARENA
+#define ARENA
+
+/**
+ * @file arena.hpp
+ * @brief Bump allocation for Syntax and Expr nodes
+ *
+ * The reader gives every top-level form its own syntax arena, and the
+ * interpreter parses each compilation unit (a loaded file, an eval'd string,
+ * one REPL form) into its own Expr arena. Nodes are laid out one after
+ * another in chunks and destroyed together with their arena. Chunks double
+ * in size; a REPL form's first chunk is sized from its syntax tree, since a
+ * definition keeps that arena for as long as the procedure lives.
+ *
+ * Inside an arena, a Syntax or Expr pointing at a node does not own it: the
+ * shared_ptr has no control block, so copying it costs nothing. Anything
+ * that keeps a node beyond the parse (a procedure, a promise, the
+ * interpreter's list of forms) takes a retained() reference, which shares
+ * one control block for the whole arena and keeps it alive.
+ *
+ * Nodes allocated while no arena is active go to the heap and are owned
+ * individually, as before.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Arena : public std::enable_shared_from_this<Arena> {
+public:
+    typedef void (*Destroy)(void *);
+
+    /**
+     * @brief An arena for nodes whose common base is T
+     * T must have a virtual destructor. first_chunk is the size of the
+     * first chunk, 0 for the default; later chunks double.
+     */
+    template <typename T>
+    static std::shared_ptr<Arena> make(size_t first_chunk = 0) {
+        return std::make_shared<Arena>(&destroyAs<T>, first_chunk);
+    }
+
+    Arena(Destroy, size_t first_chunk);
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /** @brief Bytes taken from the heap for chunks */
+    size_t bytes() const { return reserved; }
+
+    /** @brief Bytes handed out to nodes so far, headers included */
+    size_t used() const { return reserved - (size_t)(end - cur); }
+
+    /** @brief Bytes held in chunks by all arenas of the process */
+    static size_t liveBytes();
+
+    /**
+     * @brief Body of a node class's operator new
+     * Allocates from a, or from the heap if a is null.
+     */
+    static void *allocate(Arena *a, size_t n);
+
+    /**
+     * @brief Body of a node class's operator delete
+     * Only frees heap nodes; an arena node is only forgotten, which happens
+     * when its constructor throws.
+     */
+    static void release(void *p);
+
+    /** @brief Arena holding the node at p, or nullptr for a heap node */
+    static Arena *of(const void *p);
+
+    /** @brief Reference to a freshly allocated node: non-owning inside an arena */
+    template <typename T>
+    static std::shared_ptr<T> wrap(T *p) {
+        if (p && of(p))
+            return std::shared_ptr<T>(std::shared_ptr<T>(), p);
+        return std::shared_ptr<T>(p);
+    }
+
+    /** @brief A reference to the same node that keeps its arena alive */
+    template <typename T>
+    static std::shared_ptr<T> retain(const std::shared_ptr<T> &r) {
+        Arena *a = r ? of(r.get()) : nullptr;
+        if (!a || r.use_count() > 0)
+            return r;
+        return std::shared_ptr<T>(a->shared_from_this(), r.get());
+    }
+
+    /** @brief Makes a the arena new nodes of one kind go to, until destroyed */
+    class Scope {
+        Arena *&slot;
+        Arena *saved;
+    public:
+        Scope(Arena *&slot, Arena *a) : slot(slot), saved(slot) { slot = a; }
+        ~Scope() { slot = saved; }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+private:
+    struct Header;
+
+    template <typename T>
+    static void destroyAs(void *p) { static_cast<T*>(p)->~T(); }
+
+    Destroy destroy;
+    size_t first_chunk;
+    std::vector<char*> chunks;
+    char *cur = nullptr;
+    char *end = nullptr;
+    Header *last = nullptr;   ///< Most recent node; nodes are destroyed newest first
+    size_t reserved = 0;
+
+    void grow(size_t need);
+};
+
+#endif // ARENA
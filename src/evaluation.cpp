@@ -12,13 +12,38 @@
 #include "expr.hpp" 
 #include "RE.hpp"
 #include "syntax.hpp"
+#include "persistent.hpp"
+#include "threadpool.hpp"
+#include "purity.hpp"
+#include "green.hpp"
+#include "isolate.hpp"
+#include "port.hpp"
 #include <cstring>
 #include <vector>
 #include <map>
 #include <climits>
+#include <algorithm>
+#include <new>
+#include <mutex>
+#include <sstream>
+#include <cerrno>
+#include <fcntl.h>
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
+
+/*
+多线程 (future) 下的约定:
+  Value / Assoc 都是 shared_ptr, 引用计数本身是原子的, 所以在线程之间复制、传递值是安全的
+  但同一个 shared_ptr 对象被两个线程同时赋值就会把引用计数弄坏, 所以所有原地修改
+  (set!, define, set-car!, set-cdr!, vector-set!, 记录的 modifier, string-builder-append!)
+  以及 display 之类的输出都要先拿 MutationLock, 同一个程序的写操作之间因此是串行的
+  环境结点的 v 和 next 另外由读写锁保护 (见 value.cpp 的 EnvSync), 查变量总是安全的
+  这两把锁都属于产生 future 的那个程序, 没用过 future 的程序什么锁都不拿
+  其余读操作不加锁: 一个 future 不应该去读另一个线程正在修改的序对、向量之类, promise 也不应被
+  多个 future 同时 force; 读-改-写也不是原子的, 几个 future 一起 (set! n (+ n 1)) 会丢更新
+  这些和 Racket 的 future 一样由程序员保证, 否则结果是未定义的
+*/
 
 Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
     return IntegerV(n);
@@ -29,7 +54,7 @@ Value RationalNum::eval(Assoc &e) { // evaluation of a rational number
 }
 
 Value StringExpr::eval(Assoc &e) { // evaluation of a string
-    return StringV(s);
+    return StringV(s, 0, s->size());
 }
 
 Value True::eval(Assoc &e) { // evaluation of #t
@@ -53,17 +78,149 @@ Value Unary::eval(Assoc &e) { // evaluation of single-operator primitive
 }
 
 Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
-    return evalRator(rand1->eval(e), rand2->eval(e));
+    if (parallel_args && !isTrivialExpr(rand1) && !isTrivialExpr(rand2)) {
+        const Expr *es[2] = {&rand1, &rand2};
+        Value vals[2] = {Value(nullptr), Value(nullptr)};
+        evalArguments(es, 2, e, profile, vals);
+        return evalRator(vals[0], vals[1]);
+    }
+    // 和 evalArguments 一样从左到右; 写成 evalRator(rand1->eval(e), rand2->eval(e)) 顺序由编译器定
+    Value v1 = rand1->eval(e);
+    Value v2 = rand2->eval(e);
+    return evalRator(v1, v2);
 }
 
 Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
     // TODO: TO COMPLETE THE VARIADIC CLASS
     std::vector<Value> vals;
+    if (parallel_args) {
+        evalArguments(rands, e, profile, vals);
+        return evalRator(vals);
+    }
     for(auto &r:rands)vals.push_back(r->eval(e));
     return evalRator(vals);
 }
 
 
+/*
+把原语当作值使用时 (比如 (define f +)), 包成一个以这些节点为函数体的 Procedure
+这张表在静态初始化时建好之后只读, 多个线程可以同时查
+*/
+static const std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
+    {E_VOID,     {new MakeVoid(), {}}},
+    {E_EXIT,     {new Exit(), {}}},
+    {E_BOOLQ,    {new IsBoolean(new Var("parm")), {"parm"}}},
+    {E_INTQ,     {new IsFixnum(new Var("parm")), {"parm"}}},
+    {E_NULLQ,    {new IsNull(new Var("parm")), {"parm"}}},
+    {E_PAIRQ,    {new IsPair(new Var("parm")), {"parm"}}},
+    {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
+    {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
+    {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
+    {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
+    {E_WRITE,    {new Write(new Var("parm")), {"parm"}}},
+    {E_WRITE_STRING, {new WriteString(new Var("parm")), {"parm"}}},
+    {E_NEWLINE,  {new Newline({}), {}}},
+    {E_FLUSH_OUTPUT, {new FlushOutput({}), {}}},
+    {E_OPEN_OUTPUT_FILE,   {new OpenOutputFile(new Var("parm")), {"parm"}}},
+    {E_OPEN_OUTPUT_STRING, {new OpenOutputString({}), {}}},
+    {E_GET_OUTPUT_STRING,  {new GetOutputString(new Var("parm")), {"parm"}}},
+    {E_CLOSE_OUTPUT_PORT,  {new CloseOutputPort(new Var("parm")), {"parm"}}},
+    {E_WITH_OUTPUT_TO_STRING, {new WithOutputToString(new Var("parm")), {"parm"}}},
+    {E_PLUS,     {new PlusVar({}),  {}}},
+    {E_MINUS,    {new MinusVar({}), {}}},
+    {E_MUL,      {new MultVar({}),  {}}},
+    {E_DIV,      {new DivVar({}),   {}}},
+    {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_EQQ,      {new EqualVar({}), {}}},
+    {E_EQ,       {new EqualVar({}), {}}},
+    {E_LT,       {new LessVar({}), {}}},
+    {E_LE,       {new LessEqVar({}), {}}},
+    {E_GE,       {new GreaterEqVar({}), {}}},
+    {E_GT,       {new GreaterVar({}), {}}},
+    {E_CONS,     {new Cons(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_CAR,      {new Car(new Var("parm")), {"parm"}}},
+    {E_CDR,      {new Cdr(new Var("parm")), {"parm"}}},
+    {E_NOT,      {new Not(new Var("parm")), {"parm"}}},
+    {E_LIST,     {new ListFunc({}), {}}},
+    {E_LISTQ,    {new IsList(new Var("parm")), {"parm"}}},
+    {E_SETCAR,   {new SetCar(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_SETCDR,   {new SetCdr(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_VECTOR,   {new VectorFunc({}), {}}},
+    {E_MAKE_VECTOR, {new MakeVector({}), {}}},
+    {E_VECTOR_REF,  {new VectorRef(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_VECTOR_SET,  {new VectorSet({}), {}}},
+    {E_VECTOR_LENGTH, {new VectorLength(new Var("parm")), {"parm"}}},
+    {E_VECTOR_TO_LIST, {new VectorToList(new Var("parm")), {"parm"}}},
+    {E_LIST_TO_VECTOR, {new ListToVector(new Var("parm")), {"parm"}}},
+    {E_VECTORQ,  {new IsVector(new Var("parm")), {"parm"}}},
+    {E_STRING_APPEND,    {new StringAppend({}), {}}},
+    {E_SUBSTRING,        {new Substring({}), {}}},
+    {E_STRING_LENGTH,    {new StringLength(new Var("parm")), {"parm"}}},
+    {E_STRING_REF,       {new StringRef(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_STRING_TO_SYMBOL, {new StringToSymbol(new Var("parm")), {"parm"}}},
+    {E_SYMBOL_TO_STRING, {new SymbolToString(new Var("parm")), {"parm"}}},
+    {E_STRING_TO_NUMBER, {new StringToNumber(new Var("parm")), {"parm"}}},
+    {E_NUMBER_TO_STRING, {new NumberToString(new Var("parm")), {"parm"}}},
+    {E_STRING_INDEX,     {new StringIndex(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_STRING_SEARCH,    {new StringSearch({}), {}}},
+    {E_MAKE_STRING_BUILDER,      {new MakeStringBuilder({}), {}}},
+    {E_STRING_BUILDER_APPEND,    {new StringBuilderAppend({}), {}}},
+    {E_STRING_BUILDER_TO_STRING, {new StringBuilderToString(new Var("parm")), {"parm"}}},
+    {E_MAKE_PMAP,        {new MakePMap({}), {}}},
+    {E_PMAP_SET,         {new PMapSet({}), {}}},
+    {E_PMAP_REF,         {new PMapRef({}), {}}},
+    {E_PMAP_REMOVE,      {new PMapRemove(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_PMAP_CONTAINS,    {new PMapContains(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_PMAP_COUNT,       {new PMapCount(new Var("parm")), {"parm"}}},
+    {E_PMAP_TO_LIST,     {new PMapToList(new Var("parm")), {"parm"}}},
+    {E_PVECTOR,          {new PVectorFunc({}), {}}},
+    {E_PVECTOR_LENGTH,   {new PVectorLength(new Var("parm")), {"parm"}}},
+    {E_PVECTOR_REF,      {new PVectorRef(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_PVECTOR_SET,      {new PVectorSet({}), {}}},
+    {E_PVECTOR_PUSH,     {new PVectorPush(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_PVECTOR_TO_LIST,  {new PVectorToList(new Var("parm")), {"parm"}}},
+    {E_PMAPQ,            {new IsPMap(new Var("parm")), {"parm"}}},
+    {E_PVECTORQ,         {new IsPVector(new Var("parm")), {"parm"}}},
+    {E_FORCE,            {new Force(new Var("parm")), {"parm"}}},
+    {E_MAKE_PROMISE,     {new MakePromise(new Var("parm")), {"parm"}}},
+    {E_STREAM_CAR,       {new StreamCar(new Var("parm")), {"parm"}}},
+    {E_STREAM_CDR,       {new StreamCdr(new Var("parm")), {"parm"}}},
+    {E_PROMISEQ,         {new IsPromise(new Var("parm")), {"parm"}}},
+    {E_TOUCH,            {new Touch(new Var("parm")), {"parm"}}},
+    {E_FUTUREQ,          {new IsFuture(new Var("parm")), {"parm"}}},
+    {E_TASKQ,            {new IsTask(new Var("parm")), {"parm"}}},
+    {E_CHANNELQ,         {new IsChannel(new Var("parm")), {"parm"}}},
+    {E_ISOLATEQ,         {new IsIsolate(new Var("parm")), {"parm"}}},
+    {E_OUTPUT_PORTQ,     {new IsOutputPort(new Var("parm")), {"parm"}}},
+    {E_PAR_MAP,          {new ParMap(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_PAR_FOR_EACH,     {new ParForEach(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_PAR_REDUCE,       {new ParReduce({}), {}}},
+    {E_PAR_SORT,         {new ParSort(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_SPAWN,            {new Spawn(new Var("parm")), {"parm"}}},
+    {E_YIELD,            {new Yield({}), {}}},
+    {E_TASK_JOIN,        {new TaskJoin(new Var("parm")), {"parm"}}},
+    {E_MAKE_CHANNEL,     {new MakeChannel({}), {}}},
+    {E_CHANNEL_SEND,     {new ChannelSend(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_CHANNEL_RECV,     {new ChannelRecv(new Var("parm")), {"parm"}}},
+    {E_FD_WAIT,          {new FdWait(new Var("parm")), {"parm"}}},
+    {E_FD_READ,          {new FdRead(new Var("parm")), {"parm"}}},
+    {E_SPAWN_ISOLATE,    {new SpawnIsolate(new Var("parm")), {"parm"}}},
+    {E_ISOLATE_SEND,     {new IsolateSend(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_ISOLATE_RECEIVE,  {new IsolateReceive({}), {}}},
+    {E_ISOLATE_JOIN,     {new IsolateJoin(new Var("parm")), {"parm"}}},
+    {E_ISOLATE_PARENT,   {new IsolateParent({}), {}}},
+    {E_REMOTE_APPLY,     {new RemoteApply({}), {}}},
+    {E_REMOTE_MAP,       {new RemoteMap(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_SAVE_IMAGE,       {new SaveImage(new Var("parm")), {"parm"}}},
+    {E_LOAD,             {new Load(new Var("parm")), {"parm"}}},
+    {E_LOAD_EXTENSION,   {new LoadExtension(new Var("parm")), {"parm"}}},
+    {E_SORT,     {new Sort(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_VECTOR_SORT, {new VectorSort(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
+    {E_AND,      {new AndVar({}), {}}},
+    {E_OR,       {new OrVar({}), {}}}
+};
+
 Value Var::eval(Assoc &e) { // evaluation of variable
     // TODO: TO identify the invalid variable
     // We request all valid variable just need to be a symbol,you should promise:
@@ -76,42 +233,7 @@ Value Var::eval(Assoc &e) { // evaluation of variable
     Value matched_value = find(x, e);
     if (matched_value.get() == nullptr) {
         if (primitives.count(x)) {
-             static std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
-                    {E_VOID,     {new MakeVoid(), {}}},
-                    {E_EXIT,     {new Exit(), {}}},
-                    {E_BOOLQ,    {new IsBoolean(new Var("parm")), {"parm"}}},
-                    {E_INTQ,     {new IsFixnum(new Var("parm")), {"parm"}}},
-                    {E_NULLQ,    {new IsNull(new Var("parm")), {"parm"}}},
-                    {E_PAIRQ,    {new IsPair(new Var("parm")), {"parm"}}},
-                    {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
-                    {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
-                    {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
-                    {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
-                    {E_PLUS,     {new PlusVar({}),  {}}},
-                    {E_MINUS,    {new MinusVar({}), {}}},
-                    {E_MUL,      {new MultVar({}),  {}}},
-                    {E_DIV,      {new DivVar({}),   {}}},
-                    {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_EQQ,      {new EqualVar({}), {}}},
-                    {E_EQ,       {new EqualVar({}), {}}},
-                    {E_LT,       {new LessVar({}), {}}},
-                    {E_LE,       {new LessEqVar({}), {}}},
-                    {E_GE,       {new GreaterEqVar({}), {}}},
-                    {E_GT,       {new GreaterVar({}), {}}},
-                    {E_CONS,     {new Cons(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_CAR,      {new Car(new Var("parm")), {"parm"}}},
-                    {E_CDR,      {new Cdr(new Var("parm")), {"parm"}}},
-                    {E_NOT,      {new Not(new Var("parm")), {"parm"}}},
-                    {E_LIST,     {new ListFunc({}), {}}},
-                    {E_LISTQ,    {new IsList(new Var("parm")), {"parm"}}},
-                    {E_SETCAR,   {new SetCar(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_SETCDR,   {new SetCdr(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_AND,      {new AndVar({}), {}}},
-                    {E_OR,       {new OrVar({}), {}}}
-            };
-
-            auto it = primitive_map.find(primitives[x]);
+            auto it = primitive_map.find(primitives.at(x));
             //TOD0:to PASS THE parameters correctly;
             //COMPLETE THE CODE WITH THE HINT IN IF SENTENCE WITH CORRECT RETURN VALUE
             if (it != primitive_map.end()) {
@@ -126,6 +248,18 @@ Value Var::eval(Assoc &e) { // evaluation of variable
     return matched_value;
 }
 
+// 原语过程的函数体就是 primitive_map 里那个节点本身, 按指针认
+std::string primitiveName(const Procedure *proc) {
+    ExprBase *body = proc->e.get();
+    if (!body) return std::string();
+    auto it = primitive_map.find(body->e_type);
+    if (it == primitive_map.end() || it->second.first.get() != body)
+        return std::string();
+    for (auto &p : primitives)
+        if (p.second == body->e_type) return p.first;
+    return std::string();
+}
+
 Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
     //TODO: To complete the addition logic
 
@@ -558,6 +692,7 @@ Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
     //TODO: To complete the set-car! logic
     if(rand1->v_type!=V_PAIR)throw(RuntimeError("Wrong typename"));
     Pair *p=dynamic_cast<Pair*>(rand1.get());
+    MutationLock lk;
     p->car=rand2;
     return VoidV();
 }
@@ -566,10 +701,732 @@ Value SetCdr::evalRator(const Value &rand1, const Value &rand2) { // set-cdr!
    //TODO: To complete the set-cdr! logic
    if(rand1->v_type!=V_PAIR)throw(RuntimeError("Wrong typename"));
     Pair *p=dynamic_cast<Pair*>(rand1.get());
+    MutationLock lk;
     p->cdr=rand2;
     return VoidV();
 }
 
+// Collects the elements of a proper list into a contiguous buffer
+static void listToBuffer(const Value &lst, std::vector<Value> &out, const char *who) {
+    Value tmp = lst;
+    while (tmp->v_type == V_PAIR) {
+        Pair *p = dynamic_cast<Pair*>(tmp.get());
+        out.push_back(p->car);
+        tmp = p->cdr;
+    }
+    if (tmp->v_type != V_NULL)
+        throw(RuntimeError(std::string("Not a proper list in ") + who));
+}
+
+// Builds a list from a buffer back to front, so every Pair is allocated once
+static Value bufferToList(const std::vector<Value> &buf) {
+    Value list = NullV();
+    for (size_t i = buf.size(); i > 0; i--)
+        list = PairV(buf[i - 1], list);
+    return list;
+}
+
+static size_t vectorIndex(const Vector *vec, const Value &idx) {
+    if (idx->v_type != V_INT)
+        throw(RuntimeError("Vector index must be an integer"));
+    int k = dynamic_cast<Integer*>(idx.get())->n;
+    if (k < 0 || (size_t)k >= vec->elems.size())
+        throw(RuntimeError("Vector index out of range"));
+    return (size_t)k;
+}
+
+Value VectorFunc::evalRator(const std::vector<Value> &args) { // vector
+    return VectorV(args);
+}
+
+// make-vector 一次最多分配的元素个数
+static const int MAX_VECTOR_LENGTH = 1 << 26;
+
+Value MakeVector::evalRator(const std::vector<Value> &args) { // make-vector
+    if (args.size() != 1 && args.size() != 2)
+        throw(RuntimeError("Wrong number of make-vector"));
+    if (args[0]->v_type != V_INT || dynamic_cast<Integer*>(args[0].get())->n < 0)
+        throw(RuntimeError("Wrong typename in make-vector"));
+    int k = dynamic_cast<Integer*>(args[0].get())->n;
+    // 长度来自程序, 一个笔误就能让 new 抛 bad_alloc 把整个进程 (包括 server) 带走
+    if (k > MAX_VECTOR_LENGTH)
+        throw(RuntimeError("make-vector: length " + std::to_string(k) + " too large"));
+    Value fill = args.size() == 2 ? args[1] : IntegerV(0);
+    try {
+        return VectorV(std::vector<Value>(k, fill));
+    } catch (const std::bad_alloc &) {
+        throw(RuntimeError("make-vector: out of memory"));
+    }
+}
+
+Value VectorRef::evalRator(const Value &rand1, const Value &rand2) { // vector-ref
+    if (rand1->v_type != V_VECTOR) throw(RuntimeError("Wrong typename in vector-ref"));
+    Vector *vec = dynamic_cast<Vector*>(rand1.get());
+    return vec->elems[vectorIndex(vec, rand2)];
+}
+
+Value VectorSet::evalRator(const std::vector<Value> &args) { // vector-set!
+    if (args.size() != 3) throw(RuntimeError("Wrong number of vector-set!"));
+    if (args[0]->v_type != V_VECTOR) throw(RuntimeError("Wrong typename in vector-set!"));
+    Vector *vec = dynamic_cast<Vector*>(args[0].get());
+    size_t idx = vectorIndex(vec, args[1]);
+    MutationLock lk;
+    vec->elems[idx] = args[2];
+    return VoidV();
+}
+
+Value VectorLength::evalRator(const Value &rand) { // vector-length
+    if (rand->v_type != V_VECTOR) throw(RuntimeError("Wrong typename in vector-length"));
+    return IntegerV((int)dynamic_cast<Vector*>(rand.get())->elems.size());
+}
+
+Value VectorToList::evalRator(const Value &rand) { // vector->list
+    if (rand->v_type != V_VECTOR) throw(RuntimeError("Wrong typename in vector->list"));
+    return bufferToList(dynamic_cast<Vector*>(rand.get())->elems);
+}
+
+Value ListToVector::evalRator(const Value &rand) { // list->vector
+    std::vector<Value> buf;
+    listToBuffer(rand, buf, "list->vector");
+    return VectorV(buf);
+}
+
+static String *asString(const Value &v, const char *who) {
+    if (v->v_type != V_STRING)
+        throw(RuntimeError(std::string("Wrong typename in ") + who));
+    return dynamic_cast<String*>(v.get());
+}
+
+static size_t stringIndexArg(const Value &v, size_t limit, const char *who) {
+    if (v->v_type != V_INT)
+        throw(RuntimeError(std::string("Index must be an integer in ") + who));
+    int k = dynamic_cast<Integer*>(v.get())->n;
+    if (k < 0 || (size_t)k > limit)
+        throw(RuntimeError(std::string("Index out of range in ") + who));
+    return (size_t)k;
+}
+
+// 在 hay 中找 needle: memchr 定位首字节 (glibc 里是向量化的), 再用 memcmp 校验剩下的部分
+static const char *searchBytes(const char *hay, size_t n, const char *needle, size_t m) {
+    if (m == 0) return hay;
+    if (m > n) return nullptr;
+    const char *p = hay;
+    const char *last = hay + (n - m);
+    while (p <= last) {
+        p = static_cast<const char*>(memchr(p, needle[0], last - p + 1));
+        if (p == nullptr) return nullptr;
+        if (memcmp(p + 1, needle + 1, m - 1) == 0) return p;
+        p++;
+    }
+    return nullptr;
+}
+
+Value StringAppend::evalRator(const std::vector<Value> &args) { // string-append
+    size_t total = 0;
+    for (auto &arg : args)
+        total += asString(arg, "string-append")->size();
+    std::string res;
+    res.reserve(total);
+    for (auto &arg : args) {
+        String *str = dynamic_cast<String*>(arg.get());
+        res.append(str->data(), str->size());
+    }
+    return StringV(res);
+}
+
+Value Substring::evalRator(const std::vector<Value> &args) { // substring
+    if (args.size() != 2 && args.size() != 3)
+        throw(RuntimeError("Wrong number of substring"));
+    String *str = asString(args[0], "substring");
+    size_t start = stringIndexArg(args[1], str->size(), "substring");
+    size_t end = args.size() == 3 ? stringIndexArg(args[2], str->size(), "substring") : str->size();
+    if (start > end) throw(RuntimeError("Index out of range in substring"));
+    // 共享同一块缓冲区, 不拷贝字符
+    return StringV(str->buf, str->off + start, end - start);
+}
+
+Value StringLength::evalRator(const Value &rand) { // string-length
+    return IntegerV((int)asString(rand, "string-length")->size());
+}
+
+Value StringRef::evalRator(const Value &rand1, const Value &rand2) { // string-ref
+    String *str = asString(rand1, "string-ref");
+    size_t k = stringIndexArg(rand2, str->size(), "string-ref");
+    if (k == str->size()) throw(RuntimeError("Index out of range in string-ref"));
+    return StringV(str->buf, str->off + k, 1);
+}
+
+Value StringToSymbol::evalRator(const Value &rand) { // string->symbol
+    return SymbolV(asString(rand, "string->symbol")->str());
+}
+
+Value SymbolToString::evalRator(const Value &rand) { // symbol->string
+    if (rand->v_type != V_SYM) throw(RuntimeError("Wrong typename in symbol->string"));
+    return StringV(dynamic_cast<Symbol*>(rand.get())->s);
+}
+
+Value StringToNumber::evalRator(const Value &rand) { // string->number
+    std::string s = asString(rand, "string->number")->str();
+    int n, numerator, denominator;
+    if (s.empty()) return BooleanV(false);
+    if (tryParseRational(s, numerator, denominator)) {
+        if (numerator % denominator == 0) return IntegerV(numerator / denominator);
+        return RationalV(numerator, denominator);
+    }
+    if (tryParseNumber(s, n)) return IntegerV(n);
+    return BooleanV(false);
+}
+
+Value NumberToString::evalRator(const Value &rand) { // number->string
+    if (rand->v_type == V_INT)
+        return StringV(std::to_string(dynamic_cast<Integer*>(rand.get())->n));
+    if (rand->v_type == V_RATIONAL) {
+        Rational *r = dynamic_cast<Rational*>(rand.get());
+        if (r->denominator == 1) return StringV(std::to_string(r->numerator));
+        return StringV(std::to_string(r->numerator) + "/" + std::to_string(r->denominator));
+    }
+    throw(RuntimeError("Wrong typename in number->string"));
+}
+
+Value StringIndex::evalRator(const Value &rand1, const Value &rand2) { // string-index
+    String *str = asString(rand1, "string-index");
+    String *ch = asString(rand2, "string-index");
+    if (ch->size() != 1) throw(RuntimeError("string-index expects a one-character string"));
+    const void *p = memchr(str->data(), ch->data()[0], str->size());
+    if (p == nullptr) return BooleanV(false);
+    return IntegerV((int)(static_cast<const char*>(p) - str->data()));
+}
+
+Value StringSearch::evalRator(const std::vector<Value> &args) { // string-search
+    if (args.size() != 2 && args.size() != 3)
+        throw(RuntimeError("Wrong number of string-search"));
+    String *pattern = asString(args[0], "string-search");
+    String *str = asString(args[1], "string-search");
+    size_t start = args.size() == 3 ? stringIndexArg(args[2], str->size(), "string-search") : 0;
+    const char *p = searchBytes(str->data() + start, str->size() - start, pattern->data(), pattern->size());
+    if (p == nullptr) return BooleanV(false);
+    return IntegerV((int)(p - str->data()));
+}
+
+Value MakeStringBuilder::evalRator(const std::vector<Value> &args) { // make-string-builder
+    if (!args.empty()) throw(RuntimeError("Wrong number of make-string-builder"));
+    return StringBuilderV();
+}
+
+Value StringBuilderAppend::evalRator(const std::vector<Value> &args) { // string-builder-append!
+    if (args.empty() || args[0]->v_type != V_STRING_BUILDER)
+        throw(RuntimeError("Wrong typename in string-builder-append!"));
+    StringBuilder *sb = dynamic_cast<StringBuilder*>(args[0].get());
+    MutationLock lk;
+    for (size_t i = 1; i < args.size(); i++) {
+        String *str = asString(args[i], "string-builder-append!");
+        sb->buf.append(str->data(), str->size());
+    }
+    return VoidV();
+}
+
+Value StringBuilderToString::evalRator(const Value &rand) { // string-builder->string
+    if (rand->v_type != V_STRING_BUILDER)
+        throw(RuntimeError("Wrong typename in string-builder->string"));
+    return StringV(dynamic_cast<StringBuilder*>(rand.get())->buf);
+}
+
+Value RecordConstructor::evalRator(const std::vector<Value> &args) { // record constructor
+    if (args.size() != slot_of_arg.size())
+        throw(RuntimeError("Wrong number of arguments for constructor of " + type->name));
+    std::vector<Value> slots(type->fields.size(), VoidV());
+    for (size_t i = 0; i < args.size(); i++)
+        slots[slot_of_arg[i]] = args[i];
+    return RecordV(type, slots);
+}
+
+Value RecordPredicate::evalRator(const std::vector<Value> &args) { // record predicate
+    if (args.size() != 1)
+        throw(RuntimeError("Wrong number of arguments for predicate of " + type->name));
+    return BooleanV(args[0]->v_type == V_RECORD &&
+                    static_cast<Record*>(args[0].get())->type == type);
+}
+
+Value RecordAccessor::evalRator(const std::vector<Value> &args) { // record accessor
+    if (args.size() != 1)
+        throw(RuntimeError("Wrong number of arguments for accessor of " + type->name));
+    if (args[0]->v_type != V_RECORD || static_cast<Record*>(args[0].get())->type != type)
+        throw(RuntimeError("Wrong typename, expected record " + type->name));
+    return static_cast<Record*>(args[0].get())->slots()[slot];
+}
+
+Value RecordModifier::evalRator(const std::vector<Value> &args) { // record modifier
+    if (args.size() != 2)
+        throw(RuntimeError("Wrong number of arguments for modifier of " + type->name));
+    if (args[0]->v_type != V_RECORD || static_cast<Record*>(args[0].get())->type != type)
+        throw(RuntimeError("Wrong typename, expected record " + type->name));
+    MutationLock lk;
+    static_cast<Record*>(args[0].get())->slots()[slot] = args[1];
+    return VoidV();
+}
+
+static PMap *asPMap(const Value &v, const char *who) {
+    if (v->v_type != V_PMAP)
+        throw(RuntimeError(std::string("Wrong typename in ") + who));
+    return static_cast<PMap*>(v.get());
+}
+
+static PVector *asPVector(const Value &v, const char *who) {
+    if (v->v_type != V_PVECTOR)
+        throw(RuntimeError(std::string("Wrong typename in ") + who));
+    return static_cast<PVector*>(v.get());
+}
+
+static size_t pvectorIndex(const PVector *vec, const Value &idx, const char *who) {
+    if (idx->v_type != V_INT)
+        throw(RuntimeError(std::string("Index must be an integer in ") + who));
+    int k = dynamic_cast<Integer*>(idx.get())->n;
+    if (k < 0 || (size_t)k >= vec->cnt)
+        throw(RuntimeError(std::string("Index out of range in ") + who));
+    return (size_t)k;
+}
+
+Value MakePMap::evalRator(const std::vector<Value> &args) { // make-pmap
+    if (!args.empty()) throw(RuntimeError("Wrong number of make-pmap"));
+    return PMapV(HamtRef(nullptr), 0);
+}
+
+Value PMapSet::evalRator(const std::vector<Value> &args) { // pmap-set
+    if (args.size() != 3) throw(RuntimeError("Wrong number of pmap-set"));
+    return pmapSet(asPMap(args[0], "pmap-set"), args[1], args[2]);
+}
+
+Value PMapRef::evalRator(const std::vector<Value> &args) { // pmap-ref
+    if (args.size() != 2 && args.size() != 3) throw(RuntimeError("Wrong number of pmap-ref"));
+    Value v = pmapFind(asPMap(args[0], "pmap-ref"), args[1]);
+    if (v.get() != nullptr) return v;
+    return args.size() == 3 ? args[2] : BooleanV(false);
+}
+
+Value PMapRemove::evalRator(const Value &rand1, const Value &rand2) { // pmap-remove
+    return pmapRemove(asPMap(rand1, "pmap-remove"), rand2);
+}
+
+Value PMapContains::evalRator(const Value &rand1, const Value &rand2) { // pmap-contains?
+    return BooleanV(pmapFind(asPMap(rand1, "pmap-contains?"), rand2).get() != nullptr);
+}
+
+Value PMapCount::evalRator(const Value &rand) { // pmap-count
+    return IntegerV((int)asPMap(rand, "pmap-count")->count);
+}
+
+Value PMapToList::evalRator(const Value &rand) { // pmap->list, as an association list
+    std::vector<std::pair<Value, Value>> entries;
+    pmapEntries(asPMap(rand, "pmap->list"), entries);
+    Value list = NullV();
+    for (size_t i = entries.size(); i > 0; i--)
+        list = PairV(PairV(entries[i - 1].first, entries[i - 1].second), list);
+    return list;
+}
+
+Value PVectorFunc::evalRator(const std::vector<Value> &args) { // pvector
+    return PVectorV(args);
+}
+
+Value PVectorLength::evalRator(const Value &rand) { // pvector-length
+    return IntegerV((int)asPVector(rand, "pvector-length")->cnt);
+}
+
+Value PVectorRef::evalRator(const Value &rand1, const Value &rand2) { // pvector-ref
+    PVector *vec = asPVector(rand1, "pvector-ref");
+    return pvectorRef(vec, pvectorIndex(vec, rand2, "pvector-ref"));
+}
+
+Value PVectorSet::evalRator(const std::vector<Value> &args) { // pvector-set
+    if (args.size() != 3) throw(RuntimeError("Wrong number of pvector-set"));
+    PVector *vec = asPVector(args[0], "pvector-set");
+    return pvectorSet(vec, pvectorIndex(vec, args[1], "pvector-set"), args[2]);
+}
+
+Value PVectorPush::evalRator(const Value &rand1, const Value &rand2) { // pvector-push
+    return pvectorPush(asPVector(rand1, "pvector-push"), rand2);
+}
+
+Value PVectorToList::evalRator(const Value &rand) { // pvector->list
+    std::vector<Value> buf;
+    pvectorElems(asPVector(rand, "pvector->list"), buf);
+    return bufferToList(buf);
+}
+
+/*
+force 的实现 (R7RS 参考实现的迭代版本):
+  delay 的 promise 直接求值并记住结果
+  delay-force 的 promise 求值得到另一个 promise q, 把 q 的状态搬进自己的 box,
+  再让 q 共享这个 box, 然后继续循环; 这样一长串 delay-force 只占常数空间
+*/
+Value forcePromise(const Value &v) {
+    if (v->v_type != V_PROMISE) return v;
+    std::shared_ptr<PromiseBox> box = static_cast<Promise*>(v.get())->box;
+    while (!box->done) {
+        Value res = box->e->eval(box->env);
+        if (box->done) break; // 求值过程中被重入 force 过了
+        if (!box->lazy) {
+            box->done = true;
+            box->value = res;
+        } else {
+            if (res->v_type != V_PROMISE)
+                throw(RuntimeError("delay-force: expression must yield a promise"));
+            Promise *inner = static_cast<Promise*>(res.get());
+            std::shared_ptr<PromiseBox> other = inner->box;
+            box->done = other->done;
+            box->lazy = other->lazy;
+            box->value = other->value;
+            box->e = other->e;
+            box->env = other->env;
+            inner->box = box;
+        }
+        if (box->done) {
+            // 结果已经记住了, 放掉函数体和环境
+            box->e = Expr(nullptr);
+            box->env = Assoc(nullptr);
+        }
+    }
+    return box->value;
+}
+
+Value Force::evalRator(const Value &rand) { // force
+    return forcePromise(rand);
+}
+
+Value MakePromise::evalRator(const Value &rand) { // make-promise
+    if (rand->v_type == V_PROMISE) return rand;
+    return ReadyPromiseV(rand);
+}
+
+Value StreamCar::evalRator(const Value &rand) { // stream-car
+    if (rand->v_type != V_PAIR) throw(RuntimeError("Wrong typename in stream-car"));
+    return static_cast<Pair*>(rand.get())->car;
+}
+
+Value StreamCdr::evalRator(const Value &rand) { // stream-cdr
+    if (rand->v_type != V_PAIR) throw(RuntimeError("Wrong typename in stream-cdr"));
+    return forcePromise(static_cast<Pair*>(rand.get())->cdr);
+}
+
+/*
+sort 的实现: 自然归并排序 (TimSort 式的 run 检测)
+1.先把整个表拷进一段连续的缓冲区
+2.从左到右找出已经有序的 run (严格递减的 run 原地翻转), 太短的 run 用二分插入补到 minrun
+3.run 入栈, 按 TimSort 的栈不变式合并相邻 run, 最后全部合并
+4.用缓冲区一次性重建结果表
+比较器如果是内置的 < 或 >, 直接比较数值, 不再经过 applyProcedure
+*/
+namespace {
+
+struct SortLess {
+    enum Kind { GENERIC, NUM_LT, NUM_GT } kind;
+    Value proc;
+    std::vector<Value> args;
+
+    explicit SortLess(const Value &p) : kind(GENERIC), proc(p), args(2, Value(nullptr)) {
+        if (proc->v_type != V_PROC)
+            throw(RuntimeError("sort: comparison must be a procedure"));
+        Expr &body = dynamic_cast<Procedure*>(proc.get())->e;
+        // 只有 Var::eval 里 primitive_map 生成的 < 和 > 才是空参数的 LessVar/GreaterVar
+        if (auto lt = dynamic_cast<LessVar*>(body.get())) {
+            if (lt->rands.empty()) kind = NUM_LT;
+        } else if (auto gt = dynamic_cast<GreaterVar*>(body.get())) {
+            if (gt->rands.empty()) kind = NUM_GT;
+        }
+    }
+
+    bool operator()(const Value &a, const Value &b) {
+        if (kind == NUM_LT) return compareNumericValues(a, b) < 0;
+        if (kind == NUM_GT) return compareNumericValues(a, b) > 0;
+        args[0] = a;
+        args[1] = b;
+        Value res = applyProcedure(proc, args);
+        return !(res->v_type == V_BOOL && !dynamic_cast<Boolean*>(res.get())->b);
+    }
+};
+
+class NaturalMergeSort {
+    std::vector<Value> &a;
+    SortLess &less;
+    std::vector<Value> tmp;
+    std::vector<std::pair<size_t, size_t>> runs; // (start, length)
+
+    static size_t minRunLength(size_t n) {
+        size_t r = 0;
+        while (n >= 64) {
+            r |= n & 1;
+            n >>= 1;
+        }
+        return n + r;
+    }
+
+    // [lo, start) 已经有序, 把 [start, hi) 逐个二分插入进去
+    void binaryInsertionSort(size_t lo, size_t start, size_t hi) {
+        for (; start < hi; start++) {
+            Value pivot = a[start];
+            size_t left = lo, right = start;
+            while (left < right) {
+                size_t mid = left + (right - left) / 2;
+                if (less(pivot, a[mid])) right = mid;
+                else left = mid + 1;
+            }
+            for (size_t k = start; k > left; k--)
+                a[k] = std::move(a[k - 1]);
+            a[left] = std::move(pivot);
+        }
+    }
+
+    size_t countRunAndMakeAscending(size_t lo, size_t hi) {
+        size_t i = lo + 1;
+        if (i == hi) return 1;
+        if (less(a[i], a[lo])) {
+            // 严格递减才能翻转, 否则会破坏稳定性
+            while (i + 1 < hi && less(a[i + 1], a[i])) i++;
+            std::reverse(a.begin() + lo, a.begin() + i + 1);
+        } else {
+            while (i + 1 < hi && !less(a[i + 1], a[i])) i++;
+        }
+        return i + 1 - lo;
+    }
+
+    void mergeAt(size_t i) {
+        size_t base1 = runs[i].first, len1 = runs[i].second;
+        size_t base2 = runs[i + 1].first, len2 = runs[i + 1].second;
+        runs[i].second = len1 + len2;
+        runs.erase(runs.begin() + i + 1);
+        // 两段已经首尾有序就不用合并
+        if (!less(a[base2], a[base2 - 1])) return;
+        tmp.assign(a.begin() + base1, a.begin() + base2);
+        size_t l = 0, r = base2, out = base1, rend = base2 + len2;
+        while (l < len1 && r < rend) {
+            if (less(a[r], tmp[l])) a[out++] = std::move(a[r++]);
+            else a[out++] = std::move(tmp[l++]);
+        }
+        while (l < len1) a[out++] = std::move(tmp[l++]);
+        tmp.clear();
+    }
+
+    void mergeCollapse() {
+        while (runs.size() > 1) {
+            size_t n = runs.size() - 2;
+            if ((n > 0 && runs[n - 1].second <= runs[n].second + runs[n + 1].second) ||
+                (n > 1 && runs[n - 2].second <= runs[n - 1].second + runs[n].second)) {
+                if (runs[n - 1].second < runs[n + 1].second) n--;
+            } else if (runs[n].second > runs[n + 1].second) {
+                break;
+            }
+            mergeAt(n);
+        }
+    }
+
+    void mergeForceCollapse() {
+        while (runs.size() > 1) {
+            size_t n = runs.size() - 2;
+            if (n > 0 && runs[n - 1].second < runs[n + 1].second) n--;
+            mergeAt(n);
+        }
+    }
+
+public:
+    NaturalMergeSort(std::vector<Value> &a, SortLess &less) : a(a), less(less) {}
+
+    void run() {
+        size_t n = a.size();
+        if (n < 2) return;
+        size_t minRun = minRunLength(n);
+        size_t lo = 0;
+        while (lo < n) {
+            size_t len = countRunAndMakeAscending(lo, n);
+            if (len < minRun) {
+                size_t forced = std::min(minRun, n - lo);
+                binaryInsertionSort(lo, lo + len, lo + forced);
+                len = forced;
+            }
+            runs.push_back(std::make_pair(lo, len));
+            mergeCollapse();
+            lo += len;
+        }
+        mergeForceCollapse();
+    }
+};
+
+} // namespace
+
+Value Sort::evalRator(const Value &rand1, const Value &rand2) { // sort / list-sort
+    SortLess less(rand1);
+    std::vector<Value> buf;
+    listToBuffer(rand2, buf, "sort");
+    NaturalMergeSort(buf, less).run();
+    return bufferToList(buf);
+}
+
+Value VectorSort::evalRator(const Value &rand1, const Value &rand2) { // vector-sort!
+    SortLess less(rand1);
+    if (rand2->v_type != V_VECTOR) throw(RuntimeError("Wrong typename in vector-sort!"));
+    Vector *vec = dynamic_cast<Vector*>(rand2.get());
+    // 在副本上排序, 比较过程中途出错时原向量保持不变
+    std::vector<Value> buf(vec->elems);
+    NaturalMergeSort(buf, less).run();
+    vec->elems.swap(buf);
+    return VoidV();
+}
+
+/*
+pmap / pfor-each / preduce / psort 的实现:
+  先把列表或向量拷到连续的 buffer 里, 切成若干块交给 ThreadPool::parallelFor,
+  每块结果写回自己的位置, 所以输出顺序和输入一致
+  块数取 worker 数的几倍, 让先算完的线程能接着领别的块
+*/
+static const size_t PAR_CHUNKS_PER_THREAD = 4;
+static const size_t PAR_SORT_CUTOFF = 2048;   // 再小就直接串行排序
+
+static size_t parChunkCount(size_t n) {
+    size_t chunks = ((size_t)ThreadPool::global().size() + 1) * PAR_CHUNKS_PER_THREAD;
+    return std::max((size_t)1, std::min(n, chunks));
+}
+
+// 在线程池上跑 body(0..n-1), 每块都沿用调用者的输出流和 EnvSync
+static void runChunks(size_t n, const std::function<void(size_t)> &body) {
+    std::ostream *out = current_output;
+    std::shared_ptr<EnvSync> sync = shareEnvironments();
+    ThreadPool::global().parallelFor(n, [out, &sync, &body](size_t i) {
+        OutputScope scope(out);
+        EnvSyncScope sync_scope(sync.get());
+        body(i);
+    });
+}
+
+// 第 i 块是 [i*n/chunks, (i+1)*n/chunks)
+static size_t parChunkBegin(size_t i, size_t n, size_t chunks) {
+    return i * n / chunks;
+}
+
+// 把列表或向量读进 buffer, 返回输入是不是向量
+static bool sequenceToBuffer(const Value &seq, std::vector<Value> &out, const char *who) {
+    if (seq->v_type == V_VECTOR) {
+        out = static_cast<Vector*>(seq.get())->elems;
+        return true;
+    }
+    listToBuffer(seq, out, who);
+    return false;
+}
+
+static void checkProcedure(const Value &proc, const char *who) {
+    if (proc->v_type != V_PROC)
+        throw(RuntimeError(std::string(who) + ": expected a procedure"));
+}
+
+Value ParMap::evalRator(const Value &rand1, const Value &rand2) { // pmap
+    checkProcedure(rand1, "pmap");
+    std::vector<Value> in;
+    bool isVector = sequenceToBuffer(rand2, in, "pmap");
+    size_t n = in.size();
+    std::vector<Value> out(n, Value(nullptr));
+    size_t chunks = parChunkCount(n);
+    runChunks(n == 0 ? 0 : chunks, [&](size_t c) {
+        std::vector<Value> arg(1, Value(nullptr));
+        for (size_t i = parChunkBegin(c, n, chunks); i < parChunkBegin(c + 1, n, chunks); i++) {
+            arg[0] = in[i];
+            out[i] = applyProcedure(rand1, arg);
+        }
+    });
+    return isVector ? VectorV(out) : bufferToList(out);
+}
+
+Value ParForEach::evalRator(const Value &rand1, const Value &rand2) { // pfor-each
+    checkProcedure(rand1, "pfor-each");
+    std::vector<Value> in;
+    sequenceToBuffer(rand2, in, "pfor-each");
+    size_t n = in.size();
+    size_t chunks = parChunkCount(n);
+    runChunks(n == 0 ? 0 : chunks, [&](size_t c) {
+        std::vector<Value> arg(1, Value(nullptr));
+        for (size_t i = parChunkBegin(c, n, chunks); i < parChunkBegin(c + 1, n, chunks); i++) {
+            arg[0] = in[i];
+            applyProcedure(rand1, arg);
+        }
+    });
+    return VoidV();
+}
+
+Value ParReduce::evalRator(const std::vector<Value> &args) { // preduce
+    if (args.size() != 3) throw(RuntimeError("Wrong number of preduce"));
+    const Value &combine = args[0];
+    checkProcedure(combine, "preduce");
+    std::vector<Value> in;
+    sequenceToBuffer(args[2], in, "preduce");
+    size_t n = in.size();
+    size_t chunks = parChunkCount(n);
+    // 每块各自从左到右归约, 再按块的顺序从 init 开始合起来; combine 满足结合律时结果和串行一样
+    std::vector<Value> partial(chunks, Value(nullptr));
+    runChunks(n == 0 ? 0 : chunks, [&](size_t c) {
+        size_t lo = parChunkBegin(c, n, chunks), hi = parChunkBegin(c + 1, n, chunks);
+        std::vector<Value> pair(2, Value(nullptr));
+        Value acc = in[lo];
+        for (size_t i = lo + 1; i < hi; i++) {
+            pair[0] = acc;
+            pair[1] = in[i];
+            acc = applyProcedure(combine, pair);
+        }
+        partial[c] = acc;
+    });
+    Value acc = args[1];
+    std::vector<Value> pair(2, Value(nullptr));
+    for (size_t c = 0; n != 0 && c < chunks; c++) {
+        pair[0] = acc;
+        pair[1] = partial[c];
+        acc = applyProcedure(combine, pair);
+    }
+    return acc;
+}
+
+// 稳定归并: 只有右边严格小于左边时才先取右边
+static void mergeRuns(const std::vector<Value> &x, const std::vector<Value> &y,
+                      std::vector<Value> &out, SortLess &less) {
+    out.clear();
+    out.reserve(x.size() + y.size());
+    size_t i = 0, j = 0;
+    while (i < x.size() && j < y.size()) {
+        if (less(y[j], x[i])) out.push_back(y[j++]);
+        else out.push_back(x[i++]);
+    }
+    out.insert(out.end(), x.begin() + i, x.end());
+    out.insert(out.end(), y.begin() + j, y.end());
+}
+
+Value ParSort::evalRator(const Value &rand1, const Value &rand2) { // psort
+    SortLess less(rand1);
+    std::vector<Value> buf;
+    bool isVector = sequenceToBuffer(rand2, buf, "psort");
+    size_t n = buf.size();
+    ThreadPool &pool = ThreadPool::global();
+    if (n < PAR_SORT_CUTOFF || pool.size() < 2) {
+        NaturalMergeSort(buf, less).run();
+        return isVector ? VectorV(buf) : bufferToList(buf);
+    }
+    // 各块并行排好, 再一轮一轮两两归并; SortLess 带着参数缓冲区, 每个任务各拷一份
+    size_t chunks = parChunkCount(n);
+    std::vector<std::vector<Value>> runs(chunks);
+    runChunks(chunks, [&](size_t c) {
+        runs[c].assign(buf.begin() + parChunkBegin(c, n, chunks), buf.begin() + parChunkBegin(c + 1, n, chunks));
+        SortLess local(less);
+        NaturalMergeSort(runs[c], local).run();
+    });
+    while (runs.size() > 1) {
+        std::vector<std::vector<Value>> next((runs.size() + 1) / 2);
+        runChunks(next.size(), [&](size_t k) {
+            if (2 * k + 1 == runs.size()) {
+                next[k].swap(runs[2 * k]);
+                return;
+            }
+            SortLess local(less);
+            mergeRuns(runs[2 * k], runs[2 * k + 1], next[k], local);
+        });
+        runs.swap(next);
+    }
+    return isVector ? VectorV(runs[0]) : bufferToList(runs[0]);
+}
+
 Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
     // 检查类型是否为 Integer
     if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
@@ -620,6 +1477,42 @@ Value IsString::evalRator(const Value &rand) { // string?
     return BooleanV(rand->v_type == V_STRING);
 }
 
+Value IsPromise::evalRator(const Value &rand) { // promise?
+    return BooleanV(rand->v_type == V_PROMISE);
+}
+
+Value IsFuture::evalRator(const Value &rand) { // future?
+    return BooleanV(rand->v_type == V_FUTURE);
+}
+
+Value IsTask::evalRator(const Value &rand) { // task?
+    return BooleanV(rand->v_type == V_TASK);
+}
+
+Value IsChannel::evalRator(const Value &rand) { // channel?
+    return BooleanV(rand->v_type == V_CHANNEL);
+}
+
+Value IsIsolate::evalRator(const Value &rand) { // isolate?
+    return BooleanV(rand->v_type == V_ISOLATE);
+}
+
+Value IsOutputPort::evalRator(const Value &rand) { // output-port?
+    return BooleanV(rand->v_type == V_PORT);
+}
+
+Value IsVector::evalRator(const Value &rand) { // vector?
+    return BooleanV(rand->v_type == V_VECTOR);
+}
+
+Value IsPMap::evalRator(const Value &rand) { // pmap?
+    return BooleanV(rand->v_type == V_PMAP);
+}
+
+Value IsPVector::evalRator(const Value &rand) { // pvector?
+    return BooleanV(rand->v_type == V_PVECTOR);
+}
+
 Value Begin::eval(Assoc &e) {
     //TODO: To complete the begin logic
     Value res=VoidV();
@@ -784,20 +1677,60 @@ Value Lambda::eval(Assoc &env) {
     return ProcedureV(x,e,env);
 }
 
+Value LazyBody::eval(Assoc &env) {
+    return force()->eval(env);
+}
+
 Value Apply::eval(Assoc &env) {
     Value proc_val = rator->eval(env);
     if (proc_val->v_type != V_PROC) {
         throw RuntimeError("Attempt to apply a non-procedure");
     }
     
-    Procedure* proc = dynamic_cast<Procedure*>(proc_val.get());
     std::vector<Value> arg_vals;
+    if (parallel_args) {
+        evalArguments(rand, env, profile, arg_vals);
+        return applyProcedure(proc_val, arg_vals);
+    }
     
     for(auto &arg_expr : rand) {
         arg_vals.push_back(arg_expr->eval(env));
     }
-    if (auto varNode = dynamic_cast<Variadic*>(proc->e.get())) {
-        //TODO
+    return applyProcedure(proc_val, arg_vals);
+}
+
+thread_local EvalLimits *current_limits = nullptr;
+
+// 嵌套深度随调用进出加减, 异常退出时也要减回去
+struct CallDepthGuard {
+    EvalLimits *lim;
+    explicit CallDepthGuard(EvalLimits *l) : lim(l) {
+        if (!lim) return;
+        if (lim->max_steps && ++lim->steps > lim->max_steps)
+            throw RuntimeError("Step limit exceeded");
+        if (lim->max_depth && lim->depth >= lim->max_depth)
+            throw RuntimeError("Recursion depth limit exceeded");
+        lim->depth++;
+    }
+    ~CallDepthGuard() {
+        if (lim) lim->depth--;
+    }
+};
+
+Value applyProcedure(const Value &proc_val, const std::vector<Value> &arg_vals) {
+    if (proc_val->v_type != V_PROC) {
+        throw RuntimeError("Attempt to apply a non-procedure");
+    }
+    CallDepthGuard guard(current_limits);
+    if (green_scheduler) greenTick();
+    // 进程要退出了, 线程池不再等没人 touch 的 future
+    if (ThreadPool::cancelling()) throw RuntimeError("Future cancelled at exit");
+    if (isolateAbandoned()) throw RuntimeError("Isolate abandoned");
+    Procedure* proc = dynamic_cast<Procedure*>(proc_val.get());
+    // 变长原语当作值时的函数体是没有操作数的 Variadic, 实参直接交给它;
+    // 用户写的 (lambda (x) (list x)) 之类函数体也是 Variadic, 得照常求值
+    auto varNode = dynamic_cast<Variadic*>(proc->e.get());
+    if (varNode && varNode->rands.empty() && proc->parameters.empty()) {
         return varNode->evalRator(arg_vals);
     }
     if (arg_vals.size() != proc->parameters.size()) {
@@ -824,14 +1757,31 @@ Value Apply::eval(Assoc &env) {
     所以对于define,我们只需要把 add1 与 (lambda (x) (+ x 1)) 绑定即可
 */
 
+/*
+新名字插在头结点后面, 求值时捕获了这个环境的闭包之后也看得到它, 所以可以先求值再插入,
+重新定义时值里用到的还是旧的绑定, 比如 (define n (+ n 1))
+空环境只能新建一个头结点, 要先放个占位, 递归的 lambda 才捕获得到自己
+*/
 Value Define::eval(Assoc &env){
     Assoc newenv=env;
-    if(!newenv.get()){
-        auto head=Assoc(nullptr);
+    if(newenv.get()){
+        Value val=e->eval(env);
+        if (parallel_args) bumpPurityEpoch();
+        MutationLock lk;
+        EnvWriteLock wl;
+        if(newenv->x==var) newenv->v=val;   // 插在后面会被头结点挡住
+        else newenv->next=extend(var,val,newenv->next);
+        return VoidV();
+    }
+    {
+        MutationLock lk;
+        EnvWriteLock wl;
         newenv=extend(var,Value(nullptr),newenv);
     }
-    else newenv->next=extend(var,Value(nullptr),newenv->next);
-    modify(var,e->eval(newenv),newenv);
+    Value val=e->eval(newenv);
+    if (parallel_args) bumpPurityEpoch();
+    MutationLock lk;
+    modify(var,val,newenv);
     env=newenv;
     return VoidV();
 }
@@ -864,16 +1814,214 @@ Value Set::eval(Assoc &env) {
     Value val=e->eval(env);
     Value flag=find(var,env);
     if(flag.get()==nullptr)throw(RuntimeError("Undefined variable : " + var));
+    if (parallel_args) bumpPurityEpoch();
+    MutationLock lk;
     modify(var,val,env);
     return VoidV();
 }
 
-Value Display::evalRator(const Value &rand) { // display function
-    if (rand->v_type == V_STRING) {
-        String* str_ptr = dynamic_cast<String*>(rand.get());
-        std::cout << str_ptr->s;
+Value Delay::eval(Assoc &env) { // delay
+    return PromiseV(false, e, env);
+}
+
+Value DelayForce::eval(Assoc &env) { // delay-force
+    return PromiseV(true, e, env);
+}
+
+Value ConsStream::eval(Assoc &env) { // cons-stream
+    return PairV(car->eval(env), PromiseV(false, cdr, env));
+}
+
+/*
+future 的实现:
+  (future e) 把 e 和当前环境打包成 FutureState 扔进线程池, 立刻返回
+  谁先把 state 从 PENDING 改成 RUNNING (某个 worker 或者第一个 touch 的线程) 谁就负责求值
+  touch 时如果它还没开始, 就自己在当前线程求值; 如果别人正在算, 就一边等一边帮线程池干活,
+  这样 worker 里嵌套 touch 也不会把所有线程都卡死
+  求值时抛出的异常先存起来, 到 touch 时再重新抛出
+*/
+static void runFuture(const std::shared_ptr<FutureState> &st) {
+    OutputScope scope(st->out);
+    EnvSyncScope sync_scope(st->sync.get());
+    try {
+        st->value = st->e->eval(st->env);
+    } catch (...) {
+        st->error = std::current_exception();
+    }
+    st->e = Expr(nullptr);
+    st->env = Assoc(nullptr);
+    st->state.store(FutureState::DONE, std::memory_order_release);
+}
+
+Value spawnFuture(const Expr &e, const Assoc &env) {
+    std::shared_ptr<FutureState> st = std::make_shared<FutureState>(e, env);
+    ThreadPool::global().submit([st]() {
+        if (st->claim()) runFuture(st);
+    });
+    return FutureV(st);
+}
+
+Value FutureExpr::eval(Assoc &env) { // future
+    return spawnFuture(e, env);
+}
+
+Value touchFuture(const Value &v) {
+    if (v->v_type != V_FUTURE) return v;
+    std::shared_ptr<FutureState> st = static_cast<Future*>(v.get())->st;
+    if (st->claim()) {
+        runFuture(st);
     } else {
-        rand->show(std::cout);
+        ThreadPool &pool = ThreadPool::global();
+        while (st->state.load(std::memory_order_acquire) != FutureState::DONE) {
+            if (!pool.runPending()) std::this_thread::yield();
+        }
+    }
+    if (st->error) std::rethrow_exception(st->error);
+    return st->value;
+}
+
+Value Touch::evalRator(const Value &rand) { // touch
+    return touchFuture(rand);
+}
+
+Value ParallelLet::eval(Assoc &env) { // parallel-let
+    // 除第一个以外的绑定都交给线程池, 第一个就在当前线程算
+    std::vector<Value> futures(bind.size(), Value(nullptr));
+    for (size_t i = 1; i < bind.size(); i++)
+        futures[i] = spawnFuture(bind[i].second, env);
+    Assoc newenv = env;
+    std::vector<Value> vals(bind.size(), Value(nullptr));
+    std::exception_ptr first_error;
+    for (size_t i = 0; i < bind.size(); i++) {
+        // 出错也要把剩下的 future 等完, 它们还引用着当前环境
+        try {
+            vals[i] = i == 0 ? bind[0].second->eval(env) : touchFuture(futures[i]);
+        } catch (...) {
+            if (!first_error) first_error = std::current_exception();
+        }
     }
+    if (first_error) std::rethrow_exception(first_error);
+    for (size_t i = 0; i < bind.size(); i++)
+        newenv = extend(bind[i].first, vals[i], newenv);
+    return body->eval(newenv);
+}
+
+thread_local std::ostream *current_output = &std::cout;
+
+Value Display::evalRator(const Value &rand) { // display function
+    MutationLock lk;
+    displayValue(*current_output, rand);
     return VoidV();
+}
+
+void writeOutput(const std::string &text) {
+    MutationLock lk;
+    current_output->write(text.data(), text.size());
+}
+
+// 取出端口的流; 关掉了的端口不能再写
+static std::ostream &portStream(const Value &port, const char *who) {
+    if (port->v_type != V_PORT)
+        throw RuntimeError(std::string("Wrong typename in ") + who);
+    PortState *st = static_cast<OutputPort*>(port.get())->port.get();
+    if (st->closed)
+        throw RuntimeError(std::string(who) + ": port is closed");
+    return st->os;
+}
+
+Value DisplayPort::evalRator(const Value &rand, const Value &port) { // (display x port)
+    MutationLock lk;
+    displayValue(portStream(port, "display"), rand);
+    return VoidV();
+}
+
+Value Write::evalRator(const Value &rand) { // write
+    MutationLock lk;
+    rand->show(*current_output);
+    return VoidV();
+}
+
+Value WritePort::evalRator(const Value &rand, const Value &port) { // (write x port)
+    MutationLock lk;
+    rand->show(portStream(port, "write"));
+    return VoidV();
+}
+
+Value WriteString::evalRator(const Value &rand) { // write-string
+    if (rand->v_type != V_STRING)
+        throw RuntimeError("Wrong typename in write-string");
+    String *str = static_cast<String*>(rand.get());
+    MutationLock lk;
+    current_output->write(str->data(), str->size());
+    return VoidV();
+}
+
+Value WriteStringPort::evalRator(const Value &rand, const Value &port) { // (write-string s port)
+    if (rand->v_type != V_STRING)
+        throw RuntimeError("Wrong typename in write-string");
+    String *str = static_cast<String*>(rand.get());
+    MutationLock lk;
+    portStream(port, "write-string").write(str->data(), str->size());
+    return VoidV();
+}
+
+Value Newline::evalRator(const std::vector<Value> &args) { // newline
+    MutationLock lk;
+    std::ostream &os = args.empty() ? *current_output : portStream(args[0], "newline");
+    os.put('\n');
+    return VoidV();
+}
+
+Value FlushOutput::evalRator(const std::vector<Value> &args) { // flush-output
+    MutationLock lk;
+    std::ostream &os = args.empty() ? *current_output : portStream(args[0], "flush-output");
+    if (!os.flush())
+        throw RuntimeError("flush-output: write failed");
+    return VoidV();
+}
+
+Value OpenOutputFile::evalRator(const Value &path) { // open-output-file
+    if (path->v_type != V_STRING)
+        throw RuntimeError("Wrong typename in open-output-file");
+    std::string name = static_cast<String*>(path.get())->str();
+    int fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw RuntimeError("Cannot open " + name + ": " + strerror(errno));
+    return OutputPortV(std::make_shared<PortState>(std::make_unique<FdBuf>(fd, true), false));
+}
+
+Value OpenOutputString::evalRator(const std::vector<Value> &) { // open-output-string
+    return OutputPortV(std::make_shared<PortState>(std::make_unique<std::stringbuf>(), true));
+}
+
+Value GetOutputString::evalRator(const Value &port) { // get-output-string
+    if (port->v_type != V_PORT || !static_cast<OutputPort*>(port.get())->port->string_port)
+        throw RuntimeError("Wrong typename in get-output-string");
+    PortState *st = static_cast<OutputPort*>(port.get())->port.get();
+    MutationLock lk;
+    return StringV(static_cast<std::stringbuf*>(st->buf.get())->str());
+}
+
+Value CloseOutputPort::evalRator(const Value &port) { // close-output-port
+    if (port->v_type != V_PORT)
+        throw RuntimeError("Wrong typename in close-output-port");
+    PortState *st = static_cast<OutputPort*>(port.get())->port.get();
+    MutationLock lk;
+    if (st->closed) return VoidV();
+    // 字符串端口关掉以后内容还能用 get-output-string 取
+    st->closed = true;
+    if (!st->string_port && !static_cast<FdBuf*>(st->buf.get())->close())
+        throw RuntimeError("close-output-port: write failed");
+    return VoidV();
+}
+
+Value WithOutputToString::evalRator(const Value &thunk) { // with-output-to-string
+    if (thunk->v_type != V_PROC)
+        throw RuntimeError("Wrong typename in with-output-to-string");
+    std::ostringstream out;
+    {
+        OutputScope scope(&out);
+        applyProcedure(thunk, {});
+    }
+    return StringV(out.str());
 }
\ No newline at end of file
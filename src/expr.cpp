@@ -1,5 +1,6 @@
 #include "Def.hpp"
 #include "expr.hpp"
+#include "value.hpp"
 #include <cstring>
 #include <cstdlib>
 #include <vector>
@@ -19,10 +20,17 @@ int gcd(int a, int b) {
 
 ExprBase::ExprBase(ExprType et) : e_type(et) {}
 
-Expr::Expr(ExprBase * eb) : ptr(eb) {}
+thread_local Arena *ExprBase::arena = nullptr;
+
+Expr::Expr(ExprBase * eb) : ptr(Arena::wrap(eb)) {}
 ExprBase* Expr::operator->() const { return ptr.get(); }
 ExprBase& Expr::operator*() { return *ptr; }
 ExprBase* Expr::get() const { return ptr.get(); }
+Expr Expr::retained() const {
+    Expr r(nullptr);
+    r.ptr = Arena::retain(ptr);
+    return r;
+}
 
 //BASIC TYPES AND LITERALS
 
@@ -41,7 +49,7 @@ RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num
     }
 }
 
-StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str) {}
+StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(std::make_shared<const std::string>(str)) {}
 
 True::True() : ExprBase(E_TRUE) {}
 
@@ -117,6 +125,122 @@ SetCar::SetCar(const Expr &r1, const Expr &r2) : Binary(E_SETCAR, r1, r2) {}
 
 SetCdr::SetCdr(const Expr &r1, const Expr &r2) : Binary(E_SETCDR, r1, r2) {}
 
+//VECTOR OPERATIONS
+
+VectorFunc::VectorFunc(const std::vector<Expr> &rands) : Variadic(E_VECTOR, rands) {}
+
+MakeVector::MakeVector(const std::vector<Expr> &rands) : Variadic(E_MAKE_VECTOR, rands) {}
+
+VectorRef::VectorRef(const Expr &r1, const Expr &r2) : Binary(E_VECTOR_REF, r1, r2) {}
+
+VectorSet::VectorSet(const std::vector<Expr> &rands) : Variadic(E_VECTOR_SET, rands) {}
+
+VectorLength::VectorLength(const Expr &r1) : Unary(E_VECTOR_LENGTH, r1) {}
+
+VectorToList::VectorToList(const Expr &r1) : Unary(E_VECTOR_TO_LIST, r1) {}
+
+ListToVector::ListToVector(const Expr &r1) : Unary(E_LIST_TO_VECTOR, r1) {}
+
+//STRING OPERATIONS
+
+StringAppend::StringAppend(const std::vector<Expr> &rands) : Variadic(E_STRING_APPEND, rands) {}
+
+Substring::Substring(const std::vector<Expr> &rands) : Variadic(E_SUBSTRING, rands) {}
+
+StringLength::StringLength(const Expr &r1) : Unary(E_STRING_LENGTH, r1) {}
+
+StringRef::StringRef(const Expr &r1, const Expr &r2) : Binary(E_STRING_REF, r1, r2) {}
+
+StringToSymbol::StringToSymbol(const Expr &r1) : Unary(E_STRING_TO_SYMBOL, r1) {}
+
+SymbolToString::SymbolToString(const Expr &r1) : Unary(E_SYMBOL_TO_STRING, r1) {}
+
+StringToNumber::StringToNumber(const Expr &r1) : Unary(E_STRING_TO_NUMBER, r1) {}
+
+NumberToString::NumberToString(const Expr &r1) : Unary(E_NUMBER_TO_STRING, r1) {}
+
+StringIndex::StringIndex(const Expr &r1, const Expr &r2) : Binary(E_STRING_INDEX, r1, r2) {}
+
+StringSearch::StringSearch(const std::vector<Expr> &rands) : Variadic(E_STRING_SEARCH, rands) {}
+
+MakeStringBuilder::MakeStringBuilder(const std::vector<Expr> &rands) : Variadic(E_MAKE_STRING_BUILDER, rands) {}
+
+StringBuilderAppend::StringBuilderAppend(const std::vector<Expr> &rands) : Variadic(E_STRING_BUILDER_APPEND, rands) {}
+
+StringBuilderToString::StringBuilderToString(const Expr &r1) : Unary(E_STRING_BUILDER_TO_STRING, r1) {}
+
+//PERSISTENT COLLECTIONS
+
+MakePMap::MakePMap(const std::vector<Expr> &rands) : Variadic(E_MAKE_PMAP, rands) {}
+
+PMapSet::PMapSet(const std::vector<Expr> &rands) : Variadic(E_PMAP_SET, rands) {}
+
+PMapRef::PMapRef(const std::vector<Expr> &rands) : Variadic(E_PMAP_REF, rands) {}
+
+PMapRemove::PMapRemove(const Expr &r1, const Expr &r2) : Binary(E_PMAP_REMOVE, r1, r2) {}
+
+PMapContains::PMapContains(const Expr &r1, const Expr &r2) : Binary(E_PMAP_CONTAINS, r1, r2) {}
+
+PMapCount::PMapCount(const Expr &r1) : Unary(E_PMAP_COUNT, r1) {}
+
+PMapToList::PMapToList(const Expr &r1) : Unary(E_PMAP_TO_LIST, r1) {}
+
+PVectorFunc::PVectorFunc(const std::vector<Expr> &rands) : Variadic(E_PVECTOR, rands) {}
+
+PVectorLength::PVectorLength(const Expr &r1) : Unary(E_PVECTOR_LENGTH, r1) {}
+
+PVectorRef::PVectorRef(const Expr &r1, const Expr &r2) : Binary(E_PVECTOR_REF, r1, r2) {}
+
+PVectorSet::PVectorSet(const std::vector<Expr> &rands) : Variadic(E_PVECTOR_SET, rands) {}
+
+PVectorPush::PVectorPush(const Expr &r1, const Expr &r2) : Binary(E_PVECTOR_PUSH, r1, r2) {}
+
+PVectorToList::PVectorToList(const Expr &r1) : Unary(E_PVECTOR_TO_LIST, r1) {}
+
+//PROMISES AND STREAMS
+
+Force::Force(const Expr &r1) : Unary(E_FORCE, r1) {}
+
+MakePromise::MakePromise(const Expr &r1) : Unary(E_MAKE_PROMISE, r1) {}
+
+StreamCar::StreamCar(const Expr &r1) : Unary(E_STREAM_CAR, r1) {}
+
+StreamCdr::StreamCdr(const Expr &r1) : Unary(E_STREAM_CDR, r1) {}
+
+//FUTURES
+
+Touch::Touch(const Expr &r1) : Unary(E_TOUCH, r1) {}
+
+//DATA-PARALLEL OPERATIONS
+
+ParMap::ParMap(const Expr &r1, const Expr &r2) : Binary(E_PAR_MAP, r1, r2) {}
+
+ParForEach::ParForEach(const Expr &r1, const Expr &r2) : Binary(E_PAR_FOR_EACH, r1, r2) {}
+
+ParReduce::ParReduce(const vector<Expr> &args) : Variadic(E_PAR_REDUCE, args) {}
+
+ParSort::ParSort(const Expr &r1, const Expr &r2) : Binary(E_PAR_SORT, r1, r2) {}
+
+//SORTING
+
+Sort::Sort(const Expr &r1, const Expr &r2) : Binary(E_SORT, r1, r2) {}
+
+VectorSort::VectorSort(const Expr &r1, const Expr &r2) : Binary(E_VECTOR_SORT, r1, r2) {}
+
+//RECORD OPERATIONS
+
+RecordConstructor::RecordConstructor(const std::shared_ptr<RecordType> &type, const std::vector<size_t> &slots)
+    : Variadic(E_RECORD_CTOR, {}), type(type), slot_of_arg(slots) {}
+
+RecordPredicate::RecordPredicate(const std::shared_ptr<RecordType> &type)
+    : Variadic(E_RECORD_PRED, {}), type(type) {}
+
+RecordAccessor::RecordAccessor(const std::shared_ptr<RecordType> &type, size_t slot)
+    : Variadic(E_RECORD_GET, {}), type(type), slot(slot) {}
+
+RecordModifier::RecordModifier(const std::shared_ptr<RecordType> &type, size_t slot)
+    : Variadic(E_RECORD_SET, {}), type(type), slot(slot) {}
+
 //LOGIC OPERATIONS
 
 Not::Not(const Expr &r1) : Unary(E_NOT, r1) {}
@@ -145,11 +269,29 @@ IsList::IsList(const Expr &r1) : Unary(E_LISTQ, r1) {}
 
 IsString::IsString(const Expr &r1) : Unary(E_STRINGQ, r1) {}
 
+IsPromise::IsPromise(const Expr &r1) : Unary(E_PROMISEQ, r1) {}
+
+IsFuture::IsFuture(const Expr &r1) : Unary(E_FUTUREQ, r1) {}
+
+IsTask::IsTask(const Expr &r1) : Unary(E_TASKQ, r1) {}
+
+IsChannel::IsChannel(const Expr &r1) : Unary(E_CHANNELQ, r1) {}
+
+IsIsolate::IsIsolate(const Expr &r1) : Unary(E_ISOLATEQ, r1) {}
+
+IsOutputPort::IsOutputPort(const Expr &r1) : Unary(E_OUTPUT_PORTQ, r1) {}
+
+IsVector::IsVector(const Expr &r1) : Unary(E_VECTORQ, r1) {}
+
+IsPMap::IsPMap(const Expr &r1) : Unary(E_PMAPQ, r1) {}
+
+IsPVector::IsPVector(const Expr &r1) : Unary(E_PVECTORQ, r1) {}
+
 //CONTROL FLOW CONSTRUCTS
 
 Begin::Begin(const vector<Expr> &vec) : ExprBase(E_BEGIN), es(vec) {}
 
-Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t) {}
+Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(Arena::of(t.get()) ? copySyntax(t) : t) {}
 
 //CONDITIONAL
 
@@ -165,6 +307,11 @@ Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rat
 
 Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
 
+LazyBody::LazyBody(const vector<Syntax> &stxs, const Assoc &env)
+    : ExprBase(E_LAZY_BODY), scope(env.ptr), ready(false), parsed(nullptr) {
+    for (auto &stx : stxs) body.push_back(stx.retained());
+}
+
 Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
 
 //BINDING CONSTRUCTS
@@ -177,6 +324,97 @@ Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr) : ExprBa
 
 Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e) {}
 
+//LAZY EVALUATION
+
+Delay::Delay(const Expr &expr) : ExprBase(E_DELAY), e(expr) {}
+
+DelayForce::DelayForce(const Expr &expr) : ExprBase(E_DELAY_FORCE), e(expr) {}
+
+ConsStream::ConsStream(const Expr &a, const Expr &b) : ExprBase(E_CONS_STREAM), car(a), cdr(b) {}
+
+//PARALLEL EVALUATION
+
+FutureExpr::FutureExpr(const Expr &expr) : ExprBase(E_FUTURE), e(expr) {}
+
+ParallelLet::ParallelLet(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_PARALLEL_LET), bind(vec), body(e) {}
+
+//GREEN THREADS
+
+Spawn::Spawn(const Expr &r) : Unary(E_SPAWN, r) {}
+
+Yield::Yield(const vector<Expr> &rands) : Variadic(E_YIELD, rands) {}
+
+TaskJoin::TaskJoin(const Expr &r) : Unary(E_TASK_JOIN, r) {}
+
+MakeChannel::MakeChannel(const vector<Expr> &rands) : Variadic(E_MAKE_CHANNEL, rands) {}
+
+ChannelSend::ChannelSend(const Expr &r1, const Expr &r2) : Binary(E_CHANNEL_SEND, r1, r2) {}
+
+ChannelRecv::ChannelRecv(const Expr &r) : Unary(E_CHANNEL_RECV, r) {}
+
+FdWait::FdWait(const Expr &r) : Unary(E_FD_WAIT, r) {}
+
+FdRead::FdRead(const Expr &r) : Unary(E_FD_READ, r) {}
+
+//ISOLATES
+
+SpawnIsolate::SpawnIsolate(const Expr &r) : Unary(E_SPAWN_ISOLATE, r) {}
+
+IsolateSend::IsolateSend(const Expr &r1, const Expr &r2) : Binary(E_ISOLATE_SEND, r1, r2) {}
+
+IsolateReceive::IsolateReceive(const vector<Expr> &rands) : Variadic(E_ISOLATE_RECEIVE, rands) {}
+
+IsolateJoin::IsolateJoin(const Expr &r) : Unary(E_ISOLATE_JOIN, r) {}
+
+IsolateParent::IsolateParent(const vector<Expr> &rands) : Variadic(E_ISOLATE_PARENT, rands) {}
+
+//REMOTE WORKERS
+
+RemoteApply::RemoteApply(const vector<Expr> &rands) : Variadic(E_REMOTE_APPLY, rands) {}
+
+RemoteMap::RemoteMap(const Expr &r1, const Expr &r2) : Binary(E_REMOTE_MAP, r1, r2) {}
+
+//HEAP IMAGES
+
+SaveImage::SaveImage(const Expr &r) : Unary(E_SAVE_IMAGE, r) {}
+
+//LOADING SOURCE FILES
+
+Load::Load(const Expr &r) : Unary(E_LOAD, r) {}
+
+//NATIVE EXTENSIONS
+
+NativeProc::NativeProc(const string &name, int arity, const NativeFunction &fn)
+    : Variadic(E_NATIVE, {}), name(name), arity(arity), fn(fn) {}
+
+LoadExtension::LoadExtension(const Expr &r) : Unary(E_LOAD_EXTENSION, r) {}
+
 //I/O OPERATIONS
 
-Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
\ No newline at end of file
+Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
+
+DisplayPort::DisplayPort(const Expr &r1, const Expr &r2) : Binary(E_DISPLAY, r1, r2) {}
+
+Write::Write(const Expr &r) : Unary(E_WRITE, r) {}
+
+WritePort::WritePort(const Expr &r1, const Expr &r2) : Binary(E_WRITE, r1, r2) {}
+
+WriteString::WriteString(const Expr &r) : Unary(E_WRITE_STRING, r) {}
+
+WriteStringPort::WriteStringPort(const Expr &r1, const Expr &r2) : Binary(E_WRITE_STRING, r1, r2) {}
+
+Newline::Newline(const std::vector<Expr> &rands) : Variadic(E_NEWLINE, rands) {}
+
+FlushOutput::FlushOutput(const std::vector<Expr> &rands) : Variadic(E_FLUSH_OUTPUT, rands) {}
+
+//OUTPUT PORTS
+
+OpenOutputFile::OpenOutputFile(const Expr &r) : Unary(E_OPEN_OUTPUT_FILE, r) {}
+
+OpenOutputString::OpenOutputString(const std::vector<Expr> &rands) : Variadic(E_OPEN_OUTPUT_STRING, rands) {}
+
+GetOutputString::GetOutputString(const Expr &r) : Unary(E_GET_OUTPUT_STRING, r) {}
+
+CloseOutputPort::CloseOutputPort(const Expr &r) : Unary(E_CLOSE_OUTPUT_PORT, r) {}
+
+WithOutputToString::WithOutputToString(const Expr &r) : Unary(E_WITH_OUTPUT_TO_STRING, r) {}
\ No newline at end of file
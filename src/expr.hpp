@@ -22,12 +22,25 @@ public:
 #include <memory>
 #include <cstring>
 #include <vector>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+struct RecordType;
+struct Procedure;
 
 struct ExprBase{
     ExprType e_type;
     ExprBase(ExprType);
     virtual Value eval(Assoc &) = 0;
     virtual ~ExprBase() = default;
+
+    /** @brief Arena new Expr nodes go to on this thread (see arena.hpp), or nullptr */
+    static thread_local Arena *arena;
+    static void *operator new(size_t n) { return Arena::allocate(arena, n); }
+    static void operator delete(void *p) { Arena::release(p); }
 };
 
 class Expr {
@@ -37,6 +50,8 @@ public:
     ExprBase* operator->() const;
     ExprBase& operator*();
     ExprBase* get() const;
+    /** @brief Same node, keeping its arena alive; use for anything kept after parsing */
+    Expr retained() const;
 };
 
 // ================================================================================
@@ -69,7 +84,7 @@ struct RationalNum : ExprBase {
  * Represents string values
  */
 struct StringExpr : ExprBase {
-  std::string s;
+  std::shared_ptr<const std::string> s;  ///< Shared with every evaluated String
   StringExpr(const std::string &);
   virtual Value eval(Assoc &) override;
 };
@@ -104,6 +119,18 @@ struct Exit : ExprBase {
 //                             BASIC ABSTRACT TYPES FOR PARAMETERS
 // ================================================================================
 
+/**
+ * @brief Per call site evaluation cost of each argument (see purity.hpp)
+ * Only allocated once --parallel-args is on and the site is evaluated.
+ */
+class CallSiteProfile {
+    std::atomic<std::atomic<uint64_t>*> costs;
+public:
+    CallSiteProfile();
+    ~CallSiteProfile();
+    std::atomic<uint64_t> *get(size_t nargs);
+};
+
 struct Unary : ExprBase {
     Expr rand;
     Unary(ExprType, const Expr &);
@@ -114,6 +141,7 @@ struct Unary : ExprBase {
 struct Binary : ExprBase {
     Expr rand1;
     Expr rand2;
+    CallSiteProfile profile;
     Binary(ExprType, const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) = 0;
     virtual Value eval(Assoc &) override;
@@ -121,6 +149,7 @@ struct Binary : ExprBase {
 
 struct Variadic : ExprBase {
     std::vector<Expr> rands;
+    CallSiteProfile profile;
     Variadic(ExprType, const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) = 0;
     virtual Value eval(Assoc &) override;
@@ -268,6 +297,340 @@ struct SetCdr : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+// ================================================================================
+//                             VECTOR OPERATIONS
+// ================================================================================
+
+struct VectorFunc : Variadic {
+    VectorFunc(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct MakeVector : Variadic {
+    MakeVector(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct VectorRef : Binary {
+    VectorRef(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct VectorSet : Variadic {
+    VectorSet(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct VectorLength : Unary {
+    VectorLength(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct VectorToList : Unary {
+    VectorToList(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct ListToVector : Unary {
+    ListToVector(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             STRING OPERATIONS
+// ================================================================================
+
+struct StringAppend : Variadic {
+    StringAppend(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (substring s start [end]), a zero-copy slice of s
+ */
+struct Substring : Variadic {
+    Substring(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct StringLength : Unary {
+    StringLength(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (string-ref s k), the k-th character as a one-character string
+ */
+struct StringRef : Binary {
+    StringRef(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct StringToSymbol : Unary {
+    StringToSymbol(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct SymbolToString : Unary {
+    SymbolToString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StringToNumber : Unary {
+    StringToNumber(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct NumberToString : Unary {
+    NumberToString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (string-index s ch), position of the first ch in s or #f
+ */
+struct StringIndex : Binary {
+    StringIndex(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (string-search pattern s [start]), position of pattern in s or #f
+ */
+struct StringSearch : Variadic {
+    StringSearch(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct MakeStringBuilder : Variadic {
+    MakeStringBuilder(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct StringBuilderAppend : Variadic {
+    StringBuilderAppend(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct StringBuilderToString : Unary {
+    StringBuilderToString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             PERSISTENT COLLECTIONS
+// ================================================================================
+
+struct MakePMap : Variadic {
+    MakePMap(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct PMapSet : Variadic {
+    PMapSet(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct PMapRef : Variadic {
+    PMapRef(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct PMapRemove : Binary {
+    PMapRemove(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct PMapContains : Binary {
+    PMapContains(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct PMapCount : Unary {
+    PMapCount(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct PMapToList : Unary {
+    PMapToList(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct PVectorFunc : Variadic {
+    PVectorFunc(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct PVectorLength : Unary {
+    PVectorLength(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct PVectorRef : Binary {
+    PVectorRef(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct PVectorSet : Variadic {
+    PVectorSet(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct PVectorPush : Binary {
+    PVectorPush(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct PVectorToList : Unary {
+    PVectorToList(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             PROMISES AND STREAMS
+// ================================================================================
+
+struct Force : Unary {
+    Force(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct MakePromise : Unary {
+    MakePromise(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StreamCar : Unary {
+    StreamCar(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StreamCdr : Unary {
+    StreamCdr(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief Forces a promise iteratively, memoizing the result
+ * Non-promise values are returned unchanged
+ */
+Value forcePromise(const Value &);
+
+// ================================================================================
+//                                  FUTURES
+// ================================================================================
+
+struct Touch : Unary {
+    Touch(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief Waits for a future, helping the pool while it runs elsewhere
+ * Non-future values are returned unchanged
+ */
+Value touchFuture(const Value &);
+
+/**
+ * @brief Schedules e in env on the thread pool, as (future e) does
+ */
+Value spawnFuture(const Expr &, const Assoc &);
+
+// ================================================================================
+//                          DATA-PARALLEL OPERATIONS
+// ================================================================================
+
+/**
+ * @brief (pmap proc seq): map over a list or vector in chunks on the pool
+ * Results keep the input order and sequence kind
+ */
+struct ParMap : Binary {
+    ParMap(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (pfor-each proc seq); calls may happen in any order
+ */
+struct ParForEach : Binary {
+    ParForEach(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (preduce combine init seq) for an associative combine with identity init
+ */
+struct ParReduce : Variadic {
+    ParReduce(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (psort less? seq): stable sort of a list or vector into a new sequence
+ */
+struct ParSort : Binary {
+    ParSort(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+// ================================================================================
+//                             SORTING
+// ================================================================================
+
+/**
+ * @brief (sort less? list) / (list-sort less? list)
+ * Stable natural merge sort; returns a freshly built list
+ */
+struct Sort : Binary {
+    Sort(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (vector-sort! less? vector)
+ * Stable natural merge sort of the vector in place
+ */
+struct VectorSort : Binary {
+    VectorSort(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+// ================================================================================
+//                             RECORD OPERATIONS
+// ================================================================================
+
+/*
+ * define-record-type 生成的过程体都是 Variadic, Apply 会直接调用 evalRator,
+ * 不用扩展环境也不用查变量, 和内置 primitive 一样快
+ */
+
+struct RecordConstructor : Variadic {
+    std::shared_ptr<RecordType> type;
+    std::vector<size_t> slot_of_arg;   ///< Slot filled by each constructor argument
+    RecordConstructor(const std::shared_ptr<RecordType> &, const std::vector<size_t> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct RecordPredicate : Variadic {
+    std::shared_ptr<RecordType> type;
+    RecordPredicate(const std::shared_ptr<RecordType> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct RecordAccessor : Variadic {
+    std::shared_ptr<RecordType> type;
+    size_t slot;
+    RecordAccessor(const std::shared_ptr<RecordType> &, size_t);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct RecordModifier : Variadic {
+    std::shared_ptr<RecordType> type;
+    size_t slot;
+    RecordModifier(const std::shared_ptr<RecordType> &, size_t);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
 // ================================================================================
 //                             LOGIC OPERATIONS
 // ================================================================================
@@ -338,6 +701,51 @@ struct IsString : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+struct IsPromise : Unary {
+    IsPromise(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsFuture : Unary {
+    IsFuture(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsTask : Unary {
+    IsTask(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsChannel : Unary {
+    IsChannel(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsIsolate : Unary {
+    IsIsolate(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsOutputPort : Unary {
+    IsOutputPort(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsVector : Unary {
+    IsVector(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsPMap : Unary {
+    IsPMap(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsPVector : Unary {
+    IsPVector(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 // ================================================================================
 //                             CONTROL FLOW CONSTRUCTS
 // ================================================================================
@@ -385,10 +793,38 @@ struct Var : ExprBase {
 struct Apply : ExprBase {
     Expr rator;
     std::vector<Expr> rand;
+    CallSiteProfile profile;
     Apply(const Expr &, const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
 };
 
+/**
+ * @brief Calls an already evaluated procedure value on evaluated arguments
+ * Shared by Apply::eval and natively implemented higher-order primitives
+ */
+Value applyProcedure(const Value &, const std::vector<Value> &);
+
+/**
+ * @brief Name of the primitive a procedure value was made from by Var::eval
+ * @return empty for every other procedure
+ */
+std::string primitiveName(const Procedure *);
+
+/**
+ * @brief Resource limits checked by applyProcedure; 0 means unlimited
+ */
+struct EvalLimits {
+    size_t max_depth = 0;    ///< Nested procedure calls
+    uint64_t max_steps = 0;  ///< Procedure calls per top-level evaluation
+    size_t depth = 0;
+    uint64_t steps = 0;
+};
+
+/**
+ * @brief Limits of the session running on this thread, or nullptr
+ */
+extern thread_local EvalLimits *current_limits;
+
 struct Lambda : ExprBase {
     std::vector<std::string> x;
     Expr e;
@@ -396,6 +832,40 @@ struct Lambda : ExprBase {
     virtual Value eval(Assoc &) override;
 };
 
+/**
+ * @brief Lambda body kept as syntax until its first evaluation (--lazy-lambda)
+ * The body is parsed once, in the scope the lambda was parsed in; until
+ * then the syntax's arena stays alive. A body that does not parse raises
+ * the same RuntimeError on every call instead of when it is defined.
+ */
+struct LazyBody : ExprBase {
+    LazyBody(const std::vector<Syntax> &, const Assoc &);
+    /**
+     * @brief The parsed body
+     * @throws RuntimeError if it does not parse
+     */
+    ExprBase *force();
+    virtual Value eval(Assoc &) override;
+private:
+    std::vector<Syntax> body;
+    std::shared_ptr<AssocList> scope;
+    std::atomic<bool> ready;
+    std::mutex m;
+    Expr parsed;
+    std::exception_ptr error;
+};
+
+/**
+ * @brief Whether lambda and define bodies are parsed on first call
+ */
+extern bool lazy_lambda;
+
+/**
+ * @brief Whether this thread defers bodies even without lazy_lambda
+ * Set while load replays a cached file that is known to parse.
+ */
+extern thread_local bool defer_bodies;
+
 struct Define : ExprBase {
     std::string var;
     Expr e;
@@ -432,6 +902,249 @@ struct Set : ExprBase {
     virtual Value eval(Assoc &) override;
 };
 
+// ================================================================================
+//                             LAZY EVALUATION
+// ================================================================================
+
+struct Delay : ExprBase {
+    Expr e;
+    Delay(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+struct DelayForce : ExprBase {
+    Expr e;
+    DelayForce(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief (cons-stream a b), i.e. (cons a (delay b))
+ */
+struct ConsStream : ExprBase {
+    Expr car;
+    Expr cdr;
+    ConsStream(const Expr &, const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                            PARALLEL EVALUATION
+// ================================================================================
+
+/**
+ * @brief (future e): schedules e on the thread pool and returns a future
+ * Variable lookups are safe against concurrent define and set!, but a
+ * read-modify-write such as (set! n (+ n 1)) is not atomic, and reading
+ * a pair or vector another thread is mutating is undefined.
+ */
+struct FutureExpr : ExprBase {
+    Expr e;
+    FutureExpr(const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+/**
+ * @brief let whose binding expressions are evaluated concurrently
+ */
+struct ParallelLet : ExprBase {
+    std::vector<std::pair<std::string, Expr>> bind;
+    Expr body;
+    ParallelLet(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
+    virtual Value eval(Assoc &) override;
+};
+
+// ================================================================================
+//                             GREEN THREADS
+// ================================================================================
+
+/**
+ * @brief (spawn thunk): queue thunk as a green thread, returns its task
+ */
+struct Spawn : Unary {
+    Spawn(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (yield): let the other runnable green threads run
+ */
+struct Yield : Variadic {
+    Yield(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (task-join task): wait for the task, return its result or rethrow its error
+ */
+struct TaskJoin : Unary {
+    TaskJoin(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (make-channel [capacity]): unbounded when capacity is omitted
+ */
+struct MakeChannel : Variadic {
+    MakeChannel(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (channel-send ch v): blocks the green thread while the channel is full
+ */
+struct ChannelSend : Binary {
+    ChannelSend(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (channel-recv ch): blocks the green thread while the channel is empty
+ */
+struct ChannelRecv : Unary {
+    ChannelRecv(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (fd-wait fd): suspend the green thread until fd is readable
+ */
+struct FdWait : Unary {
+    FdWait(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (fd-read fd): fd-wait, then up to 4096 bytes as a string; "" at end of file
+ */
+struct FdRead : Unary {
+    FdRead(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             ISOLATES
+// ================================================================================
+
+/**
+ * @brief (spawn-isolate thunk): apply a deep copy of thunk in a new
+ * interpreter on its own thread; returns the isolate's handle
+ */
+struct SpawnIsolate : Unary {
+    SpawnIsolate(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (isolate-send! isolate v): put a deep copy of v in the isolate's mailbox
+ */
+struct IsolateSend : Binary {
+    IsolateSend(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (isolate-receive): next message of the calling isolate, waiting for one
+ */
+struct IsolateReceive : Variadic {
+    IsolateReceive(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (isolate-join isolate): wait for the thunk, return a copy of its result
+ */
+struct IsolateJoin : Unary {
+    IsolateJoin(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (isolate-parent): handle of the isolate that spawned the caller
+ */
+struct IsolateParent : Variadic {
+    IsolateParent(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+// ================================================================================
+//                             REMOTE WORKERS
+// ================================================================================
+
+/**
+ * @brief (remote-apply proc arg ...): apply proc in a worker process
+ * proc and the arguments are serialized (see serialize.hpp), and so is
+ * the result; output the procedure displays is replayed locally.
+ */
+struct RemoteApply : Variadic {
+    RemoteApply(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (remote-map proc seq): map proc over a list or vector using all workers
+ */
+struct RemoteMap : Binary {
+    RemoteMap(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+// ================================================================================
+//                             HEAP IMAGES
+// ================================================================================
+
+/**
+ * @brief (save-image "file"): save the global environment (see image.hpp)
+ * Load it back with code --image file.
+ */
+struct SaveImage : Unary {
+    SaveImage(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             LOADING SOURCE FILES
+// ================================================================================
+
+/**
+ * @brief (load "file"): evaluate a source file's forms in the global environment
+ * Files are cached in compiled form (see loadcache.hpp).
+ */
+struct Load : Unary {
+    Load(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             NATIVE EXTENSIONS
+// ================================================================================
+
+/**
+ * @brief C++ implementation behind a native procedure, on evaluated arguments
+ */
+typedef std::function<Value(const std::vector<Value> &)> NativeFunction;
+
+/**
+ * @brief Procedure body of a function registered with Interpreter::define_native
+ * Applied like the record procedures: straight to evalRator, no environment.
+ */
+struct NativeProc : Variadic {
+    std::string name;
+    int arity;            ///< Required argument count, -1 for any
+    NativeFunction fn;
+    NativeProc(const std::string &, int, const NativeFunction &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (load-extension path): dlopen a shared object and run its
+ * scheme_init_extension(Interpreter &) against the current interpreter
+ */
+struct LoadExtension : Unary {
+    LoadExtension(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 // ================================================================================
 //                              I/O OPERATIONS
 // ================================================================================
@@ -441,4 +1154,129 @@ struct Display : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+/**
+ * @brief (display x port)
+ */
+struct DisplayPort : Binary {
+    DisplayPort(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (write x): print x as the REPL does, strings in quotes
+ */
+struct Write : Unary {
+    Write(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (write x port)
+ */
+struct WritePort : Binary {
+    WritePort(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (write-string s): the characters of s; s must be a string
+ */
+struct WriteString : Unary {
+    WriteString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (write-string s port)
+ */
+struct WriteStringPort : Binary {
+    WriteStringPort(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (newline [port])
+ */
+struct Newline : Variadic {
+    Newline(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (flush-output [port]): write out what the port has buffered
+ */
+struct FlushOutput : Variadic {
+    FlushOutput(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+// ================================================================================
+//                              OUTPUT PORTS
+// ================================================================================
+
+/**
+ * @brief (open-output-file "file"): a port writing to file, truncating it
+ * Written out when its buffer fills, on flush-output and when closed.
+ */
+struct OpenOutputFile : Unary {
+    OpenOutputFile(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (open-output-string): a port collecting its output in a string
+ */
+struct OpenOutputString : Variadic {
+    OpenOutputString(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (get-output-string port): everything written to a string port so far
+ */
+struct GetOutputString : Unary {
+    GetOutputString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (close-output-port port): flush and close; later writes are errors
+ */
+struct CloseOutputPort : Unary {
+    CloseOutputPort(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (with-output-to-string thunk): what thunk displays, as a string
+ * Futures and green threads started by thunk must be done writing by the
+ * time it returns.
+ */
+struct WithOutputToString : Unary {
+    WithOutputToString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief Stream that display and the REPL write to
+ * Thread-local so that concurrent sessions keep their output apart; work
+ * handed to other threads (futures, pmap, ...) carries the spawner's stream.
+ */
+extern thread_local std::ostream *current_output;
+
+/**
+ * @brief Writes text to current_output under the lock display takes
+ * For output produced elsewhere, e.g. an isolate's buffer on isolate-join.
+ */
+void writeOutput(const std::string &text);
+
+/**
+ * @brief Redirects current_output for the lifetime of the scope
+ */
+struct OutputScope {
+    std::ostream *saved;
+    explicit OutputScope(std::ostream *os) : saved(current_output) { current_output = os; }
+    ~OutputScope() { current_output = saved; }
+};
+
 #endif
@@ -0,0 +1,405 @@
+/**
+ * @file green.cpp
+ * @brief Green thread scheduler, task stacks, channels and the epoll loop
+ */
+
+#include "green.hpp"
+#include "expr.hpp"
+#include "interpreter.hpp"
+#include "RE.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t TASK_STACK_SIZE = 8u << 20;   // 只占地址空间, 用到哪页才真的分配哪页
+const size_t STACK_CACHE = 16;
+const int TASK_QUANTUM = 1024;             // 每跑这么多次过程调用让一次
+
+void dropWaiter(std::deque<GreenTask*> &q, GreenTask *t) {
+    q.erase(std::remove(q.begin(), q.end(), t), q.end());
+}
+
+} // namespace
+
+class GreenScheduler {
+public:
+    GreenTask root;
+    GreenTask *current;
+    std::deque<GreenTask*> runq;
+    std::unordered_map<GreenTask*, std::shared_ptr<GreenTask>> alive;  ///< Spawned and not finished
+    GreenTask *zombie = nullptr;   ///< Finished task whose stack is freed after the next switch
+    int epfd = -1;
+    std::unordered_map<int, std::vector<GreenTask*>> fd_waiters;
+    size_t fd_waiting = 0;
+    std::vector<void*> stacks;
+    int budget = TASK_QUANTUM;
+
+    GreenScheduler() : current(&root) { root.owner = this; }
+    ~GreenScheduler();
+
+    void *allocStack();
+    void freeStack(void *);
+    void save(GreenTask *);
+    void restore(GreenTask *);
+    void afterSwitch();
+    void switchTo(GreenTask *);
+    GreenTask *pickNext();
+    void wake(GreenTask *);
+    bool block();
+    void yield();
+    void pollFds(int timeout);
+    void waitFd(int fd);
+    Value spawn(const Value &thunk);
+    Value join(GreenTask *);
+    [[noreturn]] void finish(GreenTask *);
+};
+
+thread_local GreenScheduler *green_scheduler = nullptr;
+static thread_local std::unique_ptr<GreenScheduler> scheduler_owner;
+
+static GreenScheduler &scheduler() {
+    if (!green_scheduler) {
+        scheduler_owner.reset(new GreenScheduler());
+        green_scheduler = scheduler_owner.get();
+    }
+    return *green_scheduler;
+}
+
+// 还没跑完的任务直接丢掉, 它们栈上的对象不会析构
+GreenScheduler::~GreenScheduler() {
+    for (auto &it : alive)
+        if (it.second->stack) munmap(it.second->stack, TASK_STACK_SIZE);
+    for (void *s : stacks) munmap(s, TASK_STACK_SIZE);
+    if (epfd >= 0) close(epfd);
+}
+
+void *GreenScheduler::allocStack() {
+    if (!stacks.empty()) {
+        void *s = stacks.back();
+        stacks.pop_back();
+        return s;
+    }
+    void *s = mmap(nullptr, TASK_STACK_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (s == MAP_FAILED)
+        throw RuntimeError("Cannot allocate task stack");
+    // 栈往低地址长, 最低一页做保护页, 溢出时直接段错误而不是踩坏别的内存
+    mprotect(s, (size_t)getpagesize(), PROT_NONE);
+    return s;
+}
+
+void GreenScheduler::freeStack(void *s) {
+    if (stacks.size() < STACK_CACHE) {
+        size_t page = (size_t)getpagesize();
+        madvise((char*)s + page, TASK_STACK_SIZE - page, MADV_DONTNEED);
+        stacks.push_back(s);
+    } else {
+        munmap(s, TASK_STACK_SIZE);
+    }
+}
+
+void GreenScheduler::save(GreenTask *t) {
+    t->out = current_output;
+    t->limits = current_limits;
+    t->depth = current_limits ? current_limits->depth : 0;
+    t->interp = current_interpreter;
+    t->sync = current_env_sync;
+}
+
+void GreenScheduler::restore(GreenTask *t) {
+    current_output = t->out;
+    current_limits = t->limits;
+    if (current_limits) current_limits->depth = t->depth;
+    current_interpreter = t->interp;
+    current_env_sync = t->sync;
+}
+
+void GreenScheduler::afterSwitch() {
+    if (zombie) {
+        GreenTask *z = zombie;
+        zombie = nullptr;
+        freeStack(z->stack);
+        z->stack = nullptr;
+        alive.erase(z);
+    }
+    restore(current);
+    budget = TASK_QUANTUM;
+}
+
+void GreenScheduler::switchTo(GreenTask *next) {
+    GreenTask *prev = current;
+    if (next == prev) return;
+    save(prev);
+    current = next;
+    swapcontext(&prev->ctx, &next->ctx);
+    afterSwitch();
+}
+
+/*
+没有可运行的任务时在 epoll 上等; 连等的 fd 都没有, 就再也没人能被唤醒了,
+这时把 root 叫醒并让它报死锁
+*/
+GreenTask *GreenScheduler::pickNext() {
+    while (1) {
+        if (!runq.empty()) {
+            GreenTask *t = runq.front();
+            runq.pop_front();
+            return t;
+        }
+        if (fd_waiting) {
+            pollFds(-1);
+            continue;
+        }
+        root.deadlocked = true;
+        return &root;
+    }
+}
+
+void GreenScheduler::wake(GreenTask *t) {
+    t->state = GreenTask::RUNNABLE;
+    runq.push_back(t);
+}
+
+// 调用前当前任务已经挂在某个等待队列上; 返回 false 表示死锁, 需要自己从队列里摘掉
+bool GreenScheduler::block() {
+    GreenTask *self = current;
+    self->state = GreenTask::BLOCKED;
+    switchTo(pickNext());
+    self->state = GreenTask::RUNNABLE;
+    if (self->deadlocked) {
+        self->deadlocked = false;
+        return false;
+    }
+    return true;
+}
+
+void GreenScheduler::yield() {
+    if (fd_waiting) pollFds(0);
+    if (runq.empty()) return;
+    runq.push_back(current);
+    switchTo(pickNext());
+}
+
+void GreenScheduler::pollFds(int timeout) {
+    epoll_event events[64];
+    int n = epoll_wait(epfd, events, 64, timeout);
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        auto it = fd_waiters.find(fd);
+        if (it == fd_waiters.end()) continue;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        for (GreenTask *t : it->second) wake(t);
+        fd_waiting -= it->second.size();
+        fd_waiters.erase(it);
+    }
+}
+
+void GreenScheduler::waitFd(int fd) {
+    if (epfd < 0) epfd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<GreenTask*> &waiters = fd_waiters[fd];
+    if (waiters.empty()) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            int err = errno;
+            fd_waiters.erase(fd);
+            if (err == EPERM) return;   // 普通文件 epoll 不支持, 它总是可读的
+            throw RuntimeError("Cannot wait on file descriptor " + std::to_string(fd));
+        }
+    }
+    waiters.push_back(current);
+    fd_waiting++;
+    block();
+}
+
+static void taskMain() {
+    GreenScheduler *s = green_scheduler;
+    s->afterSwitch();
+    GreenTask *t = s->current;
+    try {
+        t->value = applyProcedure(t->thunk, std::vector<Value>());
+    } catch (...) {
+        t->error = std::current_exception();
+    }
+    s->finish(t);
+}
+
+// 在任务自己的栈上收尾, 栈要等切到下一个任务之后才能释放
+void GreenScheduler::finish(GreenTask *t) {
+    t->thunk = Value(nullptr);
+    t->state = GreenTask::DONE;
+    for (GreenTask *j : t->joiners) wake(j);
+    t->joiners.clear();
+    zombie = t;
+    GreenTask *next = pickNext();
+    current = next;
+    setcontext(&next->ctx);
+    abort();
+}
+
+Value GreenScheduler::spawn(const Value &thunk) {
+    std::shared_ptr<GreenTask> t = std::make_shared<GreenTask>();
+    t->thunk = thunk;
+    t->owner = this;
+    t->stack = allocStack();
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp = t->stack;
+    t->ctx.uc_stack.ss_size = TASK_STACK_SIZE;
+    t->ctx.uc_link = nullptr;
+    makecontext(&t->ctx, taskMain, 0);
+    save(t.get());
+    t->depth = 0;
+    alive[t.get()] = t;
+    runq.push_back(t.get());
+    return TaskV(t);
+}
+
+Value GreenScheduler::join(GreenTask *t) {
+    if (t->owner != this)
+        throw RuntimeError("Task belongs to another thread");
+    while (t->state != GreenTask::DONE) {
+        if (t == current)
+            throw RuntimeError("Task cannot join itself");
+        t->joiners.push_back(current);
+        if (!block()) {
+            dropWaiter(t->joiners, current);
+            throw RuntimeError("Deadlock");
+        }
+    }
+    if (t->error) std::rethrow_exception(t->error);
+    return t->value;
+}
+
+void greenTick() {
+    GreenScheduler *s = green_scheduler;
+    if (--s->budget > 0) return;
+    s->budget = TASK_QUANTUM;
+    s->yield();
+}
+
+void greenDrain() {
+    GreenScheduler *s = green_scheduler;
+    if (!s || s->current != &s->root) return;
+    while (!s->runq.empty() || s->fd_waiting) {
+        if (s->runq.empty()) {
+            s->pollFds(-1);
+            continue;
+        }
+        // root 排到队尾, 等前面的任务都跑过一轮再回来
+        s->runq.push_back(&s->root);
+        s->switchTo(s->pickNext());
+    }
+}
+
+// ============================================================================
+// Primitives
+// ============================================================================
+
+static GreenChannel *asChannel(const Value &v, const char *who) {
+    if (v->v_type != V_CHANNEL)
+        throw RuntimeError(std::string("Wrong typename in ") + who);
+    GreenChannel *ch = static_cast<Channel*>(v.get())->ch.get();
+    if (ch->owner != &scheduler())
+        throw RuntimeError("Channel belongs to another thread");
+    return ch;
+}
+
+static int asFd(const Value &v, const char *who) {
+    if (v->v_type != V_INT || static_cast<Integer*>(v.get())->n < 0)
+        throw RuntimeError(std::string("Wrong typename in ") + who);
+    return static_cast<Integer*>(v.get())->n;
+}
+
+Value Spawn::evalRator(const Value &thunk) { // spawn
+    if (thunk->v_type != V_PROC)
+        throw RuntimeError("Wrong typename in spawn");
+    return scheduler().spawn(thunk);
+}
+
+Value Yield::evalRator(const std::vector<Value> &args) { // yield
+    if (!args.empty()) throw RuntimeError("Wrong number of yield");
+    if (green_scheduler) green_scheduler->yield();
+    return VoidV();
+}
+
+Value TaskJoin::evalRator(const Value &task) { // task-join
+    if (task->v_type != V_TASK)
+        throw RuntimeError("Wrong typename in task-join");
+    return scheduler().join(static_cast<Task*>(task.get())->task.get());
+}
+
+Value MakeChannel::evalRator(const std::vector<Value> &args) { // make-channel
+    if (args.size() > 1) throw RuntimeError("Wrong number of make-channel");
+    std::shared_ptr<GreenChannel> ch = std::make_shared<GreenChannel>();
+    ch->capacity = 0;
+    if (!args.empty()) {
+        if (args[0]->v_type != V_INT || static_cast<Integer*>(args[0].get())->n <= 0)
+            throw RuntimeError("Channel capacity must be a positive integer");
+        ch->capacity = (size_t)static_cast<Integer*>(args[0].get())->n;
+    }
+    ch->owner = &scheduler();
+    return ChannelV(ch);
+}
+
+Value ChannelSend::evalRator(const Value &chan, const Value &v) { // channel-send
+    GreenChannel *ch = asChannel(chan, "channel-send");
+    GreenScheduler &s = scheduler();
+    while (ch->capacity && ch->items.size() >= ch->capacity) {
+        ch->senders.push_back(s.current);
+        if (!s.block()) {
+            dropWaiter(ch->senders, s.current);
+            throw RuntimeError("Deadlock");
+        }
+    }
+    ch->items.push_back(v);
+    if (!ch->receivers.empty()) {
+        s.wake(ch->receivers.front());
+        ch->receivers.pop_front();
+    }
+    return VoidV();
+}
+
+Value ChannelRecv::evalRator(const Value &chan) { // channel-recv
+    GreenChannel *ch = asChannel(chan, "channel-recv");
+    GreenScheduler &s = scheduler();
+    while (ch->items.empty()) {
+        ch->receivers.push_back(s.current);
+        if (!s.block()) {
+            dropWaiter(ch->receivers, s.current);
+            throw RuntimeError("Deadlock");
+        }
+    }
+    Value v = ch->items.front();
+    ch->items.pop_front();
+    if (!ch->senders.empty()) {
+        s.wake(ch->senders.front());
+        ch->senders.pop_front();
+    }
+    return v;
+}
+
+Value FdWait::evalRator(const Value &fd) { // fd-wait
+    scheduler().waitFd(asFd(fd, "fd-wait"));
+    return VoidV();
+}
+
+Value FdRead::evalRator(const Value &v) { // fd-read
+    int fd = asFd(v, "fd-read");
+    char buf[4096];
+    while (1) {
+        scheduler().waitFd(fd);
+        ssize_t k = read(fd, buf, sizeof(buf));
+        if (k >= 0)
+            return StringV(std::string(buf, (size_t)k));
+        if (errno != EAGAIN && errno != EINTR)
+            throw RuntimeError("Cannot read file descriptor " + std::to_string(fd));
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef GREEN
+#define GREEN
+
+/**
+ * @file green.hpp
+ * @brief Green threads: cooperative tasks, channels and fd readiness
+ *
+ * Every OS thread that uses green threads gets a scheduler. The stack the
+ * thread was already running on becomes the root task, and each spawned
+ * task runs on its own mmap'd stack. The stacks reserve address space only,
+ * so an idle task costs the few pages it has touched plus its context.
+ *
+ * Tasks switch when they block on a channel, a join or a file descriptor,
+ * when they call yield, and when they use up their budget of procedure calls
+ * (checked by applyProcedure). When nothing is runnable, the scheduler waits
+ * in epoll for the descriptors tasks are blocked on. If no task can ever
+ * wake up, the root task gets a "Deadlock" error.
+ *
+ * Interpreter sessions drain the scheduler after every top-level form, so
+ * spawned tasks run until they finish or block on something that cannot
+ * happen anymore.
+ *
+ * Tasks and channels belong to the OS thread that created them. Do not
+ * yield while pool threads wait on the same future.
+ */
+
+#include "value.hpp"
+#include <deque>
+#include <exception>
+#include <ucontext.h>
+
+struct EvalLimits;
+class Interpreter;
+class GreenScheduler;
+
+struct GreenTask {
+    enum State { RUNNABLE, BLOCKED, DONE };
+    State state = RUNNABLE;
+    ucontext_t ctx;
+    void *stack = nullptr;            ///< nullptr for the root task
+    Value thunk;
+    Value value;                      ///< Result once done
+    std::exception_ptr error;         ///< Raised by the thunk, rethrown by task-join
+    std::deque<GreenTask*> joiners;
+    bool deadlocked = false;          ///< Woken because nothing else could wake it
+    GreenScheduler *owner = nullptr;  ///< Scheduler of the creating thread
+
+    // 线程局部的求值状态, 切走时存下来, 切回来时恢复
+    std::ostream *out = nullptr;
+    EvalLimits *limits = nullptr;
+    size_t depth = 0;
+    Interpreter *interp = nullptr;
+    EnvSync *sync = nullptr;
+
+    GreenTask() : thunk(nullptr), value(nullptr) {}
+};
+
+struct GreenChannel {
+    size_t capacity;                  ///< 0 for unbounded
+    std::deque<Value> items;
+    std::deque<GreenTask*> receivers;
+    std::deque<GreenTask*> senders;
+    GreenScheduler *owner;
+};
+
+/**
+ * @brief Scheduler of this thread, nullptr until it uses green threads
+ */
+extern thread_local GreenScheduler *green_scheduler;
+
+/**
+ * @brief Counts a procedure call against the running task's budget
+ */
+void greenTick();
+
+/**
+ * @brief From the root task: run green threads until none can make progress
+ */
+void greenDrain();
+
+#endif // GREEN
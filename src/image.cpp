@@ -0,0 +1,100 @@
+#include "image.hpp"
+#include "interpreter.hpp"
+#include "serialize.hpp"
+#include "RE.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// 最后一个字节是格式版本
+const char MAGIC[8] = {'S', 'C', 'M', 'I', 'M', 'A', 'G', '1'};
+
+} // namespace
+
+/*
+先写到同目录的临时文件, 写完再 rename 过去, 别的进程不会映射到写了一半的文件
+临时文件名带上进程号和序号, 同时写同一个文件的线程也不会撞名
+*/
+void replaceFile(const std::string &path, std::string_view data) {
+    static std::atomic<unsigned> serial(0);
+    std::string tmp = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(serial++);
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw RuntimeError("Cannot write " + path + ": " + strerror(errno));
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t k = ::write(fd, data.data() + done, data.size() - done);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) {
+            int err = errno;
+            close(fd);
+            unlink(tmp.c_str());
+            throw RuntimeError("Cannot write " + path + ": " + strerror(err));
+        }
+        done += (size_t)k;
+    }
+    if (close(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+        int err = errno;
+        unlink(tmp.c_str());
+        throw RuntimeError("Cannot write " + path + ": " + strerror(err));
+    }
+}
+
+std::string encodeImage(const Assoc &globals) {
+    std::string data(MAGIC, sizeof MAGIC);
+    encodeGlobals(globals, data);
+    return data;
+}
+
+void decodeImage(std::string_view data, Assoc &globals, const std::string &what) {
+    if (data.size() < sizeof MAGIC
+        || data.compare(0, sizeof MAGIC, std::string_view(MAGIC, sizeof MAGIC)) != 0)
+        throw RuntimeError(what + " is not an image");
+    size_t pos = sizeof MAGIC;
+    decodeGlobals(data, pos, globals);
+}
+
+void saveImage(const std::string &path, const Assoc &globals) {
+    replaceFile(path, encodeImage(globals));
+}
+
+void loadImage(const std::string &path, Assoc &globals) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw RuntimeError("Cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof MAGIC) {
+        close(fd);
+        throw RuntimeError(path + " is not an image");
+    }
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw RuntimeError("Cannot map " + path);
+    try {
+        decodeImage(std::string_view(static_cast<const char*>(map), len), globals, path);
+    } catch (...) {
+        munmap(map, len);
+        throw;
+    }
+    munmap(map, len);
+}
+
+Value SaveImage::evalRator(const Value &path) { // save-image
+    if (path->v_type != V_STRING)
+        throw RuntimeError("save-image: expected a file name");
+    if (!current_interpreter)
+        throw RuntimeError("save-image: no interpreter");
+    String *s = static_cast<String*>(path.get());
+    saveImage(std::string(s->data(), s->size()), current_interpreter->environment());
+    return VoidV();
+}
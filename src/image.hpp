@@ -0,0 +1,59 @@
+#ifndef IMAGE
+#define IMAGE
+
+/**
+ * @file image.hpp
+ * @brief Heap images: a global environment saved to a file and mapped back
+ *
+ * An image is a magic header followed by the encodeGlobals() output (see
+ * serialize.hpp). It holds only lengths and back-reference numbers, no
+ * addresses, so it is decoded in place from an mmap'd file. Procedure
+ * bodies are stored as syntax and parsed on their first call, so loading
+ * an image does no parsing at all.
+ *
+ * Closures over the saved global environment are rooted in the loading
+ * interpreter's global environment, and see its later definitions. Names
+ * of primitives and keywords keep the meaning they had when the image was
+ * saved: redefining car after loading does not change what a saved body's
+ * (car x) calls.
+ */
+
+#include "value.hpp"
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Writes every global binding except native procedures to path
+ * The file is written next to path and renamed over it when complete.
+ * @throws RuntimeError if a value cannot be saved (records, promises,
+ * futures, ...) or the file cannot be written
+ */
+void saveImage(const std::string &path, const Assoc &globals);
+
+/**
+ * @brief Defines the bindings saved in the image at path in globals
+ * @throws RuntimeError if the file cannot be read or is not an image
+ */
+void loadImage(const std::string &path, Assoc &globals);
+
+/**
+ * @brief The image of globals, as saveImage writes it
+ * @throws RuntimeError like saveImage
+ */
+std::string encodeImage(const Assoc &globals);
+
+/**
+ * @brief Defines the bindings of an image held in memory in globals
+ * @param what names the image in error messages
+ * @throws RuntimeError if data is not an image
+ */
+void decodeImage(std::string_view data, Assoc &globals, const std::string &what);
+
+/**
+ * @brief Writes data to a temporary file next to path, then renames it over
+ * path, so readers never see a half-written file
+ * @throws RuntimeError if the file cannot be written
+ */
+void replaceFile(const std::string &path, std::string_view data);
+
+#endif // IMAGE
@@ -0,0 +1,241 @@
+/**
+ * @file interpreter.cpp
+ * @brief Interpreter sessions: evaluation entry points and the REPL loop
+ */
+
+#include "interpreter.hpp"
+#include "syntax.hpp"
+#include "RE.hpp"
+#include "purity.hpp"
+#include "green.hpp"
+#include "isolate.hpp"
+#include <algorithm>
+
+bool isExplicitVoidCall(Expr expr) {
+    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
+    if (make_void_expr != nullptr) {
+        return true;
+    }
+    
+    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
+    if (apply_expr != nullptr) {
+        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
+        if (var_expr != nullptr && var_expr->x == "void") {
+            return true;
+        }
+    }
+    
+    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
+    if (begin_expr != nullptr && !begin_expr->es.empty()) {
+        return isExplicitVoidCall(begin_expr->es.back());
+    }
+    
+    If* if_expr = dynamic_cast<If*>(expr.get());
+    if (if_expr != nullptr) {
+        return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
+    }
+    
+    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
+    if (cond_expr != nullptr) {
+        for (const auto& clause : cond_expr->clauses) {
+            if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Interpreter::Interpreter(std::ostream &out, const EvalLimits &limits)
+    : out(&out), env(empty()), lim(limits), sync(std::make_shared<EnvSync>()) {}
+
+/*
+define 总是插在全局环境第一个结点后面, 所以在 base 的环境前面垫一个空名字的结点,
+新定义就都落在这一层里, 不会改到 base 的链表; 环境连着 base 的, 锁也跟 base 共用
+*/
+Interpreter::Interpreter(const Interpreter &base, std::ostream &out)
+    : out(&out), env(empty()), lim(base.lim), sync(base.sync) {
+    Assoc globals = base.env;
+    env = extend("", VoidV(), globals);
+    lim.depth = 0;
+    lim.steps = 0;
+}
+
+Interpreter::~Interpreter() {
+    stopIsolates(isolates);
+}
+
+// 已经被 isolate-join 收掉线程的就不再记着
+void Interpreter::ownIsolate(const std::shared_ptr<IsolateState> &st) {
+    isolates.erase(std::remove_if(isolates.begin(), isolates.end(),
+                                  [](const std::shared_ptr<IsolateState> &x) {
+                                      std::lock_guard<std::mutex> lk(x->thread_mutex);
+                                      return !x->thread.joinable();
+                                  }),
+                   isolates.end());
+    isolates.push_back(st);
+}
+
+thread_local Interpreter *current_interpreter = nullptr;
+
+// 在自己的输出流、限制和环境锁下求值, 退出时恢复调用线程原来的设置
+struct SessionScope {
+    OutputScope output;
+    EnvSyncScope sync;
+    EvalLimits *saved;
+    Interpreter *saved_interp;
+    SessionScope(Interpreter *interp, std::ostream *out, EvalLimits *lim, EnvSync *sync)
+        : output(out), sync(sync), saved(current_limits), saved_interp(current_interpreter) {
+        current_limits = lim;
+        current_interpreter = interp;
+    }
+    ~SessionScope() {
+        current_limits = saved;
+        current_interpreter = saved_interp;
+    }
+};
+
+/*
+和 define 一样: 已有的名字直接改, 新名字插在全局环境第二个位置,
+这样之前捕获了全局环境的闭包也能看到它
+*/
+void Interpreter::bind(const std::string &name, const Expr &body) {
+    // 可能在求值线程以外调用, 锁用这个解释器自己的
+    EnvSyncScope scope(sync.get());
+    Value proc = ProcedureV({}, body, empty());
+    if (find(name, env).get()) {
+        modify(name, proc, env);
+    } else if (!env.get()) {
+        env = extend(name, proc, env);
+    } else {
+        EnvWriteLock lock;
+        env->next = extend(name, proc, env->next);
+    }
+    bumpPurityEpoch();
+}
+
+void Interpreter::define_native(const std::string &name, int arity, const NativeFunction &fn) {
+    bind(name, Expr(new NativeProc(name, arity, fn)));
+}
+
+Expr Interpreter::parseIn(Arena *unit, const Syntax &stx) {
+    Arena::Scope scope(ExprBase::arena, unit);
+    return stx->parse(env).retained();
+}
+
+Value Interpreter::evalAll(Reader &in, std::vector<Expr> *forms) {
+    SessionScope scope(this, out, &lim, sync.get());
+    lim.steps = 0;
+    Value result = VoidV();
+    // 整个输入是一个编译单元, 所有表达式的节点放在同一个 arena 里
+    std::shared_ptr<Arena> unit = Arena::make<ExprBase>();
+    while (!in.atEnd()) {
+        Syntax stx = in.read();
+        Expr expr = parseIn(unit.get(), stx);
+        if (forms)
+            forms->push_back(expr);
+        result = expr->eval(env);
+        if (green_scheduler) greenDrain();
+        if (result->v_type == V_TERMINATE)
+            break;
+    }
+    return result;
+}
+
+Value Interpreter::run(const std::vector<Expr> &forms) {
+    SessionScope scope(this, out, &lim, sync.get());
+    lim.steps = 0;
+    Value result = VoidV();
+    for (const Expr &expr : forms) {
+        result = expr->eval(env);
+        if (green_scheduler) greenDrain();
+        if (result->v_type == V_TERMINATE)
+            break;
+    }
+    return result;
+}
+
+Value Interpreter::apply(const Value &proc, const std::vector<Value> &args) {
+    SessionScope scope(this, out, &lim, sync.get());
+    lim.steps = 0;
+    Value result = applyProcedure(proc, args);
+    if (green_scheduler) greenDrain();
+    return result;
+}
+
+Value Interpreter::eval(std::string_view source) {
+    Reader in(source);
+    return evalAll(in);
+}
+
+Value Interpreter::load(const std::string &path, bool parallel_read) {
+    Reader in(std::string_view{});
+    if (!in.open(path))
+        throw RuntimeError("Cannot open " + path);
+    if (parallel_read) in.parallel();
+    return evalAll(in);
+}
+
+Value Interpreter::load(const std::string &path, std::vector<Expr> &forms) {
+    Reader in(std::string_view{});
+    if (!in.open(path))
+        throw RuntimeError("Cannot open " + path);
+    in.parallel();
+    return evalAll(in, &forms);
+}
+
+/*
+一个会话: 读一个表达式, 求值, 打印, 直到 (exit) 或者输入结束
+结果和 display 都写到这个解释器自己的输出流
+*/
+Interpreter::ReplResult Interpreter::repl(std::istream &in, bool prompt) {
+    Reader reader(in);
+    return repl(reader, prompt);
+}
+
+Interpreter::ReplResult Interpreter::repl(Reader &in, bool prompt) {
+    SessionScope scope(this, out, &lim, sync.get());
+    ReplResult res;
+    std::ostream &os = *out;
+    // 输出攒在缓冲区里, 等着读下一个表达式之前才写出去;
+    // 打印了东西的表达式求值完也写出去, 后面的表达式把进程搞崩了也不会丢
+    in.flushBeforeWait(out);
+    while (1){
+        if (prompt)
+            os << "scm> ";
+        if (in.atEnd())
+            break;
+        std::streampos mark = os.tellp();
+        try{
+            Syntax stx = in.read(); // read
+            lim.steps = 0;
+            // 每个表达式自己一个 arena, define 留下的闭包会一直占着它; Expr 树一般不比语法树大,
+            // 第一块就按语法树用掉的字节数分, 而不是每个定义都占一整块 4KB
+            Arena *syntax = Arena::of(stx.get());
+            Expr expr = parseIn(Arena::make<ExprBase>(syntax ? syntax->used() : 0).get(), stx); // parse
+            // stx -> show(os); // syntax print
+            Value val = expr -> eval(env);
+            if (green_scheduler) greenDrain();
+            if (val -> v_type == V_TERMINATE) {
+                res.exited = true;
+                break;
+            }
+            if(val->v_type!=V_VOID||isExplicitVoidCall(expr)){
+                val -> show(os); // value print
+            }
+                
+        }
+        catch (const RuntimeError &RE){
+            // os << RE.message();
+            os << "RuntimeError";
+            res.errors++;
+        }
+        bool printed = os.tellp() != mark;
+        os << '\n';
+        if (printed) os.flush();
+        
+    }
+    in.flushBeforeWait(nullptr);
+    os.flush();
+    return res;
+}
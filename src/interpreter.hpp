@@ -0,0 +1,152 @@
+#ifndef INTERPRETER
+#define INTERPRETER
+
+/**
+ * @file interpreter.hpp
+ * @brief Embeddable interpreter instance
+ *
+ * An Interpreter owns its global environment, output stream and resource
+ * limits, so several of them can live in one process and run on different
+ * threads at the same time. The code executable is a thin client of it.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include "native.hpp"
+#include "syntax.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct IsolateState;
+
+class Interpreter {
+public:
+    explicit Interpreter(std::ostream &out = std::cout, const EvalLimits &limits = EvalLimits());
+
+    /**
+     * @brief Session layered on the globals of base
+     * Definitions made here stay in this interpreter; base's bindings are
+     * shared, so set! on them is visible to base and its other layers.
+     */
+    Interpreter(const Interpreter &base, std::ostream &out);
+
+    /**
+     * @brief Abandons and joins the isolates spawned in this session
+     * (see isolate.hpp), so none of them outlives the session
+     */
+    ~Interpreter();
+
+    Interpreter(const Interpreter &) = delete;
+    Interpreter &operator=(const Interpreter &) = delete;
+
+    /**
+     * @brief Evaluates every form in source and returns the last value
+     * Stops early at (exit), returning the terminate value.
+     * @throws RuntimeError from parsing or evaluation
+     */
+    Value eval(std::string_view source);
+
+    /**
+     * @brief Evaluates a source file like eval
+     * Large files are read on the thread pool (see Reader::parallel) unless
+     * parallel_read is false, e.g. in a process that is going to fork; forms
+     * are still parsed and evaluated one by one in order.
+     * @throws RuntimeError if the file cannot be read
+     */
+    Value load(const std::string &path, bool parallel_read = true);
+
+    /**
+     * @brief Evaluates a source file like eval
+     * and appends the parsed forms to forms, for replaying with run()
+     */
+    Value load(const std::string &path, std::vector<Expr> &forms);
+
+    /**
+     * @brief Evaluates already parsed forms in this interpreter's environment
+     * The forms must have been parsed against an environment that binds the
+     * same names (e.g. by load on another, fresh interpreter).
+     */
+    Value run(const std::vector<Expr> &forms);
+
+    /**
+     * @brief Applies a procedure value in this interpreter's session
+     */
+    Value apply(const Value &proc, const std::vector<Value> &args);
+
+    struct ReplResult {
+        size_t errors = 0;    ///< Forms that raised a RuntimeError
+        bool exited = false;  ///< Stopped at (exit) rather than end of input
+    };
+
+    /**
+     * @brief Read-eval-print loop until (exit) or end of input
+     * Errors are reported as "RuntimeError" and the loop continues. Output
+     * is flushed after each form that printed something, before waiting for
+     * input and when the loop ends.
+     */
+    ReplResult repl(Reader &in, bool prompt);
+
+    /**
+     * @brief repl over a stream; it is read in blocks, so pass a Reader on
+     * the file descriptor instead for interactive input
+     */
+    ReplResult repl(std::istream &in, bool prompt);
+
+    /**
+     * @brief Binds name to a procedure calling the C++ function fn
+     * Arity and argument types come from fn's signature (see native.hpp):
+     * interp.define_native("score", &score);
+     */
+    template <typename F>
+    void define_native(const std::string &name, F fn) {
+        bind(name, makeNative(name, std::move(fn)));
+    }
+
+    /**
+     * @brief Binds name to fn on the raw argument values; arity -1 accepts any count
+     */
+    void define_native(const std::string &name, int arity, const NativeFunction &fn);
+
+    /**
+     * @brief Records an isolate spawned in this session, for the destructor
+     */
+    void ownIsolate(const std::shared_ptr<IsolateState> &st);
+
+    std::ostream &output() { return *out; }
+    Assoc &environment() { return env; }
+    EvalLimits &limits() { return lim; }
+
+private:
+    std::ostream *out;
+    Assoc env;
+    EvalLimits lim;
+    std::shared_ptr<EnvSync> sync;  ///< Locked only once this interpreter spawns futures
+    std::vector<std::shared_ptr<IsolateState>> isolates;
+
+    Value evalAll(Reader &in, std::vector<Expr> *forms = nullptr);
+    /** @brief Parses stx in the global environment with its nodes in unit */
+    Expr parseIn(Arena *unit, const Syntax &stx);
+    void bind(const std::string &name, const Expr &body);
+};
+
+/**
+ * @brief Interpreter evaluating on this thread, or nullptr
+ */
+extern thread_local Interpreter *current_interpreter;
+
+/**
+ * @brief Entry point a (load-extension "x.so") shared object must export
+ * extern "C" void scheme_init_extension(Interpreter &);
+ */
+typedef void (*ExtensionInit)(Interpreter &);
+
+/**
+ * @brief Whether a void result was asked for explicitly and should be printed
+ */
+bool isExplicitVoidCall(Expr expr);
+
+#endif // INTERPRETER
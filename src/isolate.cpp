@@ -0,0 +1,367 @@
+/**
+ * @file isolate.cpp
+ * @brief Deep copies of value graphs, isolate threads and mailboxes
+ */
+
+#include "isolate.hpp"
+#include "expr.hpp"
+#include "interpreter.hpp"
+#include "persistent.hpp"
+#include "RE.hpp"
+#include "serialize.hpp"
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/*
+按对象指针记住已经复制过的东西, 这样共享和环都能原样保留
+可变对象先建一个空壳登记上, 再去复制它的字段
+*/
+class Copier {
+public:
+    Value copy(const Value &v);
+
+private:
+    std::unordered_map<const ValueBase*, Value> seen;
+    std::unordered_map<const AssocList*, Assoc> envs;
+    std::unordered_map<const PromiseBox*, std::shared_ptr<PromiseBox>> boxes;
+    std::unordered_set<const ValueBase*> building;   ///< Persistent collections being rebuilt
+
+    Value remember(const Value &from, const Value &to) {
+        seen.emplace(from.get(), to);
+        return to;
+    }
+    Value copyPair(const Value &v);
+    Assoc copyEnv(const Assoc &env);
+    Assoc copyCaptured(ExprBase *body, const std::vector<std::string> &params, const Assoc &env);
+};
+
+// 沿着 cdr 循环, 长表不会把栈用完
+Value Copier::copyPair(const Value &v) {
+    Value head = remember(v, PairV(Value(nullptr), Value(nullptr)));
+    Value src = v, dst = head;
+    while (1) {
+        Pair *sp = static_cast<Pair*>(src.get());
+        Pair *dp = static_cast<Pair*>(dst.get());
+        dp->car = copy(sp->car);
+        Value next = sp->cdr;
+        if (next.get() && next->v_type == V_PAIR && !seen.count(next.get())) {
+            dp->cdr = remember(next, PairV(Value(nullptr), Value(nullptr)));
+            src = next;
+            dst = dp->cdr;
+        } else {
+            dp->cdr = copy(next);
+            return head;
+        }
+    }
+}
+
+// 先把链上还没复制的结点都建出来, 再填值: 值里的闭包往往又指回这条链
+Assoc Copier::copyEnv(const Assoc &env) {
+    if (!env.get()) return env;
+    auto found = envs.find(env.get());
+    if (found != envs.end()) return found->second;
+
+    std::vector<std::pair<AssocList*, AssocList*>> made;
+    Assoc head(nullptr);
+    AssocList *prev = nullptr;
+    for (Assoc cur = env; cur.get(); cur = cur->next) {
+        auto f = envs.find(cur.get());
+        if (f != envs.end()) {
+            if (prev) prev->next = f->second;
+            else head = f->second;
+            break;
+        }
+        Assoc tail = empty();
+        Assoc node = extend(cur->x, Value(nullptr), tail);
+        envs.emplace(cur.get(), node);
+        if (prev) prev->next = node;
+        else head = node;
+        prev = node.get();
+        made.emplace_back(cur.get(), node.get());
+    }
+    for (auto &p : made)
+        p.second->v = copy(p.first->v);
+    return head;
+}
+
+/*
+只带函数体提到的绑定, 每个名字取环境链上最近的那个, 和 serialize.cpp 编码闭包一样;
+原语和记录类型的过程不引用环境. 还原不成语法树的函数体 (里面定义了记录类型之类) 只好整条链都复制
+先建好新环境再复制值, 值里的闭包指回自己时已经登记过了
+*/
+Assoc Copier::copyCaptured(ExprBase *body, const std::vector<std::string> &params, const Assoc &env) {
+    if (!body || !env.get()) return empty();
+    switch (body->e_type) {
+        case E_NATIVE: case E_LOAD_EXTENSION:
+        case E_RECORD_CTOR: case E_RECORD_PRED: case E_RECORD_GET: case E_RECORD_SET:
+            return empty();
+        default:
+            break;
+    }
+    std::set<std::string> names;
+    try {
+        bodyNames(body, names);
+    } catch (const RuntimeError &) {
+        return copyEnv(env);
+    }
+    for (auto &x : params) names.erase(x);
+
+    std::vector<AssocList*> bindings;
+    for (AssocList *node = env.get(); node && !names.empty(); node = node->next.get())
+        if (names.erase(node->x)) bindings.push_back(node);
+    Assoc copied = empty();
+    for (AssocList *node : bindings) copied = extend(node->x, Value(nullptr), copied);
+    AssocList *dst = copied.get();
+    for (auto it = bindings.rbegin(); it != bindings.rend(); ++it, dst = dst->next.get())
+        dst->v = copy((*it)->v);
+    return copied;
+}
+
+Value Copier::copy(const Value &v) {
+    if (!v.get()) return v;
+    auto found = seen.find(v.get());
+    if (found != seen.end()) return found->second;
+
+    switch (v->v_type) {
+        case V_INT:
+            return remember(v, IntegerV(static_cast<Integer*>(v.get())->n));
+        case V_RATIONAL: {
+            Rational *r = static_cast<Rational*>(v.get());
+            return remember(v, RationalV(r->numerator, r->denominator));
+        }
+        case V_BOOL:
+            return remember(v, BooleanV(static_cast<Boolean*>(v.get())->b));
+        case V_SYM:
+            return remember(v, SymbolV(static_cast<Symbol*>(v.get())->s));
+        case V_NULL:
+            return remember(v, NullV());
+        case V_VOID:
+            return remember(v, VoidV());
+        case V_TERMINATE:
+            return remember(v, TerminateV());
+        case V_STRING: {
+            // 字符串的缓冲区是不可变的, 直接共享
+            String *s = static_cast<String*>(v.get());
+            return remember(v, StringV(s->buf, s->off, s->len));
+        }
+        case V_STRING_BUILDER: {
+            Value sb = remember(v, StringBuilderV());
+            static_cast<StringBuilder*>(sb.get())->buf = static_cast<StringBuilder*>(v.get())->buf;
+            return sb;
+        }
+        case V_PAIR:
+            return copyPair(v);
+        case V_VECTOR: {
+            Vector *src = static_cast<Vector*>(v.get());
+            Value vec = remember(v, VectorV(std::vector<Value>(src->elems.size(), Value(nullptr))));
+            Vector *dst = static_cast<Vector*>(vec.get());
+            for (size_t i = 0; i < src->elems.size(); i++)
+                dst->elems[i] = copy(src->elems[i]);
+            return vec;
+        }
+        case V_RECORD: {
+            Record *src = static_cast<Record*>(v.get());
+            Value rec = remember(v, RecordV(src->type, std::vector<Value>(src->n, Value(nullptr))));
+            Record *dst = static_cast<Record*>(rec.get());
+            for (size_t i = 0; i < src->n; i++)
+                dst->slots()[i] = copy(src->slots()[i]);
+            return rec;
+        }
+        case V_PROC: {
+            // 过程体是不可变的 Expr 树, 共享; 只复制它用到的捕获绑定
+            Procedure *src = static_cast<Procedure*>(v.get());
+            Value proc = remember(v, ProcedureV(src->parameters, src->e, empty()));
+            if (!primitiveName(src).empty()) return proc;
+            static_cast<Procedure*>(proc.get())->env = copyCaptured(src->e.get(), src->parameters, src->env);
+            return proc;
+        }
+        case V_PROMISE: {
+            PromiseBox *b = static_cast<Promise*>(v.get())->box.get();
+            auto f = boxes.find(b);
+            if (f != boxes.end())
+                return remember(v, Value(new Promise(f->second)));
+            std::shared_ptr<PromiseBox> nb =
+                std::make_shared<PromiseBox>(b->done, b->lazy, Value(nullptr), b->e, empty());
+            boxes.emplace(b, nb);
+            Value p = remember(v, Value(new Promise(nb)));
+            nb->value = copy(b->value);
+            nb->env = copyCaptured(b->e.get(), {}, b->env);
+            return p;
+        }
+        case V_PMAP: {
+            if (!building.insert(v.get()).second)
+                throw RuntimeError("Cannot copy a persistent map that contains itself");
+            std::vector<std::pair<Value, Value>> entries;
+            pmapEntries(static_cast<PMap*>(v.get()), entries);
+            Value m = PMapV(HamtRef(nullptr), 0);
+            for (auto &kv : entries)
+                m = pmapSet(static_cast<PMap*>(m.get()), copy(kv.first), copy(kv.second));
+            building.erase(v.get());
+            return remember(v, m);
+        }
+        case V_PVECTOR: {
+            if (!building.insert(v.get()).second)
+                throw RuntimeError("Cannot copy a persistent vector that contains itself");
+            std::vector<Value> elems;
+            pvectorElems(static_cast<PVector*>(v.get()), elems);
+            for (Value &e : elems) e = copy(e);
+            building.erase(v.get());
+            return remember(v, PVectorV(elems));
+        }
+        case V_ISOLATE:
+            return v;
+        case V_FUTURE:
+            throw RuntimeError("Cannot copy a future to another isolate");
+        case V_TASK:
+        case V_CHANNEL:
+            throw RuntimeError("Cannot copy a green thread object to another isolate");
+        default:
+            throw RuntimeError("Cannot copy value to another isolate");
+    }
+}
+
+// 当前线程自己的邮箱; 不是 spawn-isolate 起的线程第一次用时才建
+thread_local std::shared_ptr<IsolateState> self_isolate;
+
+std::shared_ptr<IsolateState> &selfIsolate() {
+    if (!self_isolate) self_isolate = std::make_shared<IsolateState>();
+    return self_isolate;
+}
+
+IsolateState *asIsolate(const Value &v, const char *who) {
+    if (v->v_type != V_ISOLATE)
+        throw RuntimeError(std::string("Wrong typename in ") + who);
+    return static_cast<Isolate*>(v.get())->st.get();
+}
+
+// 输出先攒在自己的缓冲区里, 由 isolate-join 交给 join 的一方
+void runIsolate(std::shared_ptr<IsolateState> st, Value thunk) {
+    self_isolate = st;
+    Value result(nullptr);
+    bool failed = false;
+    std::string error;
+    std::ostringstream out;
+    try {
+        Interpreter interp(out);
+        result = deepCopy(interp.apply(thunk, std::vector<Value>()));
+    } catch (const RuntimeError &e) {
+        failed = true;
+        error = e.message();
+    } catch (const std::exception &e) {
+        failed = true;
+        error = e.what();
+    }
+    thunk = Value(nullptr);
+    std::lock_guard<std::mutex> lk(st->m);
+    st->done = true;
+    st->failed = failed;
+    st->result = result;
+    st->error = error;
+    st->output = out.str();
+    st->cv.notify_all();
+}
+
+void joinThread(IsolateState *st) {
+    std::lock_guard<std::mutex> lk(st->thread_mutex);
+    if (st->thread.joinable()) st->thread.join();
+}
+
+} // namespace
+
+Value deepCopy(const Value &v) {
+    Copier c;
+    return c.copy(v);
+}
+
+bool isolateAbandoned() {
+    return self_isolate && self_isolate->abandoned.load(std::memory_order_relaxed);
+}
+
+void stopIsolates(std::vector<std::shared_ptr<IsolateState>> &isolates) {
+    for (auto &st : isolates) {
+        std::lock_guard<std::mutex> lk(st->m);
+        st->abandoned.store(true);
+        st->cv.notify_all();
+    }
+    for (auto &st : isolates) joinThread(st.get());
+    isolates.clear();
+}
+
+/*
+子线程归创建它的会话所有, 会话结束时 stopIsolates 叫停并 join
+已经 join 过线程的状态顺手从会话里去掉, 免得一直 spawn 的会话越攒越多
+*/
+Value SpawnIsolate::evalRator(const Value &thunk) { // spawn-isolate
+    if (thunk->v_type != V_PROC)
+        throw RuntimeError("Wrong typename in spawn-isolate");
+    Interpreter *owner = current_interpreter;
+    if (!owner)
+        throw RuntimeError("spawn-isolate outside an interpreter session");
+    std::shared_ptr<IsolateState> st = std::make_shared<IsolateState>();
+    st->parent = selfIsolate();
+    Value copied = deepCopy(thunk);
+    {
+        std::lock_guard<std::mutex> lk(st->thread_mutex);
+        st->thread = std::thread(runIsolate, st, std::move(copied));
+    }
+    owner->ownIsolate(st);
+    return IsolateV(st);
+}
+
+Value IsolateSend::evalRator(const Value &iso, const Value &v) { // isolate-send!
+    IsolateState *st = asIsolate(iso, "isolate-send!");
+    Value msg = deepCopy(v);
+    std::lock_guard<std::mutex> lk(st->m);
+    st->inbox.push_back(std::move(msg));
+    st->cv.notify_all();
+    return VoidV();
+}
+
+Value IsolateReceive::evalRator(const std::vector<Value> &args) { // isolate-receive
+    if (!args.empty()) throw RuntimeError("Wrong number of isolate-receive");
+    IsolateState *st = selfIsolate().get();
+    std::unique_lock<std::mutex> lk(st->m);
+    st->cv.wait(lk, [st] { return !st->inbox.empty() || st->abandoned.load(); });
+    if (st->inbox.empty())
+        throw RuntimeError("Isolate abandoned");
+    Value msg = st->inbox.front();
+    st->inbox.pop_front();
+    return msg;
+}
+
+Value IsolateJoin::evalRator(const Value &iso) { // isolate-join
+    IsolateState *st = asIsolate(iso, "isolate-join");
+    std::string output;
+    {
+        // 自己被放弃时不能一直等下去; 子线程的通知不会叫醒这里, 所以隔一会儿看一眼
+        std::unique_lock<std::mutex> lk(st->m);
+        while (!st->cv.wait_for(lk, std::chrono::milliseconds(50), [st] { return st->done; }))
+            if (isolateAbandoned()) throw RuntimeError("Isolate abandoned");
+        if (!st->output_taken) {
+            st->output_taken = true;
+            output.swap(st->output);
+        }
+    }
+    joinThread(st);
+    if (!output.empty()) writeOutput(output);
+    if (st->failed)
+        throw RuntimeError(st->error);
+    // 结果可能被 join 多次, 每次都给一份自己的
+    return deepCopy(st->result);
+}
+
+Value IsolateParent::evalRator(const std::vector<Value> &args) { // isolate-parent
+    if (!args.empty()) throw RuntimeError("Wrong number of isolate-parent");
+    std::shared_ptr<IsolateState> &self = selfIsolate();
+    if (!self->parent)
+        throw RuntimeError("No parent isolate");
+    return IsolateV(self->parent);
+}
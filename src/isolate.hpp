@@ -0,0 +1,78 @@
+#ifndef ISOLATE
+#define ISOLATE
+
+/**
+ * @file isolate.hpp
+ * @brief Shared-nothing isolates: interpreters on their own threads
+ *
+ * (spawn-isolate thunk) deep-copies the thunk, including everything its
+ * environment reaches, and applies it in a fresh Interpreter on a new OS
+ * thread. Isolates talk only through mailboxes; every message is deep-copied
+ * by the sender, so the receiver owns the only reference to it. The result
+ * of the thunk is copied back the same way for isolate-join.
+ *
+ * A copied closure keeps only the captured bindings its body mentions, as
+ * serialize.hpp encodes closures, so a thunk does not drag the whole global
+ * environment along. Bindings are copied per closure: two closures sharing
+ * a variable get one copy each.
+ *
+ * What an isolate displays goes to its own buffer and is written to the
+ * joiner's output by the first isolate-join. The session that spawned an
+ * isolate owns it: when that Interpreter is destroyed, isolates still
+ * running are abandoned (their next procedure call or isolate-receive
+ * raises an error) and joined, and their output is dropped.
+ *
+ * Immutable parts are shared instead of copied: procedure bodies (Expr
+ * trees), string buffers and record types.
+ */
+
+#include "value.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Copies a value graph so that no mutable object is shared with the original
+ * Sharing and cycles inside the graph are preserved. Isolate handles are
+ * passed through as they are.
+ * @throws RuntimeError for futures, tasks and channels, which are bound to
+ * the thread that created them
+ */
+Value deepCopy(const Value &);
+
+struct IsolateState {
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<Value> inbox;               ///< Messages, already copied for this isolate
+    std::shared_ptr<IsolateState> parent;  ///< Spawner, nullptr for threads started otherwise
+    bool done = false;
+    bool failed = false;
+    Value result;                          ///< Copied result once done
+    std::string error;                     ///< Message of the error that ended the thunk
+    std::string output;                    ///< What the thunk displayed, once done
+    bool output_taken = false;             ///< output went to a joiner already
+    std::atomic<bool> abandoned{false};    ///< Set when the owning session ends
+
+    std::mutex thread_mutex;               ///< Guards joining thread
+    std::thread thread;                    ///< Not joinable for threads started otherwise
+
+    IsolateState() : result(nullptr) {}
+};
+
+/**
+ * @brief Whether the isolate running on this thread was abandoned by its owner
+ */
+bool isolateAbandoned();
+
+/**
+ * @brief Abandons every isolate still running and waits for their threads
+ * Called when the owning Interpreter is destroyed; clears isolates.
+ */
+void stopIsolates(std::vector<std::shared_ptr<IsolateState>> &isolates);
+
+#endif // ISOLATE
@@ -0,0 +1,328 @@
+/**
+ * @file loadcache.cpp
+ * @brief load: reading source files through the on-disk cache of their forms
+ */
+
+#include "loadcache.hpp"
+#include "image.hpp"
+#include "interpreter.hpp"
+#include "serialize.hpp"
+#include "syntax.hpp"
+#include "RE.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = {'S', 'C', 'M', 'C', 'A', 'C', 'H', 'E'};
+
+// 读取器或者语法编码 (serialize.cpp) 变了就改这里, 旧条目的名字对不上, 自然不会再用
+const char CACHE_VERSION[] = "scheme load cache 2";
+
+struct Digest {
+    uint64_t a, b;
+    bool operator==(const Digest &o) const { return a == o.a && b == o.b; }
+};
+
+// 条目开头, 后面紧跟 forms 个语法编码
+struct Header {
+    char magic[8];
+    uint64_t source_len;
+    Digest source;
+    uint64_t forms;
+    Digest names;         ///< 开始时全局环境里绑定了的原语和关键字名
+    uint64_t checked;     ///< 写条目的那次 load 当场解析了所有函数体, 都没出错
+    uint64_t payload_len;
+    Digest payload;
+};
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+两路 64 位, 一次吃 8 个字节, 比读取器快得多
+只用来认出内容没变的文件和坏掉的条目, 不防有意构造的碰撞
+*/
+Digest digest(std::string_view data, uint64_t seed) {
+    const uint64_t K1 = 0x87c37b91114253d5ULL;
+    const uint64_t K2 = 0x4cf5ad432745937fULL;
+    uint64_t a = seed, b = ~seed;
+    size_t n = data.size(), i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, data.data() + i, 8);
+        a = rotl(a ^ (w * K1), 31) * K2;
+        b = rotl(b + (w * K2), 27) * K1 + a;
+    }
+    uint64_t w = 0;
+    if (i < n) memcpy(&w, data.data() + i, n - i);
+    a = fmix(a ^ (w * K1) ^ n);
+    b = fmix(b ^ rotl(w * K2, 33) ^ a);
+    return {a + b, b};
+}
+
+uint64_t versionSeed() {
+    static const uint64_t seed = digest(CACHE_VERSION, 0).a;
+    return seed;
+}
+
+std::string defaultCacheDir() {
+    const char *dir = getenv("SCHEME_CACHE_DIR");
+    if (dir) return dir;
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir) return std::string(dir) + "/scheme";
+    dir = getenv("HOME");
+    if (dir && *dir) return std::string(dir) + "/.cache/scheme";
+    return "";
+}
+
+// mkdir -p
+bool makeDirs(const std::string &dir) {
+    for (size_t i = 1; i <= dir.size(); i++) {
+        if (i < dir.size() && dir[i] != '/') continue;
+        std::string prefix = dir.substr(0, i);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+std::string hex(uint64_t x) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s(16, '0');
+    for (int i = 15; i >= 0; i--, x >>= 4)
+        s[i] = digits[x & 15];
+    return s;
+}
+
+// 整个普通文件只读映射进来; 打不开是 !opened, 不是普通文件 (管道之类) 就不映射
+struct Mapped {
+    bool opened = false;
+    bool regular = false;
+    const char *data = nullptr;
+    size_t len = 0;
+
+    explicit Mapped(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        opened = true;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            len = (size_t)st.st_size;
+            void *map = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+            if (map != MAP_FAILED) {
+                regular = true;
+                data = static_cast<const char*>(map);
+            }
+        }
+        close(fd);
+    }
+    ~Mapped() {
+        if (data) munmap(const_cast<char*>(data), len);
+    }
+    Mapped(const Mapped &) = delete;
+    Mapped &operator=(const Mapped &) = delete;
+
+    std::string_view text() const { return std::string_view(data, len); }
+};
+
+/*
+parse 只看表头的名字在环境里有没有绑定, 而只有原语和关键字的名字会因此解析成别的样子
+把全局环境里这样的名字抄进一个小环境, 对它解析和对整个全局环境解析结果一样,
+却不用每个表头都把全局环境从头找一遍
+新名字一般加在小环境最前面, 推迟解析的函数体看到的还是当时的样子, 和当场解析一样;
+--lazy-lambda 的函数体本来就看得到后来的定义, 这时和 define 一样插在头结点后面
+*/
+class Forms {
+public:
+    explicit Forms(Assoc &env) : env(env), shadow(nullptr), unit(Arena::make<ExprBase>()) {
+        Assoc none = empty();
+        shadow = extend("", VoidV(), none);
+        std::set<std::string> bound;
+        note(env.get(), nullptr, &bound);
+        std::string all;
+        for (auto &x : bound) {
+            all += x;
+            all += '\0';
+        }
+        initial = digest(all, versionSeed());
+    }
+
+    /** @brief 开始时小环境里的名字 */
+    const Digest &names() const { return initial; }
+
+    Value eval(const Syntax &stx, bool defer) {
+        Expr expr(nullptr);
+        {
+            Arena::Scope scope(ExprBase::arena, unit.get());
+            bool saved = defer_bodies;
+            defer_bodies = defer;
+            try {
+                expr = stx->parse(shadow).retained();
+            } catch (...) {
+                defer_bodies = saved;
+                throw;
+            }
+            defer_bodies = saved;
+        }
+        AssocList *head = env.get();
+        AssocList *second = head ? head->next.get() : nullptr;
+        Value result = expr->eval(env);
+        // define 把新名字插在全局环境的头结点后面, 环境原来是空的时候新名字就是头
+        if (env.get() == head) {
+            if (head) note(head->next.get(), second, nullptr);
+        } else {
+            note(env.get(), head, nullptr);
+        }
+        return result;
+    }
+
+private:
+    Assoc &env;
+    Assoc shadow;
+    std::shared_ptr<Arena> unit;   ///< 整个文件是一个编译单元
+    Digest initial;
+
+    void note(AssocList *from, AssocList *stop, std::set<std::string> *bound) {
+        for (AssocList *node = from; node && node != stop; node = node->next.get()) {
+            if (!node->v.get() || !(primitives.count(node->x) || reserved_words.count(node->x)))
+                continue;
+            if (bound) bound->insert(node->x);
+            if (lazy_lambda)
+                shadow->next = extend(node->x, VoidV(), shadow->next);
+            else
+                shadow = extend(node->x, VoidV(), shadow);
+        }
+    }
+};
+
+// 和 Reader::read 一样, 每个表达式的语法树放在自己的 arena 里
+Syntax decodeForm(std::string_view in, size_t &pos) {
+    std::shared_ptr<Arena> nodes = Arena::make<SyntaxBase>();
+    Arena::Scope scope(SyntaxBase::arena, nodes.get());
+    return decodeSyntax(in, pos).retained();
+}
+
+// 头和内容都对得上才用; 内容的校验和先整个算完, 坏条目不会求值到一半才发现
+bool usable(std::string_view entry, std::string_view source, const Digest &key, Header &h) {
+    if (entry.size() < sizeof h) return false;
+    memcpy(&h, entry.data(), sizeof h);
+    std::string_view payload = entry.substr(sizeof h);
+    return memcmp(h.magic, MAGIC, sizeof MAGIC) == 0
+        && h.source_len == source.size()
+        && h.source == key
+        && h.payload_len == payload.size()
+        && h.payload == digest(payload, versionSeed());
+}
+
+// 缓存只是加速, 目录建不了或者写不进去都当没有缓存
+void store(const std::string &entry, std::string_view source, const Digest &key,
+           uint64_t forms, const Digest &names, const std::string &payload) {
+    Header h;
+    memcpy(h.magic, MAGIC, sizeof MAGIC);
+    h.source_len = source.size();
+    h.source = key;
+    h.forms = forms;
+    h.names = names;
+    h.checked = !lazy_lambda;
+    h.payload_len = payload.size();
+    h.payload = digest(payload, versionSeed());
+    std::string data(reinterpret_cast<const char*>(&h), sizeof h);
+    data += payload;
+    if (!makeDirs(load_cache_dir)) return;
+    try {
+        replaceFile(entry, data);
+    } catch (const RuntimeError &) {
+    }
+}
+
+} // namespace
+
+std::string load_cache_dir = defaultCacheDir();
+
+Value loadFile(const std::string &path, Assoc &env) {
+    Mapped source(path);
+    if (!source.opened)
+        throw RuntimeError("Cannot open " + path);
+    Forms forms(env);
+    Value result = VoidV();
+
+    // 管道之类的照常一块块读, 内容要读完才知道, 不进缓存
+    if (!source.regular) {
+        Reader in(std::string_view{});
+        if (!in.open(path))
+            throw RuntimeError("Cannot open " + path);
+        while (!in.atEnd()) {
+            result = forms.eval(in.read(), false);
+            if (result->v_type == V_TERMINATE) break;
+        }
+        return result;
+    }
+
+    std::string_view text = source.text();
+    Digest key = digest(text, versionSeed());
+    std::string entry;
+    if (!load_cache_dir.empty())
+        entry = load_cache_dir + "/" + hex(key.a) + hex(key.b) + ".scmc";
+
+    if (!entry.empty()) {
+        Mapped cached(entry);
+        Header h;
+        if (cached.regular && usable(cached.text(), text, key, h)) {
+            /*
+            上次 load 在同样的名字下把函数体都解析过了, 这次就推迟到第一次调用,
+            解析的结果一样, 也不会出错; 只有文件按运行时的条件重新绑定原语名时才可能不同
+            */
+            bool defer = h.checked && h.names == forms.names();
+            std::string_view in = cached.text();
+            size_t pos = sizeof h;
+            for (uint64_t i = 0; i < h.forms; i++) {
+                result = forms.eval(decodeForm(in, pos), defer);
+                if (result->v_type == V_TERMINATE) break;
+            }
+            return result;
+        }
+    }
+
+    Reader in(text);
+    in.parallel();
+    std::string payload;
+    uint64_t count = 0;
+    while (!in.atEnd()) {
+        Syntax stx = in.read();
+        if (!entry.empty()) encodeSyntax(stx, payload);
+        count++;
+        result = forms.eval(stx, false);
+        if (result->v_type == V_TERMINATE) return result;
+    }
+    if (!entry.empty())
+        store(entry, text, key, count, forms.names(), payload);
+    return result;
+}
+
+Value Load::evalRator(const Value &path) { // load
+    if (path->v_type != V_STRING)
+        throw RuntimeError("Wrong typename in load");
+    if (!current_interpreter)
+        throw RuntimeError("load outside an interpreter session");
+    return loadFile(static_cast<String*>(path.get())->str(), current_interpreter->environment());
+}
@@ -0,0 +1,45 @@
+#ifndef LOADCACHE
+#define LOADCACHE
+
+/**
+ * @file loadcache.hpp
+ * @brief (load "file") with a cache of files already read
+ *
+ * The first load of a file stores its forms, in the serializer's binary
+ * syntax encoding (see serialize.hpp), under a name derived from a hash of
+ * the file contents and the cache format version. Loading the same contents
+ * again decodes the forms straight from the mapped entry instead of reading
+ * the text.
+ *
+ * The entry keeps syntax rather than Expr trees because a parse depends on
+ * the global environment: a primitive name that the program has rebound is
+ * called like any procedure. Both paths therefore parse every form against
+ * a small environment holding only the primitive and keyword names bound
+ * in the global one, so they never search the whole global environment,
+ * and the result is the same as parsing against it.
+ *
+ * An entry records the length and hash of its source and a checksum of its
+ * own contents. An entry that does not match is ignored and rewritten.
+ */
+
+#include "value.hpp"
+#include <string>
+
+/**
+ * @brief Directory holding the cache entries; empty turns the cache off
+ * Defaults to $SCHEME_CACHE_DIR, else $XDG_CACHE_HOME/scheme, else
+ * $HOME/.cache/scheme. Created on first use.
+ */
+extern std::string load_cache_dir;
+
+/**
+ * @brief Evaluates the forms of the file at path in env, one by one
+ * Stops early at (exit), returning the terminate value. Entries are written
+ * only for files that were evaluated to the end.
+ * @return value of the last form
+ * @throws RuntimeError if the file cannot be read, or from parsing or
+ * evaluation
+ */
+Value loadFile(const std::string &path, Assoc &env);
+
+#endif // LOADCACHE
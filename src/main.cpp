@@ -1,80 +1,186 @@
-#include "Def.hpp"
-#include "syntax.hpp"
-#include "expr.hpp"
-#include "value.hpp"
-#include "RE.hpp"
+#include "image.hpp"
+#include "interpreter.hpp"
+#include "loadcache.hpp"
+#include "port.hpp"
+#include "prelude.hpp"
+#include "purity.hpp"
+#include "remote.hpp"
+#include "server.hpp"
+#include "threadpool.hpp"
 #include <sstream>
 #include <iostream>
-#include <map>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cstdlib>
+#include <unistd.h>
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+// --pipeline: 输入在另一个线程上提前读好, 求值的同时读后面的表达式
+// 只有一个硬件线程时读和求值重叠不起来, 只剩交接的开销, 就不开; --threads 给了多个线程时照开
+static bool pipeline_input = false;
 
-bool isExplicitVoidCall(Expr expr) {
-    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
-    if (make_void_expr != nullptr) {
-        return true;
-    }
-    
-    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
-    if (apply_expr != nullptr) {
-        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
-        if (var_expr != nullptr && var_expr->x == "void") {
-            return true;
-        }
-    }
-    
-    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
-    if (begin_expr != nullptr && !begin_expr->es.empty()) {
-        return isExplicitVoidCall(begin_expr->es.back());
-    }
-    
-    If* if_expr = dynamic_cast<If*>(expr.get());
-    if (if_expr != nullptr) {
-        return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
-    }
-    
-    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
-    if (cond_expr != nullptr) {
-        for (const auto& clause : cond_expr->clauses) {
-            if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
-                return true;
-            }
-        }
+// --image: 开始之前先把镜像里的全局绑定装进解释器
+static std::string start_image;
+
+// --no-prelude: 不装构建时编进来的 prelude (见 prelude.hpp)
+static bool use_prelude = true;
+
+// 先装 prelude, 再装 --image, 镜像里的同名定义覆盖 prelude 的
+// 服务器的会话和 --worker 也从这里开始, 它们得和 REPL 看到同样的全局环境
+static void startSession(Interpreter &interp) {
+    if (use_prelude) {
+        std::string_view image(reinterpret_cast<const char*>(prelude_image), prelude_image_size);
+        decodeImage(image, interp.environment(), "prelude");
     }
-    return false;
+    if (!start_image.empty())
+        loadImage(start_image, interp.environment());
 }
 
-void REPL(){
+int REPL(){
     // read - evaluation - print loop
-    Assoc global_env = empty();
-    while (1){
-        #ifndef ONLINE_JUDGE
-            std::cout << "scm> ";
-        #endif
-        Syntax stx = readSyntax(std :: cin); // read
-        try{
-            Expr expr = stx -> parse(global_env); // parse
-            // stx -> show(std :: cout); // syntax print
-            Value val = expr -> eval(global_env);
-            if (val -> v_type == V_TERMINATE)
-                break;
-            if(val->v_type!=V_VOID||isExplicitVoidCall(expr)){
-                val -> show(std :: cout); // value print
+    // 标准输出自己缓冲, 满了或者要等输入时才写, 不再每次 display 都进 iostream 的同步缓冲
+    FdBuf stdout_buf(STDOUT_FILENO);
+    std::ostream out(&stdout_buf);
+    Interpreter interp(out);
+    try {
+        startSession(interp);
+    } catch (const RuntimeError &e) {
+        std::cerr << "code: " << e.message() << std::endl;
+        return 1;
+    }
+    Reader in(STDIN_FILENO);
+    if (pipeline_input) in.pipeline();
+    #ifndef ONLINE_JUDGE
+        interp.repl(in, true);
+    #else
+        interp.repl(in, false);
+    #endif
+    // 还在跑的 future 往 std::cout 里写, 先停掉线程池
+    ThreadPool::shutdownGlobal();
+    return 0;
+}
+
+/*
+--batch: 每个脚本在自己的全局环境里跑, jobs 个线程从队列里领文件
+输出先各自攒在 ostringstream 里, 主线程按输入顺序依次写出, 写完就释放
+*/
+static int runBatch(const std::vector<std::string> &files, unsigned jobs) {
+    size_t n = files.size();
+    std::vector<std::string> outputs(n);
+    std::vector<bool> done(n, false);
+    std::vector<bool> failed(n, false);
+    std::mutex m;
+    std::condition_variable ready;
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < n) {
+            std::ostringstream os;
+            bool ok = true;
+            Reader in(std::string_view{});
+            if (!in.open(files[i])) {
+                ok = false;
+            } else {
+                in.parallel();
+                if (pipeline_input) in.pipeline();
+                try {
+                    Interpreter interp(os);
+                    startSession(interp);
+                    interp.repl(in, false);
+                } catch (const RuntimeError &e) {
+                    os << "\n" << e.message() << "\n";
+                    ok = false;
+                } catch (const std::exception &e) {
+                    os << "\n" << e.what() << "\n";
+                    ok = false;
+                }
             }
-                
+            std::lock_guard<std::mutex> lk(m);
+            outputs[i] = os.str();
+            done[i] = true;
+            failed[i] = !ok;
+            ready.notify_all();
+        }
+    };
+
+    if (jobs == 0) jobs = 1;
+    std::vector<std::thread> threads;
+    for (unsigned k = 0; k < jobs && k < n; k++)
+        threads.emplace_back(worker);
+
+    int status = 0;
+    for (size_t i = 0; i < n; i++) {
+        std::string text;
+        bool bad;
+        {
+            std::unique_lock<std::mutex> lk(m);
+            ready.wait(lk, [&] { return done[i]; });
+            text.swap(outputs[i]);
+            bad = failed[i];
         }
-        catch (const RuntimeError &RE){
-            // std :: cout << RE.message();
-            std :: cout << "RuntimeError";
+        std::cout << text;
+        std::cout.flush();
+        if (bad) {
+            std::cerr << "code: failed to run " << files[i] << std::endl;
+            status = 1;
         }
-        puts("");
-        
     }
+    for (auto &t : threads) t.join();
+    ThreadPool::shutdownGlobal();
+    return status;
 }
 
-
 int main(int argc, char *argv[]) {
-    REPL();
-    return 0;
-}
\ No newline at end of file
+    bool batch = false;
+    unsigned jobs = std::thread::hardware_concurrency();
+    ServerOptions serve;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--parallel-args") parallel_args = true;
+        else if (arg == "--no-parallel-args") parallel_args = false;
+        else if (arg == "--threads" && i + 1 < argc) ThreadPool::setGlobalWorkers((unsigned)atoi(argv[++i]));
+        else if (arg == "--batch") batch = true;
+        else if (arg == "--pipeline") pipeline_input = true;
+        else if (arg == "--lazy-lambda") lazy_lambda = true;
+        else if (arg == "--image" && i + 1 < argc) start_image = argv[++i];
+        else if (arg == "--cache-dir" && i + 1 < argc) load_cache_dir = argv[++i];
+        else if (arg == "--no-prelude") use_prelude = false;
+        else if (arg == "--jobs" && i + 1 < argc) jobs = (unsigned)atoi(argv[++i]);
+        else if (arg == "--serve" && i + 1 < argc) serve.socket_path = argv[++i];
+        else if (arg == "--prelude" && i + 1 < argc) serve.prelude = argv[++i];
+        else if (arg == "--prefork" && i + 1 < argc) {
+            serve.prefork = true;
+            serve.workers = (unsigned)atoi(argv[++i]);
+        }
+        else if (arg == "--quiet") serve.log = false;
+        else if (arg == "--worker" && i + 1 < argc) return runWorker(argv[++i], startSession);
+        else if (arg == "--remote" && i + 1 < argc) remote_workers = argv[++i];
+        else if (arg == "--max-steps" && i + 1 < argc) serve.max_steps = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--max-depth" && i + 1 < argc) serve.max_depth = strtoull(argv[++i], nullptr, 10);
+        else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "code: unknown option " << arg << std::endl;
+            return 2;
+        }
+        else files.push_back(arg);
+    }
+    if (ThreadPool::globalWorkers() <= 1)
+        pipeline_input = false;
+    serve.setup = startSession;
+    if (batch)
+        return runBatch(files, jobs);
+    if (!files.empty()) {
+        std::cerr << "code: unexpected argument " << files[0] << " (script files need --batch)" << std::endl;
+        return 2;
+    }
+    if (!serve.socket_path.empty()) {
+        if (!serve.prefork)
+            serve.workers = jobs ? jobs : 1;
+        return serveUnixSocket(serve);
+    }
+    if (serve.prefork)
+        return dispatchPrefork(serve);
+    return REPL();
+}
@@ -0,0 +1,70 @@
+/**
+ * @file native.cpp
+ * @brief Native procedure calls and shared-object extensions
+ */
+
+#include "native.hpp"
+#include "interpreter.hpp"
+#include <climits>
+#include <cmath>
+#include <exception>
+#include <dlfcn.h>
+
+Value NativeProc::evalRator(const std::vector<Value> &args) { // native procedure
+    if (arity >= 0 && args.size() != (size_t)arity)
+        throw RuntimeError("Wrong number of arguments for " + name);
+    try {
+        return fn(args);
+    } catch (const RuntimeError &) {
+        throw;
+    } catch (const std::exception &e) {
+        // C++ 那边抛出来的异常统一变成 RuntimeError, REPL 才接得住
+        throw RuntimeError(name + ": " + e.what());
+    }
+}
+
+/*
+double 转成精确数: 整数直接给 Integer, 否则用连分数找分母不超过 2^20 的最佳近似
+*/
+Value nativeDoubleToValue(double x) {
+    if (!std::isfinite(x) || std::fabs(x) > INT_MAX)
+        throw RuntimeError("Native result out of range");
+    if (x == std::floor(x))
+        return IntegerV((int)x);
+    const long long max_den = 1 << 20;
+    long long p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+    double r = x;
+    for (int i = 0; i < 64; i++) {
+        long long a = (long long)std::floor(r);
+        long long p2 = a * p1 + p0, q2 = a * q1 + q0;
+        if (q2 > max_den || std::llabs(p2) > INT_MAX) break;
+        p0 = p1; q0 = q1; p1 = p2; q1 = q2;
+        double frac = r - a;
+        if (frac < 1e-12) break;
+        r = 1 / frac;
+    }
+    if (q1 == 1)
+        return IntegerV((int)p1);
+    return RationalV((int)p1, (int)q1);
+}
+
+/*
+扩展库加载后就不再卸载: 它注册的过程随时可能还会被调用
+*/
+Value LoadExtension::evalRator(const Value &rand) { // load-extension
+    if (rand->v_type != V_STRING)
+        throw RuntimeError("Wrong typename in load-extension");
+    if (!current_interpreter)
+        throw RuntimeError("load-extension outside an interpreter session");
+    std::string path = static_cast<String*>(rand.get())->str();
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+        throw RuntimeError(std::string("Cannot load extension: ") + dlerror());
+    ExtensionInit init = reinterpret_cast<ExtensionInit>(dlsym(handle, "scheme_init_extension"));
+    if (!init) {
+        dlclose(handle);
+        throw RuntimeError("No scheme_init_extension in " + path);
+    }
+    init(*current_interpreter);
+    return VoidV();
+}
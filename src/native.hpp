@@ -0,0 +1,117 @@
+#ifndef NATIVE
+#define NATIVE
+
+/**
+ * @file native.hpp
+ * @brief Typed C++ functions as Scheme procedures
+ *
+ * makeNative turns any function pointer, lambda or functor whose parameter
+ * and result types have a NativeType specialization into a NativeProc body.
+ * The argument count and the type checks are generated from the signature,
+ * so the registered procedure is applied exactly like a built-in primitive.
+ *
+ * Supported types: int, double, bool, std::string and Value (unchecked);
+ * results may also be void. Add a NativeType specialization for more.
+ */
+
+#include "expr.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T> struct NativeType;
+
+template <> struct NativeType<int> {
+    static int from(const Value &v, const std::string &who) {
+        if (v->v_type != V_INT)
+            throw RuntimeError("Wrong typename in " + who + ", expected integer");
+        return static_cast<Integer*>(v.get())->n;
+    }
+    static Value to(int n) { return IntegerV(n); }
+};
+
+/**
+ * @brief Closest exact number; integers stay integers
+ * @throws RuntimeError if the double is not finite or does not fit an int
+ */
+Value nativeDoubleToValue(double);
+
+template <> struct NativeType<double> {
+    static double from(const Value &v, const std::string &who) {
+        if (v->v_type == V_INT)
+            return static_cast<Integer*>(v.get())->n;
+        if (v->v_type == V_RATIONAL) {
+            Rational *r = static_cast<Rational*>(v.get());
+            return (double)r->numerator / r->denominator;
+        }
+        throw RuntimeError("Wrong typename in " + who + ", expected number");
+    }
+    static Value to(double x) { return nativeDoubleToValue(x); }
+};
+
+template <> struct NativeType<bool> {
+    static bool from(const Value &v, const std::string &who) {
+        if (v->v_type != V_BOOL)
+            throw RuntimeError("Wrong typename in " + who + ", expected boolean");
+        return static_cast<Boolean*>(v.get())->b;
+    }
+    static Value to(bool b) { return BooleanV(b); }
+};
+
+template <> struct NativeType<std::string> {
+    static std::string from(const Value &v, const std::string &who) {
+        if (v->v_type != V_STRING)
+            throw RuntimeError("Wrong typename in " + who + ", expected string");
+        return static_cast<String*>(v.get())->str();
+    }
+    static Value to(const std::string &s) { return StringV(s); }
+};
+
+template <> struct NativeType<Value> {
+    static const Value &from(const Value &v, const std::string &) { return v; }
+    static Value to(const Value &v) { return v; }
+};
+
+/**
+ * @brief Recovers R(Args...) from function pointers, lambdas and functors
+ */
+template <typename F> struct NativeSignature : NativeSignature<decltype(&F::operator())> {};
+template <typename R, typename... Args> struct NativeSignature<R (*)(Args...)> {
+    typedef R result;
+    typedef std::function<R(Args...)> function;
+    static constexpr size_t arity = sizeof...(Args);
+};
+template <typename C, typename R, typename... Args>
+struct NativeSignature<R (C::*)(Args...)> : NativeSignature<R (*)(Args...)> {};
+template <typename C, typename R, typename... Args>
+struct NativeSignature<R (C::*)(Args...) const> : NativeSignature<R (*)(Args...)> {};
+
+template <typename R, typename... Args, size_t... I>
+Value callNative(const std::function<R(Args...)> &fn, const std::vector<Value> &args,
+                 const std::string &who, std::index_sequence<I...>) {
+    if constexpr (std::is_void_v<R>) {
+        fn(NativeType<std::decay_t<Args>>::from(args[I], who)...);
+        return VoidV();
+    } else {
+        return NativeType<std::decay_t<R>>::to(fn(NativeType<std::decay_t<Args>>::from(args[I], who)...));
+    }
+}
+
+/**
+ * @brief Body of a procedure that unpacks, checks and forwards to fn
+ */
+template <typename F>
+Expr makeNative(const std::string &name, F fn) {
+    typedef NativeSignature<std::decay_t<F>> Sig;
+    typename Sig::function typed(std::move(fn));
+    return Expr(new NativeProc(name, (int)Sig::arity,
+        [typed, name](const std::vector<Value> &args) {
+            return callNative(typed, args, name, std::make_index_sequence<Sig::arity>());
+        }));
+}
+
+#endif // NATIVE
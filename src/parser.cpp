@@ -21,8 +21,54 @@ using std::string;
 using std::vector;
 using std::pair;
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
+
+bool lazy_lambda = false;
+thread_local bool defer_bodies = false;
+
+/*
+函数体: stxs[from..] 是一个或多个表达式, 多个用 begin 包起来, 一个都没有就是 void
+defer 时整个函数体先留着语法, 第一次求值时再在同一个作用域里解析
+*/
+static Expr parseBody(const vector<Syntax> &stxs, size_t from, Assoc &env, bool defer) {
+    if (from == stxs.size())
+        return Expr(new MakeVoid());
+    if (defer)
+        return Expr(new LazyBody(vector<Syntax>(stxs.begin() + from, stxs.end()), env));
+    if (from + 1 == stxs.size())
+        return stxs[from]->parse(env);
+    vector<Expr> body_exprs;
+    for (size_t i = from; i < stxs.size(); i++)
+        body_exprs.push_back(stxs[i]->parse(env));
+    return Expr(new Begin(std::move(body_exprs)));
+}
+
+/*
+只解析一次; 解析出错也记下来, 之后每次调用都抛同一个错
+解析出来的节点放在堆上, 不进当前的 arena (求值时也不该有)
+*/
+ExprBase *LazyBody::force() {
+    if (!ready.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lk(m);
+        if (!ready.load(std::memory_order_relaxed)) {
+            try {
+                Arena::Scope heap(ExprBase::arena, nullptr);
+                Assoc env(nullptr);
+                env.ptr = scope;
+                parsed = parseBody(body, 0, env, false);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            body.clear();
+            scope.reset();
+            ready.store(true, std::memory_order_release);
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+    return parsed.get();
+}
 
 /**
  * @brief Default parse method (should be overridden by subclasses)
@@ -108,7 +154,7 @@ Expr List::parse(Assoc &env) {
                 parameters.push_back(stxs[i]->parse(env));
             //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
             //函数名这一块
-            ExprType op_type = primitives[op];
+            ExprType op_type = primitives.at(op);
             if (op_type == E_PLUS) {
                 if (parameters.size() == 2) {
                     return Expr(new Plus(parameters[0], parameters[1])); 
@@ -231,6 +277,307 @@ Expr List::parse(Assoc &env) {
                     throw RuntimeError("Wrong number of set-cdr!");
                 }
                 return Expr(new SetCdr(parameters[0], parameters[1]));
+            } else if (op_type == E_VECTOR) {
+                return Expr(new VectorFunc(parameters));
+            } else if (op_type == E_MAKE_VECTOR) {
+                if (parameters.size() != 1 && parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of make-vector");
+                }
+                return Expr(new MakeVector(parameters));
+            } else if (op_type == E_VECTOR_REF) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of vector-ref");
+                }
+                return Expr(new VectorRef(parameters[0], parameters[1]));
+            } else if (op_type == E_VECTOR_SET) {
+                if (parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of vector-set!");
+                }
+                return Expr(new VectorSet(parameters));
+            } else if (op_type == E_VECTOR_LENGTH) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of vector-length");
+                }
+                return Expr(new VectorLength(parameters[0]));
+            } else if (op_type == E_VECTOR_TO_LIST) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of vector->list");
+                }
+                return Expr(new VectorToList(parameters[0]));
+            } else if (op_type == E_LIST_TO_VECTOR) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of list->vector");
+                }
+                return Expr(new ListToVector(parameters[0]));
+            } else if (op_type == E_STRING_APPEND) {
+                return Expr(new StringAppend(parameters));
+            } else if (op_type == E_SUBSTRING) {
+                if (parameters.size() != 2 && parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of substring");
+                }
+                return Expr(new Substring(parameters));
+            } else if (op_type == E_STRING_LENGTH) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of string-length");
+                }
+                return Expr(new StringLength(parameters[0]));
+            } else if (op_type == E_STRING_REF) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of string-ref");
+                }
+                return Expr(new StringRef(parameters[0], parameters[1]));
+            } else if (op_type == E_STRING_TO_SYMBOL) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of string->symbol");
+                }
+                return Expr(new StringToSymbol(parameters[0]));
+            } else if (op_type == E_SYMBOL_TO_STRING) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of symbol->string");
+                }
+                return Expr(new SymbolToString(parameters[0]));
+            } else if (op_type == E_STRING_TO_NUMBER) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of string->number");
+                }
+                return Expr(new StringToNumber(parameters[0]));
+            } else if (op_type == E_NUMBER_TO_STRING) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of number->string");
+                }
+                return Expr(new NumberToString(parameters[0]));
+            } else if (op_type == E_STRING_INDEX) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of string-index");
+                }
+                return Expr(new StringIndex(parameters[0], parameters[1]));
+            } else if (op_type == E_STRING_SEARCH) {
+                if (parameters.size() != 2 && parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of string-search");
+                }
+                return Expr(new StringSearch(parameters));
+            } else if (op_type == E_MAKE_STRING_BUILDER) {
+                if (!parameters.empty()) {
+                    throw RuntimeError("Wrong number of make-string-builder");
+                }
+                return Expr(new MakeStringBuilder(parameters));
+            } else if (op_type == E_STRING_BUILDER_APPEND) {
+                if (parameters.empty()) {
+                    throw RuntimeError("Wrong number of string-builder-append!");
+                }
+                return Expr(new StringBuilderAppend(parameters));
+            } else if (op_type == E_STRING_BUILDER_TO_STRING) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of string-builder->string");
+                }
+                return Expr(new StringBuilderToString(parameters[0]));
+            } else if (op_type == E_MAKE_PMAP) {
+                if (!parameters.empty()) {
+                    throw RuntimeError("Wrong number of make-pmap");
+                }
+                return Expr(new MakePMap(parameters));
+            } else if (op_type == E_PMAP_SET) {
+                if (parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of pmap-set");
+                }
+                return Expr(new PMapSet(parameters));
+            } else if (op_type == E_PMAP_REF) {
+                if (parameters.size() != 2 && parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of pmap-ref");
+                }
+                return Expr(new PMapRef(parameters));
+            } else if (op_type == E_PMAP_REMOVE) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of pmap-remove");
+                }
+                return Expr(new PMapRemove(parameters[0], parameters[1]));
+            } else if (op_type == E_PMAP_CONTAINS) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of pmap-contains?");
+                }
+                return Expr(new PMapContains(parameters[0], parameters[1]));
+            } else if (op_type == E_PMAP_COUNT) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of pmap-count");
+                }
+                return Expr(new PMapCount(parameters[0]));
+            } else if (op_type == E_PMAP_TO_LIST) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of pmap->list");
+                }
+                return Expr(new PMapToList(parameters[0]));
+            } else if (op_type == E_PVECTOR) {
+                return Expr(new PVectorFunc(parameters));
+            } else if (op_type == E_PVECTOR_LENGTH) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of pvector-length");
+                }
+                return Expr(new PVectorLength(parameters[0]));
+            } else if (op_type == E_PVECTOR_REF) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of pvector-ref");
+                }
+                return Expr(new PVectorRef(parameters[0], parameters[1]));
+            } else if (op_type == E_PVECTOR_SET) {
+                if (parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of pvector-set");
+                }
+                return Expr(new PVectorSet(parameters));
+            } else if (op_type == E_PVECTOR_PUSH) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of pvector-push");
+                }
+                return Expr(new PVectorPush(parameters[0], parameters[1]));
+            } else if (op_type == E_PVECTOR_TO_LIST) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of pvector->list");
+                }
+                return Expr(new PVectorToList(parameters[0]));
+            } else if (op_type == E_FORCE) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of force");
+                }
+                return Expr(new Force(parameters[0]));
+            } else if (op_type == E_MAKE_PROMISE) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of make-promise");
+                }
+                return Expr(new MakePromise(parameters[0]));
+            } else if (op_type == E_STREAM_CAR) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of stream-car");
+                }
+                return Expr(new StreamCar(parameters[0]));
+            } else if (op_type == E_STREAM_CDR) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of stream-cdr");
+                }
+                return Expr(new StreamCdr(parameters[0]));
+            } else if (op_type == E_TOUCH) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of touch");
+                }
+                return Expr(new Touch(parameters[0]));
+            } else if (op_type == E_PAR_MAP) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of pmap");
+                }
+                return Expr(new ParMap(parameters[0], parameters[1]));
+            } else if (op_type == E_PAR_FOR_EACH) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of pfor-each");
+                }
+                return Expr(new ParForEach(parameters[0], parameters[1]));
+            } else if (op_type == E_PAR_REDUCE) {
+                if (parameters.size() != 3) {
+                    throw RuntimeError("Wrong number of preduce");
+                }
+                return Expr(new ParReduce(parameters));
+            } else if (op_type == E_PAR_SORT) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of psort");
+                }
+                return Expr(new ParSort(parameters[0], parameters[1]));
+            } else if (op_type == E_SPAWN) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of spawn");
+                }
+                return Expr(new Spawn(parameters[0]));
+            } else if (op_type == E_YIELD) {
+                if (!parameters.empty()) {
+                    throw RuntimeError("Wrong number of yield");
+                }
+                return Expr(new Yield(parameters));
+            } else if (op_type == E_TASK_JOIN) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of task-join");
+                }
+                return Expr(new TaskJoin(parameters[0]));
+            } else if (op_type == E_MAKE_CHANNEL) {
+                if (parameters.size() > 1) {
+                    throw RuntimeError("Wrong number of make-channel");
+                }
+                return Expr(new MakeChannel(parameters));
+            } else if (op_type == E_CHANNEL_SEND) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of channel-send");
+                }
+                return Expr(new ChannelSend(parameters[0], parameters[1]));
+            } else if (op_type == E_CHANNEL_RECV) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of channel-recv");
+                }
+                return Expr(new ChannelRecv(parameters[0]));
+            } else if (op_type == E_FD_WAIT) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of fd-wait");
+                }
+                return Expr(new FdWait(parameters[0]));
+            } else if (op_type == E_FD_READ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of fd-read");
+                }
+                return Expr(new FdRead(parameters[0]));
+            } else if (op_type == E_SPAWN_ISOLATE) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of spawn-isolate");
+                }
+                return Expr(new SpawnIsolate(parameters[0]));
+            } else if (op_type == E_ISOLATE_SEND) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of isolate-send!");
+                }
+                return Expr(new IsolateSend(parameters[0], parameters[1]));
+            } else if (op_type == E_ISOLATE_RECEIVE) {
+                if (!parameters.empty()) {
+                    throw RuntimeError("Wrong number of isolate-receive");
+                }
+                return Expr(new IsolateReceive(parameters));
+            } else if (op_type == E_ISOLATE_JOIN) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of isolate-join");
+                }
+                return Expr(new IsolateJoin(parameters[0]));
+            } else if (op_type == E_ISOLATE_PARENT) {
+                if (!parameters.empty()) {
+                    throw RuntimeError("Wrong number of isolate-parent");
+                }
+                return Expr(new IsolateParent(parameters));
+            } else if (op_type == E_REMOTE_APPLY) {
+                if (parameters.empty()) {
+                    throw RuntimeError("Wrong number of remote-apply");
+                }
+                return Expr(new RemoteApply(parameters));
+            } else if (op_type == E_REMOTE_MAP) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of remote-map");
+                }
+                return Expr(new RemoteMap(parameters[0], parameters[1]));
+            } else if (op_type == E_SAVE_IMAGE) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of save-image");
+                }
+                return Expr(new SaveImage(parameters[0]));
+            } else if (op_type == E_LOAD) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of load");
+                }
+                return Expr(new Load(parameters[0]));
+            } else if (op_type == E_LOAD_EXTENSION) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of load-extension");
+                }
+                return Expr(new LoadExtension(parameters[0]));
+            } else if (op_type == E_SORT) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of arguments for " + op);
+                }
+                return Expr(new Sort(parameters[0], parameters[1]));
+            } else if (op_type == E_VECTOR_SORT) {
+                if (parameters.size() != 2) {
+                    throw RuntimeError("Wrong number of vector-sort!");
+                }
+                return Expr(new VectorSort(parameters[0], parameters[1]));
             } else if (op_type == E_LIST) {
                 return Expr(new ListFunc(parameters));
             } else if (op_type == E_LISTQ) {
@@ -273,6 +620,51 @@ Expr List::parse(Assoc &env) {
                     throw RuntimeError("Wrong number of string?");
                 }
                 return Expr(new IsString(parameters[0]));
+            } else if (op_type == E_VECTORQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of vector?");
+                }
+                return Expr(new IsVector(parameters[0]));
+            } else if (op_type == E_PROMISEQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of promise?");
+                }
+                return Expr(new IsPromise(parameters[0]));
+            } else if (op_type == E_FUTUREQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of future?");
+                }
+                return Expr(new IsFuture(parameters[0]));
+            } else if (op_type == E_TASKQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of task?");
+                }
+                return Expr(new IsTask(parameters[0]));
+            } else if (op_type == E_CHANNELQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of channel?");
+                }
+                return Expr(new IsChannel(parameters[0]));
+            } else if (op_type == E_ISOLATEQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of isolate?");
+                }
+                return Expr(new IsIsolate(parameters[0]));
+            } else if (op_type == E_OUTPUT_PORTQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of output-port?");
+                }
+                return Expr(new IsOutputPort(parameters[0]));
+            } else if (op_type == E_PMAPQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of pmap?");
+                }
+                return Expr(new IsPMap(parameters[0]));
+            } else if (op_type == E_PVECTORQ) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of pvector?");
+                }
+                return Expr(new IsPVector(parameters[0]));
             } else if (op_type == E_EQQ) {
                 if (parameters.size() != 2) {
                     throw RuntimeError("Wrong number of eq?");
@@ -281,10 +673,63 @@ Expr List::parse(Assoc &env) {
                 
             // 输入输出
             } else if (op_type == E_DISPLAY) {
+                if (parameters.size() == 1) {
+                    return Expr(new Display(parameters[0]));
+                } else if (parameters.size() == 2) {
+                    return Expr(new DisplayPort(parameters[0], parameters[1]));
+                }
+                throw RuntimeError("Wrong number of display");
+            } else if (op_type == E_WRITE) {
+                if (parameters.size() == 1) {
+                    return Expr(new Write(parameters[0]));
+                } else if (parameters.size() == 2) {
+                    return Expr(new WritePort(parameters[0], parameters[1]));
+                }
+                throw RuntimeError("Wrong number of write");
+            } else if (op_type == E_WRITE_STRING) {
+                if (parameters.size() == 1) {
+                    return Expr(new WriteString(parameters[0]));
+                } else if (parameters.size() == 2) {
+                    return Expr(new WriteStringPort(parameters[0], parameters[1]));
+                }
+                throw RuntimeError("Wrong number of write-string");
+            } else if (op_type == E_NEWLINE) {
+                if (parameters.size() > 1) {
+                    throw RuntimeError("Wrong number of newline");
+                }
+                return Expr(new Newline(parameters));
+            } else if (op_type == E_FLUSH_OUTPUT) {
+                if (parameters.size() > 1) {
+                    throw RuntimeError("Wrong number of flush-output");
+                }
+                return Expr(new FlushOutput(parameters));
+
+            // 输出端口
+            } else if (op_type == E_OPEN_OUTPUT_FILE) {
                 if (parameters.size() != 1) {
-                    throw RuntimeError("Wrong number of display");
+                    throw RuntimeError("Wrong number of open-output-file");
+                }
+                return Expr(new OpenOutputFile(parameters[0]));
+            } else if (op_type == E_OPEN_OUTPUT_STRING) {
+                if (!parameters.empty()) {
+                    throw RuntimeError("Wrong number of open-output-string");
                 }
-                return Expr(new Display(parameters[0]));
+                return Expr(new OpenOutputString(parameters));
+            } else if (op_type == E_GET_OUTPUT_STRING) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of get-output-string");
+                }
+                return Expr(new GetOutputString(parameters[0]));
+            } else if (op_type == E_CLOSE_OUTPUT_PORT) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of close-output-port");
+                }
+                return Expr(new CloseOutputPort(parameters[0]));
+            } else if (op_type == E_WITH_OUTPUT_TO_STRING) {
+                if (parameters.size() != 1) {
+                    throw RuntimeError("Wrong number of with-output-to-string");
+                }
+                return Expr(new WithOutputToString(parameters[0]));
                 
             // 特殊形式
             } else if (op_type == E_VOID) {
@@ -304,7 +749,7 @@ Expr List::parse(Assoc &env) {
         }
         //预留关键字这一块
         if (reserved_words.count(op) != 0) {
-            switch (reserved_words[op]) {
+            switch (reserved_words.at(op)) {
                 //TODO: TO COMPLETE THE reserve_words PARSER LOGIC
                 case E_IF:{
                     if(stxs.size()!=4){
@@ -345,15 +790,7 @@ Expr List::parse(Assoc &env) {
                     }
                     
                     // 使用新环境解析lambda体
-                    if (stxs.size() > 3) {
-                        vector<Expr> body_exprs;
-                        for(size_t i = 2; i < stxs.size(); i++) {
-                            body_exprs.push_back(stxs[i]->parse(new_env));
-                        }
-                        return Expr(new Lambda(parms, Expr(new Begin(std::move(body_exprs)))));
-                    } else {
-                        return Expr(new Lambda(parms, stxs[2]->parse(new_env)));
-                    }
+                    return Expr(new Lambda(parms, parseBody(stxs, 2, new_env, lazy_lambda || defer_bodies)));
                 }    
                 
                 case E_QUOTE:{
@@ -402,21 +839,7 @@ Expr List::parse(Assoc &env) {
                         }
                         
                         // 解析函数体
-                        std::vector<Expr> expr_list;
-                        size_t body_start = 2;
-                        for (size_t i = body_start; i < stxs.size(); i++) {
-                            expr_list.push_back(stxs[i]->parse(local_env));
-                        }
-                        
-                        // 构建函数体表达式
-                        Expr body_expr(nullptr);
-                        if (expr_list.empty()) {
-                            body_expr = Expr(new MakeVoid());
-                        } else if (expr_list.size() == 1) {
-                            body_expr = expr_list[0];
-                        } else {
-                            body_expr = Expr(new Begin(expr_list));
-                        }
+                        Expr body_expr = parseBody(stxs, 2, local_env, lazy_lambda || defer_bodies);
                         
                         // 创建lambda表达式
                         Expr lambda_def = Expr(new Lambda(param_list, body_expr));
@@ -435,6 +858,84 @@ Expr List::parse(Assoc &env) {
                         return Expr(new Define(sym_name->s, stxs[2]->parse(env)));
                     }
                 }
+                /*
+                define-record-type 的格式:
+                (define-record-type point
+                    (make-point x y)        构造函数及其参数对应的字段
+                    point?                  谓词
+                    (x point-x set-point-x!) 字段 访问器 [修改器]
+                    (y point-y))
+                展开成若干个 define, 每个过程的函数体都是原生的 Record* 表达式
+                */
+                case E_DEFINE_RECORD: {
+                    if (stxs.size() < 4) {
+                        throw RuntimeError("define-record-type: too few arguments");
+                    }
+                    auto type_name = dynamic_cast<SymbolSyntax*>(stxs[1].get());
+                    auto ctor_spec = dynamic_cast<List*>(stxs[2].get());
+                    auto pred_name = dynamic_cast<SymbolSyntax*>(stxs[3].get());
+                    if (!type_name || !ctor_spec || ctor_spec->stxs.empty() || !pred_name) {
+                        throw RuntimeError("define-record-type: bad syntax");
+                    }
+
+                    // 先收集所有字段, 字段的声明顺序就是槽位顺序
+                    vector<string> fields;
+                    for (size_t i = 4; i < stxs.size(); i++) {
+                        auto field_spec = dynamic_cast<List*>(stxs[i].get());
+                        if (!field_spec || field_spec->stxs.size() < 2 || field_spec->stxs.size() > 3) {
+                            throw RuntimeError("define-record-type: bad field spec");
+                        }
+                        auto field = dynamic_cast<SymbolSyntax*>(field_spec->stxs[0].get());
+                        if (!field) {
+                            throw RuntimeError("define-record-type: field name must be a symbol");
+                        }
+                        fields.push_back(field->s);
+                    }
+                    std::shared_ptr<RecordType> type = std::make_shared<RecordType>(type_name->s, fields);
+
+                    vector<Expr> defs;
+                    auto ctor_name = dynamic_cast<SymbolSyntax*>(ctor_spec->stxs[0].get());
+                    if (!ctor_name) {
+                        throw RuntimeError("define-record-type: constructor name must be a symbol");
+                    }
+                    vector<size_t> slot_of_arg;
+                    for (size_t i = 1; i < ctor_spec->stxs.size(); i++) {
+                        auto arg = dynamic_cast<SymbolSyntax*>(ctor_spec->stxs[i].get());
+                        if (!arg) {
+                            throw RuntimeError("define-record-type: constructor field must be a symbol");
+                        }
+                        size_t slot = 0;
+                        while (slot < fields.size() && fields[slot] != arg->s) slot++;
+                        if (slot == fields.size()) {
+                            throw RuntimeError("define-record-type: unknown field " + arg->s);
+                        }
+                        slot_of_arg.push_back(slot);
+                    }
+                    defs.push_back(Expr(new Define(ctor_name->s,
+                        Expr(new Lambda({}, Expr(new RecordConstructor(type, slot_of_arg)))))));
+                    defs.push_back(Expr(new Define(pred_name->s,
+                        Expr(new Lambda({}, Expr(new RecordPredicate(type)))))));
+
+                    for (size_t i = 4; i < stxs.size(); i++) {
+                        auto field_spec = dynamic_cast<List*>(stxs[i].get());
+                        size_t slot = i - 4;
+                        auto accessor = dynamic_cast<SymbolSyntax*>(field_spec->stxs[1].get());
+                        if (!accessor) {
+                            throw RuntimeError("define-record-type: accessor must be a symbol");
+                        }
+                        defs.push_back(Expr(new Define(accessor->s,
+                            Expr(new Lambda({}, Expr(new RecordAccessor(type, slot)))))));
+                        if (field_spec->stxs.size() == 3) {
+                            auto modifier = dynamic_cast<SymbolSyntax*>(field_spec->stxs[2].get());
+                            if (!modifier) {
+                                throw RuntimeError("define-record-type: modifier must be a symbol");
+                            }
+                            defs.push_back(Expr(new Define(modifier->s,
+                                Expr(new Lambda({}, Expr(new RecordModifier(type, slot)))))));
+                        }
+                    }
+                    return Expr(new Begin(defs));
+                }
                 case E_BEGIN:{
                     vector<Expr> exprs;
                     for(int i=1;i<stxs.size();i++)
@@ -481,7 +982,12 @@ Expr List::parse(Assoc &env) {
                     2.用新环境解析绑定表达式
                     3.在新环境中执行各语句
                 */
-                case E_LET:{
+                /*
+                parallel-let 的语法和 let 完全一样, 只是绑定表达式并行求值
+                */
+                case E_LET:
+                case E_PARALLEL_LET:{
+                    bool parallel = reserved_words.at(op) == E_PARALLEL_LET;
                     if(stxs.size() < 3) {
                         throw RuntimeError("Wrong number of arguments for let");
                     }
@@ -520,9 +1026,13 @@ Expr List::parse(Assoc &env) {
                         for(size_t i = 2; i < stxs.size(); i++) {
                             body_exprs.push_back(stxs[i]->parse(new_env));
                         }
-                        return Expr(new Let(let_bindings, Expr(new Begin(body_exprs))));
+                        Expr body = Expr(new Begin(body_exprs));
+                        if (parallel) return Expr(new ParallelLet(let_bindings, body));
+                        return Expr(new Let(let_bindings, body));
                     } else {
-                        return Expr(new Let(let_bindings, stxs[2]->parse(new_env)));
+                        Expr body = stxs[2]->parse(new_env);
+                        if (parallel) return Expr(new ParallelLet(let_bindings, body));
+                        return Expr(new Let(let_bindings, body));
                     }
                 }
 
@@ -582,6 +1092,34 @@ Expr List::parse(Assoc &env) {
                         }
                         return Expr(new Set(name->s, stxs[2]->parse(env)));
                 }
+                /*
+                delay / delay-force 只是把表达式和当前环境包成 promise, 不求值
+                cons-stream 相当于 (cons a (delay b))
+                */
+                case E_DELAY:{
+                    if (stxs.size() != 2) {
+                        throw RuntimeError("Wrong number of arguments for delay");
+                    }
+                    return Expr(new Delay(stxs[1]->parse(env)));
+                }
+                case E_DELAY_FORCE:{
+                    if (stxs.size() != 2) {
+                        throw RuntimeError("Wrong number of arguments for delay-force");
+                    }
+                    return Expr(new DelayForce(stxs[1]->parse(env)));
+                }
+                case E_CONS_STREAM:{
+                    if (stxs.size() != 3) {
+                        throw RuntimeError("Wrong number of arguments for cons-stream");
+                    }
+                    return Expr(new ConsStream(stxs[1]->parse(env), stxs[2]->parse(env)));
+                }
+                case E_FUTURE:{
+                    if (stxs.size() != 2) {
+                        throw RuntimeError("Wrong number of arguments for future");
+                    }
+                    return Expr(new FutureExpr(stxs[1]->parse(env)));
+                }
                 default:
                     throw RuntimeError("Unknown reserved word: " + op);
             }
@@ -0,0 +1,377 @@
+/**
+ * @file persistent.cpp
+ * @brief Implementation of the persistent hash map and vector
+ */
+
+#include "persistent.hpp"
+#include <cstring>
+
+// ============================================================================
+// Key hashing and equality
+// ============================================================================
+
+static uint32_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+static uint32_t hashBytes(const char *p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t hashKey(const Value &v) {
+    switch (v->v_type) {
+        case V_INT:
+            return mix((uint64_t)(int64_t)static_cast<Integer*>(v.get())->n);
+        case V_RATIONAL: {
+            Rational *r = static_cast<Rational*>(v.get());
+            return mix(((uint64_t)(uint32_t)r->numerator << 32) | (uint32_t)r->denominator);
+        }
+        case V_BOOL:
+            return static_cast<Boolean*>(v.get())->b ? 1231 : 1237;
+        case V_SYM: {
+            const std::string &s = static_cast<Symbol*>(v.get())->s;
+            return hashBytes(s.data(), s.size()) ^ 0x5bd1e995u;
+        }
+        case V_STRING: {
+            String *s = static_cast<String*>(v.get());
+            return hashBytes(s->data(), s->size());
+        }
+        case V_NULL:
+            return 1;
+        case V_VOID:
+            return 2;
+        default:
+            return mix((uint64_t)(uintptr_t)v.get());
+    }
+}
+
+bool keyEqual(const Value &a, const Value &b) {
+    if (a.get() == b.get()) return true;
+    if (a->v_type != b->v_type) return false;
+    switch (a->v_type) {
+        case V_INT:
+            return static_cast<Integer*>(a.get())->n == static_cast<Integer*>(b.get())->n;
+        case V_RATIONAL: {
+            Rational *r1 = static_cast<Rational*>(a.get());
+            Rational *r2 = static_cast<Rational*>(b.get());
+            return r1->numerator == r2->numerator && r1->denominator == r2->denominator;
+        }
+        case V_BOOL:
+            return static_cast<Boolean*>(a.get())->b == static_cast<Boolean*>(b.get())->b;
+        case V_SYM:
+            return static_cast<Symbol*>(a.get())->s == static_cast<Symbol*>(b.get())->s;
+        case V_STRING: {
+            String *s1 = static_cast<String*>(a.get());
+            String *s2 = static_cast<String*>(b.get());
+            return s1->size() == s2->size() && memcmp(s1->data(), s2->data(), s1->size()) == 0;
+        }
+        case V_NULL:
+        case V_VOID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// ============================================================================
+// Persistent hash map
+// ============================================================================
+
+static const unsigned HASH_BITS = 32;
+static const unsigned LEVEL_BITS = 5;
+
+HamtNode::HamtNode() : datamap(0), nodemap(0) {}
+
+static uint32_t bitpos(uint32_t hash, unsigned shift) {
+    return 1u << ((hash >> shift) & 31);
+}
+
+static unsigned bitIndex(uint32_t bitmap, uint32_t bit) {
+    return __builtin_popcount(bitmap & (bit - 1));
+}
+
+static HamtRef mergeTwo(const Value &k1, const Value &v1, uint32_t h1,
+                        const Value &k2, const Value &v2, uint32_t h2, unsigned shift) {
+    std::shared_ptr<HamtNode> node = std::make_shared<HamtNode>();
+    if (shift >= HASH_BITS) {
+        // 哈希用完了, 退化成冲突链表
+        node->entries.push_back(std::make_pair(k1, v1));
+        node->entries.push_back(std::make_pair(k2, v2));
+        return node;
+    }
+    uint32_t b1 = bitpos(h1, shift), b2 = bitpos(h2, shift);
+    if (b1 != b2) {
+        node->datamap = b1 | b2;
+        if (b1 < b2) {
+            node->entries.push_back(std::make_pair(k1, v1));
+            node->entries.push_back(std::make_pair(k2, v2));
+        } else {
+            node->entries.push_back(std::make_pair(k2, v2));
+            node->entries.push_back(std::make_pair(k1, v1));
+        }
+    } else {
+        node->nodemap = b1;
+        node->children.push_back(mergeTwo(k1, v1, h1, k2, v2, h2, shift + LEVEL_BITS));
+    }
+    return node;
+}
+
+static Value hamtFind(const HamtNode *node, const Value &key, uint32_t hash, unsigned shift) {
+    while (true) {
+        if (shift >= HASH_BITS) {
+            for (auto &e : node->entries)
+                if (keyEqual(e.first, key)) return e.second;
+            return Value(nullptr);
+        }
+        uint32_t bit = bitpos(hash, shift);
+        if (node->datamap & bit) {
+            const std::pair<Value, Value> &e = node->entries[bitIndex(node->datamap, bit)];
+            return keyEqual(e.first, key) ? e.second : Value(nullptr);
+        }
+        if (!(node->nodemap & bit)) return Value(nullptr);
+        node = node->children[bitIndex(node->nodemap, bit)].get();
+        shift += LEVEL_BITS;
+    }
+}
+
+static HamtRef hamtInsert(const HamtRef &node, const Value &key, const Value &val,
+                          uint32_t hash, unsigned shift, bool &added) {
+    if (shift >= HASH_BITS) {
+        std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+        for (auto &e : copy->entries) {
+            if (keyEqual(e.first, key)) {
+                e.second = val;
+                return copy;
+            }
+        }
+        copy->entries.push_back(std::make_pair(key, val));
+        added = true;
+        return copy;
+    }
+    uint32_t bit = bitpos(hash, shift);
+    if (node->datamap & bit) {
+        unsigned i = bitIndex(node->datamap, bit);
+        const std::pair<Value, Value> &e = node->entries[i];
+        std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+        if (keyEqual(e.first, key)) {
+            copy->entries[i].second = val;
+            return copy;
+        }
+        // 同一位置已经有别的键, 两个键一起下沉到新的子节点
+        HamtRef sub = mergeTwo(e.first, e.second, hashKey(e.first), key, val, hash, shift + LEVEL_BITS);
+        copy->entries.erase(copy->entries.begin() + i);
+        copy->datamap ^= bit;
+        copy->nodemap |= bit;
+        copy->children.insert(copy->children.begin() + bitIndex(copy->nodemap, bit), sub);
+        added = true;
+        return copy;
+    }
+    if (node->nodemap & bit) {
+        unsigned j = bitIndex(node->nodemap, bit);
+        HamtRef child = hamtInsert(node->children[j], key, val, hash, shift + LEVEL_BITS, added);
+        std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+        copy->children[j] = child;
+        return copy;
+    }
+    std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+    copy->datamap |= bit;
+    copy->entries.insert(copy->entries.begin() + bitIndex(copy->datamap, bit), std::make_pair(key, val));
+    added = true;
+    return copy;
+}
+
+static HamtRef hamtRemove(const HamtRef &node, const Value &key,
+                          uint32_t hash, unsigned shift, bool &removed) {
+    if (shift >= HASH_BITS) {
+        for (size_t i = 0; i < node->entries.size(); i++) {
+            if (keyEqual(node->entries[i].first, key)) {
+                std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+                copy->entries.erase(copy->entries.begin() + i);
+                removed = true;
+                return copy;
+            }
+        }
+        return node;
+    }
+    uint32_t bit = bitpos(hash, shift);
+    if (node->datamap & bit) {
+        unsigned i = bitIndex(node->datamap, bit);
+        if (!keyEqual(node->entries[i].first, key)) return node;
+        std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+        copy->entries.erase(copy->entries.begin() + i);
+        copy->datamap ^= bit;
+        removed = true;
+        return copy;
+    }
+    if (node->nodemap & bit) {
+        unsigned j = bitIndex(node->nodemap, bit);
+        HamtRef child = hamtRemove(node->children[j], key, hash, shift + LEVEL_BITS, removed);
+        if (!removed) return node;
+        std::shared_ptr<HamtNode> copy = std::make_shared<HamtNode>(*node);
+        if (child->children.empty() && child->entries.size() == 1) {
+            // 子节点只剩一个键, 把它提回当前层, 保持 "子节点至少两个键" 的不变式
+            copy->children.erase(copy->children.begin() + j);
+            copy->nodemap ^= bit;
+            copy->datamap |= bit;
+            copy->entries.insert(copy->entries.begin() + bitIndex(copy->datamap, bit), child->entries[0]);
+        } else {
+            copy->children[j] = child;
+        }
+        return copy;
+    }
+    return node;
+}
+
+static void hamtEntries(const HamtNode *node, std::vector<std::pair<Value, Value>> &out) {
+    for (auto &e : node->entries) out.push_back(e);
+    for (auto &c : node->children) hamtEntries(c.get(), out);
+}
+
+PMap::PMap(const HamtRef &root, size_t count) : ValueBase(V_PMAP), root(root), count(count) {}
+
+void PMap::show(std::ostream &os) {
+    os << "#<pmap>";
+}
+
+Value PMapV(const HamtRef &root, size_t count) {
+    return Value(new PMap(root ? root : std::make_shared<HamtNode>(), count));
+}
+
+Value pmapFind(const PMap *m, const Value &key) {
+    return hamtFind(m->root.get(), key, hashKey(key), 0);
+}
+
+Value pmapSet(const PMap *m, const Value &key, const Value &val) {
+    bool added = false;
+    HamtRef root = hamtInsert(m->root, key, val, hashKey(key), 0, added);
+    return PMapV(root, m->count + (added ? 1 : 0));
+}
+
+Value pmapRemove(const PMap *m, const Value &key) {
+    bool removed = false;
+    HamtRef root = hamtRemove(m->root, key, hashKey(key), 0, removed);
+    return PMapV(root, m->count - (removed ? 1 : 0));
+}
+
+void pmapEntries(const PMap *m, std::vector<std::pair<Value, Value>> &out) {
+    hamtEntries(m->root.get(), out);
+}
+
+// ============================================================================
+// Persistent vector
+// ============================================================================
+
+static const size_t WIDTH = 32;
+static const size_t MASK = WIDTH - 1;
+
+PVector::PVector(size_t cnt, unsigned shift, const PVecRef &root, const PVecRef &tail)
+    : ValueBase(V_PVECTOR), cnt(cnt), shift(shift), root(root), tail(tail) {}
+
+void PVector::show(std::ostream &os) {
+    os << "#<pvector>";
+}
+
+static size_t tailOffset(const PVector *v) {
+    return v->cnt < WIDTH ? 0 : ((v->cnt - 1) / WIDTH) * WIDTH;
+}
+
+// 第 i 个元素所在的叶子
+static const PVecNode *leafFor(const PVector *v, size_t i) {
+    if (i >= tailOffset(v)) return v->tail.get();
+    const PVecNode *node = v->root.get();
+    for (unsigned level = v->shift; level > 0; level -= LEVEL_BITS)
+        node = node->kids[(i >> level) & MASK].get();
+    return node;
+}
+
+static PVecRef newPath(unsigned level, const PVecRef &node) {
+    if (level == 0) return node;
+    std::shared_ptr<PVecNode> ret = std::make_shared<PVecNode>();
+    ret->kids.push_back(newPath(level - LEVEL_BITS, node));
+    return ret;
+}
+
+static PVecRef pushTail(const PVector *v, unsigned level, const PVecRef &parent, const PVecRef &tailnode) {
+    size_t subidx = ((v->cnt - 1) >> level) & MASK;
+    std::shared_ptr<PVecNode> ret = std::make_shared<PVecNode>(*parent);
+    PVecRef insert(nullptr);
+    if (level == LEVEL_BITS) {
+        insert = tailnode;
+    } else if (subidx < parent->kids.size()) {
+        insert = pushTail(v, level - LEVEL_BITS, parent->kids[subidx], tailnode);
+    } else {
+        insert = newPath(level - LEVEL_BITS, tailnode);
+    }
+    if (subidx < ret->kids.size()) ret->kids[subidx] = insert;
+    else ret->kids.push_back(insert);
+    return ret;
+}
+
+static PVecRef doAssoc(unsigned level, const PVecRef &node, size_t i, const Value &val) {
+    std::shared_ptr<PVecNode> ret = std::make_shared<PVecNode>(*node);
+    if (level == 0) {
+        ret->vals[i & MASK] = val;
+    } else {
+        size_t subidx = (i >> level) & MASK;
+        ret->kids[subidx] = doAssoc(level - LEVEL_BITS, node->kids[subidx], i, val);
+    }
+    return ret;
+}
+
+Value pvectorRef(const PVector *v, size_t i) {
+    return leafFor(v, i)->vals[i & MASK];
+}
+
+Value pvectorSet(const PVector *v, size_t i, const Value &val) {
+    if (i >= tailOffset(v)) {
+        std::shared_ptr<PVecNode> tail = std::make_shared<PVecNode>(*v->tail);
+        tail->vals[i & MASK] = val;
+        return Value(new PVector(v->cnt, v->shift, v->root, tail));
+    }
+    return Value(new PVector(v->cnt, v->shift, doAssoc(v->shift, v->root, i, val), v->tail));
+}
+
+Value pvectorPush(const PVector *v, const Value &val) {
+    if (v->cnt - tailOffset(v) < WIDTH) {
+        std::shared_ptr<PVecNode> tail = std::make_shared<PVecNode>(*v->tail);
+        tail->vals.push_back(val);
+        return Value(new PVector(v->cnt + 1, v->shift, v->root, tail));
+    }
+    // tail 满了, 把它挂进树里; 根也满了就长高一层
+    PVecRef root(nullptr);
+    unsigned shift = v->shift;
+    if ((v->cnt >> LEVEL_BITS) > ((size_t)1 << v->shift)) {
+        std::shared_ptr<PVecNode> grown = std::make_shared<PVecNode>();
+        grown->kids.push_back(v->root);
+        grown->kids.push_back(newPath(v->shift, v->tail));
+        root = grown;
+        shift += LEVEL_BITS;
+    } else {
+        root = pushTail(v, v->shift, v->root, v->tail);
+    }
+    std::shared_ptr<PVecNode> tail = std::make_shared<PVecNode>();
+    tail->vals.push_back(val);
+    return Value(new PVector(v->cnt + 1, shift, root, tail));
+}
+
+void pvectorElems(const PVector *v, std::vector<Value> &out) {
+    for (size_t i = 0; i < v->cnt; i += WIDTH) {
+        const PVecNode *leaf = leafFor(v, i);
+        out.insert(out.end(), leaf->vals.begin(), leaf->vals.end());
+    }
+}
+
+Value PVectorV(const std::vector<Value> &elems) {
+    Value v(new PVector(0, LEVEL_BITS, std::make_shared<PVecNode>(), std::make_shared<PVecNode>()));
+    for (auto &e : elems)
+        v = pvectorPush(static_cast<PVector*>(v.get()), e);
+    return v;
+}
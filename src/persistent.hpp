@@ -0,0 +1,102 @@
+#ifndef PERSISTENT
+#define PERSISTENT
+
+/**
+ * @file persistent.hpp
+ * @brief Persistent (immutable) map and vector with structural sharing
+ *
+ * PMap is a hash array mapped trie (CHAMP layout: inline entries and child
+ * nodes are tracked by two separate 32-bit bitmaps). PVector is a 32-way
+ * trie with a tail buffer, in the style of Clojure's vectors. Every update
+ * copies only the O(log32 n) nodes on the path to the change and shares
+ * everything else with the old version.
+ */
+
+#include "value.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// ============================================================================
+// Key hashing and equality
+// ============================================================================
+
+/**
+ * @brief Hash of a map key
+ * Numbers, booleans, symbols and strings hash by content; every other
+ * value hashes by identity, matching eq?.
+ */
+uint32_t hashKey(const Value &);
+
+/**
+ * @brief Key equality used by PMap (eq? plus content equality for strings and rationals)
+ */
+bool keyEqual(const Value &, const Value &);
+
+// ============================================================================
+// Persistent hash map
+// ============================================================================
+
+struct HamtNode;
+typedef std::shared_ptr<const HamtNode> HamtRef;
+
+/**
+ * @brief Immutable trie node
+ * Below the last hash level a node degenerates into a collision list that
+ * only uses entries.
+ */
+struct HamtNode {
+    uint32_t datamap;                             ///< Positions stored inline
+    uint32_t nodemap;                             ///< Positions stored in children
+    std::vector<std::pair<Value, Value>> entries; ///< Inline (key, value) pairs
+    std::vector<HamtRef> children;                ///< Sub-tries
+    HamtNode();
+};
+
+struct PMap : ValueBase {
+    HamtRef root;
+    size_t count;
+    PMap(const HamtRef &, size_t);
+    virtual void show(std::ostream &) override;
+};
+Value PMapV(const HamtRef &, size_t);
+
+/**
+ * @brief Looks up key, returning Value(nullptr) when absent
+ */
+Value pmapFind(const PMap *, const Value &);
+Value pmapSet(const PMap *, const Value &, const Value &);
+Value pmapRemove(const PMap *, const Value &);
+void pmapEntries(const PMap *, std::vector<std::pair<Value, Value>> &);
+
+// ============================================================================
+// Persistent vector
+// ============================================================================
+
+struct PVecNode;
+typedef std::shared_ptr<const PVecNode> PVecRef;
+
+/**
+ * @brief Immutable trie node; leaves use vals, inner nodes use kids
+ */
+struct PVecNode {
+    std::vector<Value> vals;
+    std::vector<PVecRef> kids;
+};
+
+struct PVector : ValueBase {
+    size_t cnt;       ///< Number of elements
+    unsigned shift;   ///< Bits consumed by the root level
+    PVecRef root;     ///< Trie holding all elements before the tail
+    PVecRef tail;     ///< Last (up to 32) elements
+    PVector(size_t, unsigned, const PVecRef &, const PVecRef &);
+    virtual void show(std::ostream &) override;
+};
+Value PVectorV(const std::vector<Value> &);
+
+Value pvectorRef(const PVector *, size_t);
+Value pvectorSet(const PVector *, size_t, const Value &);
+Value pvectorPush(const PVector *, const Value &);
+void pvectorElems(const PVector *, std::vector<Value> &);
+
+#endif // PERSISTENT
@@ -0,0 +1,99 @@
+/**
+ * @file port.cpp
+ * @brief Buffered file descriptor output and output port state
+ */
+
+#include "port.hpp"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+FdBuf::FdBuf(int fd, bool owned, size_t size) : fd(fd), owned(owned), buf(size) {}
+
+FdBuf::~FdBuf() {
+    close();
+}
+
+bool FdBuf::close() {
+    std::lock_guard<std::mutex> lk(m);
+    if (fd < 0) return true;
+    bool ok = drain();
+    if (owned && ::close(fd) != 0) ok = false;
+    fd = -1;
+    return ok;
+}
+
+bool FdBuf::writeAll(const char *p, size_t n) {
+    if (fd < 0) return n == 0;
+    while (n > 0) {
+        ssize_t k = ::write(fd, p, n);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return true;
+}
+
+// 缓冲区里的内容写出去; 写失败也清空, 免得下次再写同一段
+bool FdBuf::drain() {
+    bool ok = writeAll(buf.data(), used);
+    used = 0;
+    return ok;
+}
+
+// 没有 put area, 单个字符也走到这里, 在锁里进缓冲区
+FdBuf::int_type FdBuf::overflow(int_type c) {
+    std::lock_guard<std::mutex> lk(m);
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return drain() ? traits_type::not_eof(c) : traits_type::eof();
+    if (used == buf.size() && !drain()) return traits_type::eof();
+    buf[used++] = traits_type::to_char_type(c);
+    written++;
+    return c;
+}
+
+std::streamsize FdBuf::xsputn(const char *s, std::streamsize n) {
+    std::lock_guard<std::mutex> lk(m);
+    size_t len = (size_t)n;
+    if (len > buf.size() - used) {
+        // 放不下: 先把缓冲区写掉, 比缓冲区还长的直接写, 不再拷一遍
+        if (!drain()) return 0;
+        if (len >= buf.size()) {
+            if (!writeAll(s, len)) return 0;
+            written += len;
+            return n;
+        }
+    }
+    memcpy(buf.data() + used, s, len);
+    used += len;
+    written += len;
+    return n;
+}
+
+int FdBuf::sync() {
+    std::lock_guard<std::mutex> lk(m);
+    return drain() ? 0 : -1;
+}
+
+// 只支持 tellp: 当前位置就是一共写了多少字节
+FdBuf::pos_type FdBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out))
+        return pos_type(off_type(-1));
+    std::lock_guard<std::mutex> lk(m);
+    return pos_type((off_type)written);
+}
+
+PortState::PortState(std::unique_ptr<std::streambuf> b, bool s)
+    : buf(std::move(b)), os(buf.get()), string_port(s) {}
+
+void displayValue(std::ostream &os, const Value &v) {
+    if (v->v_type == V_STRING) {
+        String *str = static_cast<String*>(v.get());
+        os.write(str->data(), str->size());
+    } else {
+        v->show(os);
+    }
+}
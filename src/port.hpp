@@ -0,0 +1,88 @@
+#ifndef PORT
+#define PORT
+
+/**
+ * @file port.hpp
+ * @brief Output ports: buffered file descriptors and string ports
+ *
+ * An output port value (open-output-file, open-output-string) owns a
+ * std::ostream over its own buffer. display, write, write-string and
+ * newline write to current_output, or to the port given as their last
+ * argument. with-output-to-string points current_output at a string for
+ * the duration of a thunk.
+ *
+ * FdBuf is also what the code executable puts under standard output: a
+ * large buffer written out when full, after each top-level form that
+ * printed something, and when the REPL is about to wait for input (see
+ * Reader::flushBeforeWait), instead of on every display.
+ */
+
+#include "value.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+/**
+ * @brief Stream buffer writing to a file descriptor in large blocks
+ * Writes longer than the buffer go straight to the descriptor. Futures,
+ * isolates and remote calls write to standard output from other threads,
+ * so every operation takes a lock, as std::cout synchronized with stdio
+ * does; there is no put area for std::streambuf to fill behind it.
+ * tellp() gives the number of bytes written so far.
+ */
+class FdBuf : public std::streambuf {
+public:
+    static const size_t BUFFER_SIZE = 1 << 16;
+
+    /** @param owned close fd when closed or destroyed */
+    explicit FdBuf(int fd, bool owned = false, size_t size = BUFFER_SIZE);
+    ~FdBuf() override;
+    FdBuf(const FdBuf &) = delete;
+    FdBuf &operator=(const FdBuf &) = delete;
+
+    /**
+     * @brief Writes out the buffer and closes the descriptor if owned
+     * Later writes fail.
+     * @return false if something could not be written or closed
+     */
+    bool close();
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+    int sync() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+
+private:
+    std::mutex m;
+    int fd;
+    bool owned;
+    std::vector<char> buf;
+    size_t used = 0;       ///< Bytes of buf waiting to be written
+    uint64_t written = 0;  ///< Bytes accepted since the start
+
+    bool drain();                              ///< Caller holds m
+    bool writeAll(const char *p, size_t n);    ///< Caller holds m
+};
+
+/**
+ * @brief What an output port value holds
+ */
+struct PortState {
+    std::unique_ptr<std::streambuf> buf;
+    std::ostream os;
+    bool string_port;      ///< buf is a std::stringbuf
+    bool closed = false;
+
+    PortState(std::unique_ptr<std::streambuf> buf, bool string_port);
+};
+
+/**
+ * @brief Writes v as display does: strings without quotes, the rest as printed
+ */
+void displayValue(std::ostream &os, const Value &v);
+
+#endif // PORT
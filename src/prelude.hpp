@@ -0,0 +1,19 @@
+#ifndef PRELUDE
+#define PRELUDE
+
+/**
+ * @file prelude.hpp
+ * @brief The standard prelude, compiled into code at build time
+ *
+ * lib/prelude.scm is evaluated by tools/mkprelude while code is built, and
+ * its definitions are embedded as a heap image (see image.hpp) in a
+ * generated source file. Decoding it binds every definition without
+ * parsing anything; bodies are parsed on their first call.
+ */
+
+#include <cstddef>
+
+extern const unsigned char prelude_image[];
+extern const size_t prelude_image_size;
+
+#endif // PRELUDE
@@ -0,0 +1,346 @@
+/**
+ * @file purity.cpp
+ * @brief Effect analysis, call site profiling and parallel argument evaluation
+ */
+
+#include "purity.hpp"
+#include "RE.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+
+bool parallel_args = false;
+
+// 只有费时超过这个值 (纳秒) 的实参才值得交给别的线程
+static const uint64_t PAR_ARG_MIN_NS = 20000;
+// 顺序求值时每隔多少次对实参计一次时
+static const unsigned PROFILE_SAMPLE_RATE = 16;
+// 分析时最多嵌套这么多层过程, 再深就当作有副作用
+static const size_t PURITY_MAX_DEPTH = 64;
+
+// Procedure::purity 的低两位是状态, 高位是算出结果时的 epoch
+enum { PURITY_UNKNOWN = 0, PURITY_PURE = 2, PURITY_IMPURE = 3 };
+static std::atomic<uint32_t> purity_epoch(1);
+
+void bumpPurityEpoch() {
+    purity_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ============================================================================
+// CallSiteProfile
+// ============================================================================
+
+CallSiteProfile::CallSiteProfile() : costs(nullptr) {}
+
+CallSiteProfile::~CallSiteProfile() {
+    delete[] costs.load();
+}
+
+std::atomic<uint64_t> *CallSiteProfile::get(size_t nargs) {
+    std::atomic<uint64_t> *p = costs.load(std::memory_order_acquire);
+    if (p) return p;
+    std::atomic<uint64_t> *fresh = new std::atomic<uint64_t>[nargs];
+    for (size_t i = 0; i < nargs; i++) fresh[i].store(0, std::memory_order_relaxed);
+    if (costs.compare_exchange_strong(p, fresh, std::memory_order_acq_rel)) return fresh;
+    delete[] fresh;  // 别的线程先装好了
+    return p;
+}
+
+// ============================================================================
+// Effect analysis
+// ============================================================================
+
+/*
+会修改状态、做 I/O、或者会回调任意过程的原语都算有副作用
+force/stream-cdr 会执行 promise 里的任意代码, 排序和 p 系列会调用传进来的过程
+绿色线程的操作会切换任务; native 过程里是什么 C++ 代码都可能有, 也算不纯
+*/
+static bool pureOperator(ExprType t) {
+    switch (t) {
+        case E_SETCAR: case E_SETCDR: case E_VECTOR_SET:
+        case E_STRING_BUILDER_APPEND: case E_RECORD_SET:
+        case E_DISPLAY: case E_WRITE: case E_WRITE_STRING: case E_NEWLINE: case E_FLUSH_OUTPUT:
+        case E_OPEN_OUTPUT_FILE: case E_OPEN_OUTPUT_STRING: case E_GET_OUTPUT_STRING:
+        case E_CLOSE_OUTPUT_PORT: case E_WITH_OUTPUT_TO_STRING:
+        case E_EXIT:
+        case E_FORCE: case E_STREAM_CDR: case E_TOUCH:
+        case E_PAR_MAP: case E_PAR_FOR_EACH: case E_PAR_REDUCE: case E_PAR_SORT:
+        case E_SORT: case E_VECTOR_SORT:
+        case E_SPAWN: case E_YIELD: case E_TASK_JOIN: case E_MAKE_CHANNEL:
+        case E_CHANNEL_SEND: case E_CHANNEL_RECV: case E_FD_WAIT: case E_FD_READ:
+        case E_SPAWN_ISOLATE: case E_ISOLATE_SEND: case E_ISOLATE_RECEIVE:
+        case E_ISOLATE_JOIN: case E_ISOLATE_PARENT:
+        case E_REMOTE_APPLY: case E_REMOTE_MAP: case E_SAVE_IMAGE: case E_LOAD:
+        case E_NATIVE: case E_LOAD_EXTENSION:
+            return false;
+        default:
+            return true;
+    }
+}
+
+namespace {
+
+/*
+分析递归过程时, 正在分析的过程先乐观地当作纯的
+lowest_assumed 记录用到了栈里哪一层的假设: 只有当假设都落在自己这一层以内时,
+"纯" 这个结论才能写进缓存; "不纯" 总是可以直接缓存
+*/
+struct PurityAnalysis {
+    std::vector<Procedure*> stack;
+    size_t lowest_assumed = SIZE_MAX;
+};
+
+thread_local PurityAnalysis analysis;
+
+bool isBound(const std::vector<std::string> &bound, const std::string &x) {
+    for (auto it = bound.rbegin(); it != bound.rend(); ++it)
+        if (*it == x) return true;
+    return false;
+}
+
+bool pureExpr(ExprBase *e, const Assoc &env, std::vector<std::string> &bound);
+
+bool pureAll(const std::vector<Expr> &es, const Assoc &env, std::vector<std::string> &bound) {
+    for (auto &x : es)
+        if (!pureExpr(x.get(), env, bound)) return false;
+    return true;
+}
+
+bool pureOperatorExpr(ExprBase *rator, const Assoc &env, std::vector<std::string> &bound) {
+    if (rator->e_type == E_VAR) {
+        const std::string &x = static_cast<Var*>(rator)->x;
+        if (isBound(bound, x)) return false;   // 形参之类, 运行时才知道是什么
+        Assoc scope = env;
+        Value v = find(x, scope);
+        if (v.get() == nullptr) {
+            auto it = primitives.find(x);
+            return it != primitives.end() && pureOperator(it->second);
+        }
+        return v->v_type == V_PROC && isPureProcedure(static_cast<Procedure*>(v.get()));
+    }
+    if (rator->e_type == E_LAMBDA) {
+        Lambda *lam = static_cast<Lambda*>(rator);
+        size_t mark = bound.size();
+        bound.insert(bound.end(), lam->x.begin(), lam->x.end());
+        bool ok = pureExpr(lam->e.get(), env, bound);
+        bound.resize(mark);
+        return ok;
+    }
+    return false;
+}
+
+bool pureExpr(ExprBase *e, const Assoc &env, std::vector<std::string> &bound) {
+    switch (e->e_type) {
+        case E_FIXNUM: case E_RATIONAL: case E_STRING: case E_TRUE: case E_FALSE:
+        case E_VOID: case E_QUOTE: case E_VAR: case E_LAMBDA:
+            return true;
+        case E_AND:
+            return pureAll(static_cast<AndVar*>(e)->rands, env, bound);
+        case E_OR:
+            return pureAll(static_cast<OrVar*>(e)->rands, env, bound);
+        case E_BEGIN:
+            return pureAll(static_cast<Begin*>(e)->es, env, bound);
+        case E_IF: {
+            If *x = static_cast<If*>(e);
+            return pureExpr(x->cond.get(), env, bound) && pureExpr(x->conseq.get(), env, bound) &&
+                   pureExpr(x->alter.get(), env, bound);
+        }
+        case E_COND:
+            for (auto &clause : static_cast<Cond*>(e)->clauses)
+                if (!pureAll(clause, env, bound)) return false;
+            return true;
+        case E_LET:
+        case E_LETREC: {
+            bool rec = e->e_type == E_LETREC;
+            auto &bind = rec ? static_cast<Letrec*>(e)->bind : static_cast<Let*>(e)->bind;
+            Expr &body = rec ? static_cast<Letrec*>(e)->body : static_cast<Let*>(e)->body;
+            size_t mark = bound.size();
+            if (rec)
+                for (auto &b : bind) bound.push_back(b.first);
+            for (auto &b : bind)
+                if (!pureExpr(b.second.get(), env, bound)) {
+                    bound.resize(mark);
+                    return false;
+                }
+            if (!rec)
+                for (auto &b : bind) bound.push_back(b.first);
+            bool ok = pureExpr(body.get(), env, bound);
+            bound.resize(mark);
+            return ok;
+        }
+        case E_APPLY: {
+            Apply *x = static_cast<Apply*>(e);
+            return pureOperatorExpr(x->rator.get(), env, bound) && pureAll(x->rand, env, bound);
+        }
+        case E_LAZY_BODY: {
+            // 分析的都是要调用的过程, 提前解析不算浪费; 解析不了就当不纯
+            ExprBase *body;
+            try {
+                body = static_cast<LazyBody*>(e)->force();
+            } catch (const RuntimeError &) {
+                return false;
+            }
+            return pureExpr(body, env, bound);
+        }
+        default:
+            break;
+    }
+    if (!pureOperator(e->e_type)) return false;
+    if (Unary *u = dynamic_cast<Unary*>(e))
+        return pureExpr(u->rand.get(), env, bound);
+    if (Binary *b = dynamic_cast<Binary*>(e))
+        return pureExpr(b->rand1.get(), env, bound) && pureExpr(b->rand2.get(), env, bound);
+    if (Variadic *v = dynamic_cast<Variadic*>(e))
+        return pureAll(v->rands, env, bound);
+    // define, set!, delay, future 等其余结构一律保守处理
+    return false;
+}
+
+} // namespace
+
+bool isPureExpr(const Expr &e, const Assoc &env) {
+    std::vector<std::string> bound;
+    return pureExpr(e.get(), env, bound);
+}
+
+bool isPureProcedure(Procedure *proc) {
+    uint32_t epoch = purity_epoch.load(std::memory_order_relaxed) & 0x3fffffff;
+    uint32_t cached = proc->purity.load(std::memory_order_relaxed);
+    if ((cached >> 2) == epoch && (cached & 3) != PURITY_UNKNOWN)
+        return (cached & 3) == PURITY_PURE;
+
+    std::vector<Procedure*> &stack = analysis.stack;
+    for (size_t i = 0; i < stack.size(); i++)
+        if (stack[i] == proc) {
+            analysis.lowest_assumed = std::min(analysis.lowest_assumed, i);
+            return true;
+        }
+    if (stack.size() >= PURITY_MAX_DEPTH) return false;
+
+    size_t level = stack.size();
+    stack.push_back(proc);
+    std::vector<std::string> bound(proc->parameters);
+    bool pure = pureExpr(proc->e.get(), proc->env, bound);
+    stack.pop_back();
+    if (analysis.lowest_assumed >= level) {
+        analysis.lowest_assumed = SIZE_MAX;
+        proc->purity.store(epoch << 2 | (pure ? PURITY_PURE : PURITY_IMPURE), std::memory_order_relaxed);
+    } else if (!pure) {
+        proc->purity.store(epoch << 2 | PURITY_IMPURE, std::memory_order_relaxed);
+    }
+    return pure;
+}
+
+// ============================================================================
+// Parallel argument evaluation
+// ============================================================================
+
+// 字面量、变量这类实参不可能费时, 不用计时
+bool isTrivialExpr(const Expr &e) {
+    switch (e->e_type) {
+        case E_FIXNUM: case E_RATIONAL: case E_STRING: case E_TRUE: case E_FALSE:
+        case E_VOID: case E_QUOTE: case E_VAR: case E_LAMBDA:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+每个实参的耗时用 "峰值保持" 的指数平均: 比当前值大就直接取新值, 否则慢慢往下衰减
+递归函数里同一个调用点绝大多数时候都很便宜 (叶子), 普通平均会把偶尔的大调用淹没;
+真正决定要不要并行的是 "现在有没有空闲 worker", 所以只有一直都便宜的调用点会被排除
+*/
+static void recordCost(std::atomic<uint64_t> &slot, uint64_t ns) {
+    uint64_t old = slot.load(std::memory_order_relaxed);
+    uint64_t next = ns >= old ? ns : old - ((old - ns) >> 4);
+    slot.store(next, std::memory_order_relaxed);
+}
+
+// clock_gettime 直接走 vDSO, 比 chrono 在不开优化时便宜得多
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void evalArguments(const Expr *const *es, size_t n, Assoc &env, CallSiteProfile &profile, Value *out) {
+    // 少于两个不平凡的实参就不可能并行, 连计时都省掉
+    size_t nontrivial = 0;
+    for (size_t i = 0; i < n && nontrivial < 2; i++)
+        if (!isTrivialExpr(*es[i])) nontrivial++;
+    if (nontrivial < 2) {
+        for (size_t i = 0; i < n; i++) out[i] = (*es[i])->eval(env);
+        return;
+    }
+    std::atomic<uint64_t> *cost = profile.get(n);
+
+    size_t costly = 0, last = 0;
+    for (size_t i = 0; i < n; i++)
+        if (cost[i].load(std::memory_order_relaxed) >= PAR_ARG_MIN_NS) {
+            costly++;
+            last = i;
+        }
+
+    // 单核机器上不启动线程池: 一旦有了第二个线程, 所有 shared_ptr 的引用计数都会变成原子操作
+    // 用 --threads 要了多个 worker 时照常并行
+    static const bool multicore = ThreadPool::globalWorkers() > 1;
+    if (costly >= 2 && multicore && ThreadPool::global().idleWorkers() > 0) {
+        bool pure = true;
+        for (size_t i = 0; pure && i < n; i++)
+            pure = isTrivialExpr(*es[i]) || isPureExpr(*es[i], env);
+        if (pure) {
+            // 最后一个费时的实参留在当前线程算, 其余费时的交给线程池
+            std::vector<Value> spawned(n, Value(nullptr));
+            for (size_t i = 0; i < n; i++)
+                if (i != last && cost[i].load(std::memory_order_relaxed) >= PAR_ARG_MIN_NS)
+                    spawned[i] = spawnFuture(*es[i], env);
+            // 留在本线程的那个照常计时, 调用点变便宜以后就会退回串行
+            for (size_t i = 0; i < n; i++) {
+                if (spawned[i].get()) continue;
+                if (i == last) {
+                    uint64_t start = nowNs();
+                    out[i] = (*es[i])->eval(env);
+                    recordCost(cost[i], nowNs() - start);
+                } else {
+                    out[i] = (*es[i])->eval(env);
+                }
+            }
+            for (size_t i = 0; i < n; i++)
+                if (spawned[i].get()) out[i] = touchFuture(spawned[i]);
+            return;
+        }
+    }
+
+    // 计时本身不便宜, 每个线程只抽样 1/PROFILE_SAMPLE_RATE 的求值
+    static thread_local unsigned sample_tick = 0;
+    bool sample = ++sample_tick % PROFILE_SAMPLE_RATE == 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!sample || isTrivialExpr(*es[i])) {
+            out[i] = (*es[i])->eval(env);
+            continue;
+        }
+        uint64_t start = nowNs();
+        out[i] = (*es[i])->eval(env);
+        recordCost(cost[i], nowNs() - start);
+    }
+}
+
+void evalArguments(const std::vector<Expr> &es, Assoc &env, CallSiteProfile &profile, std::vector<Value> &out) {
+    size_t nontrivial = 0;
+    for (size_t i = 0; i < es.size() && nontrivial < 2; i++)
+        if (!isTrivialExpr(es[i])) nontrivial++;
+    if (nontrivial < 2) {
+        out.clear();
+        for (auto &e : es) out.push_back(e->eval(env));
+        return;
+    }
+    std::vector<const Expr*> ptrs;
+    ptrs.reserve(es.size());
+    for (auto &e : es) ptrs.push_back(&e);
+    out.assign(es.size(), Value(nullptr));
+    evalArguments(ptrs.data(), ptrs.size(), env, profile, out.data());
+}
@@ -0,0 +1,55 @@
+#ifndef PURITY
+#define PURITY
+
+/**
+ * @file purity.hpp
+ * @brief Automatic parallel evaluation of pure call arguments
+ *
+ * With --parallel-args, Apply, Binary and Variadic nodes hand their operands
+ * to evalArguments. It profiles how long each operand takes at that call
+ * site and, when at least two of them are costly, every operand is free of
+ * side effects and a worker is idle, evaluates the costly ones as futures.
+ *
+ * The effect analysis walks the Expr tree. Literals, variables, lambda and
+ * quote are pure; primitives are pure unless they mutate, do I/O or call
+ * back into arbitrary procedures; calls are pure only when the operator
+ * resolves to a procedure whose body is pure. Calls through parameters and
+ * other unknown operators count as impure. Results per Procedure are cached
+ * until the next define or set!.
+ */
+
+#include "value.hpp"
+#include <vector>
+
+/**
+ * @brief Enabled by --parallel-args; set once before evaluation starts
+ */
+extern bool parallel_args;
+
+/**
+ * @brief Invalidates every cached procedure purity (define and set! call it)
+ */
+void bumpPurityEpoch();
+
+/**
+ * @brief Whether evaluating the expression in env can have no side effects
+ */
+bool isPureExpr(const Expr &, const Assoc &);
+
+/**
+ * @brief Whether calling the procedure can have no side effects
+ */
+bool isPureProcedure(Procedure *);
+
+/**
+ * @brief Literals, variables, quote and lambda: never worth profiling
+ */
+bool isTrivialExpr(const Expr &);
+
+/**
+ * @brief Evaluates n argument expressions left to right into out, possibly in parallel
+ */
+void evalArguments(const Expr *const *, size_t, Assoc &, CallSiteProfile &, Value *);
+void evalArguments(const std::vector<Expr> &, Assoc &, CallSiteProfile &, std::vector<Value> &);
+
+#endif // PURITY
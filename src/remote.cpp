@@ -0,0 +1,406 @@
+/**
+ * @file remote.cpp
+ * @brief Worker pool, worker loop and the remote-apply / remote-map primitives
+ */
+
+#include "remote.hpp"
+#include "expr.hpp"
+#include "interpreter.hpp"
+#include "purity.hpp"
+#include "serialize.hpp"
+#include "wire.hpp"
+#include "RE.hpp"
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::string remote_workers;
+
+namespace {
+
+enum { REPLY_OK = 0, REPLY_ERROR = 1 };
+
+// ============================================================================
+// Worker side
+// ============================================================================
+
+std::string reply(int status, const std::string &output, const std::string &body) {
+    std::string r;
+    r.reserve(output.size() + body.size() + 5);
+    r.push_back((char)status);
+    putU32(r, (uint32_t)output.size());
+    r += output;
+    r += body;
+    return r;
+}
+
+/*
+一个连接一个解释器, 请求按顺序处理
+纯过程可以放心复用, 有 set! 之类的过程每次都重新解码, 免得上次调用留下状态
+*/
+void serveWorker(int fd, const std::function<void(Interpreter &)> &setup) {
+    std::ostringstream out;
+    Interpreter interp(out);
+    try {
+        if (setup) setup(interp);
+    } catch (const RuntimeError &e) {
+        std::cerr << "code: worker: " << e.message() << std::endl;
+        close(fd);
+        return;
+    }
+    std::string cached_bytes;
+    Value cached(nullptr);
+    std::string req;
+    while (readFrame(fd, req)) {
+        out.str("");
+        out.clear();
+        int status = REPLY_OK;
+        std::string body;
+        try {
+            if (req.size() < 4)
+                throw RuntimeError("Bad remote request");
+            size_t n = getU32(reinterpret_cast<const unsigned char*>(req.data()));
+            if (n > req.size() - 4)
+                throw RuntimeError("Bad remote request");
+            Value proc(nullptr);
+            if (cached.get() && req.compare(4, n, cached_bytes) == 0) {
+                proc = cached;
+            } else {
+                size_t pos = 4;
+                proc = decodeValue(req, pos);
+                if (pos != 4 + n || proc->v_type != V_PROC)
+                    throw RuntimeError("Bad remote request");
+                if (isPureProcedure(static_cast<Procedure*>(proc.get()))) {
+                    cached = proc;
+                    cached_bytes.assign(req, 4, n);
+                }
+            }
+            size_t pos = 4 + n;
+            Value args = decodeValue(req, pos);
+            if (args->v_type != V_VECTOR)
+                throw RuntimeError("Bad remote request");
+            Value result = interp.apply(proc, static_cast<Vector*>(args.get())->elems);
+            encodeValue(result, body);
+        } catch (const RuntimeError &e) {
+            status = REPLY_ERROR;
+            body = e.message();
+        } catch (const std::exception &e) {
+            status = REPLY_ERROR;
+            body = e.what();
+        }
+        if (!writeFrame(fd, reply(status, out.str(), body)))
+            break;
+    }
+    close(fd);
+}
+
+// ============================================================================
+// Pool
+// ============================================================================
+
+struct RemoteWorker {
+    int fd = -1;       ///< -1 until started
+    pid_t pid = 0;     ///< Process we started, 0 for a socket path
+    size_t slot = 0;
+};
+
+/*
+槽位数固定; 空闲的槽位可能还没有连接, 取走时才启动
+坏掉的连接直接关掉, 槽位放回去, 下次用到再重启
+*/
+class RemotePool {
+public:
+    std::vector<RemoteWorker> acquire(size_t want);
+    void release(std::vector<RemoteWorker> &ws, const std::vector<bool> &broken);
+
+private:
+    std::mutex m;
+    std::condition_variable cv;
+    bool configured = false;
+    std::vector<std::string> paths;    ///< Per slot, empty when we start the worker ourselves
+    std::vector<RemoteWorker> idle;
+
+    void configure();
+    bool start(RemoteWorker &w);
+    static void stop(RemoteWorker &w);
+};
+
+void RemotePool::configure() {
+    configured = true;
+    const std::string &spec = remote_workers;
+    if (!spec.empty() && spec.find_first_not_of("0123456789") != std::string::npos) {
+        size_t begin = 0;
+        while (begin <= spec.size()) {
+            size_t end = spec.find(',', begin);
+            if (end == std::string::npos) end = spec.size();
+            if (end > begin) paths.push_back(spec.substr(begin, end - begin));
+            begin = end + 1;
+        }
+    } else {
+        unsigned n = spec.empty() ? std::thread::hardware_concurrency() : (unsigned)atoi(spec.c_str());
+        paths.assign(n ? n : 1, std::string());
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        RemoteWorker w;
+        w.slot = i;
+        idle.push_back(w);
+    }
+}
+
+/*
+fork 之后到 exec 之间只做 async-signal-safe 的事: 这时别的线程可能正拿着锁
+socketpair 两端都是 CLOEXEC, 子进程只把自己那一端的标志清掉
+*/
+bool RemotePool::start(RemoteWorker &w) {
+    if (!paths[w.slot].empty()) {
+        w.fd = connectUnix(paths[w.slot]);
+        return w.fd >= 0;
+    }
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+        return false;
+    std::string fdarg = std::to_string(sv[1]);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        fcntl(sv[1], F_SETFD, 0);
+        execl("/proc/self/exe", "code", "--worker", fdarg.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(sv[1]);
+    w.fd = sv[0];
+    w.pid = pid;
+    return true;
+}
+
+void RemotePool::stop(RemoteWorker &w) {
+    if (w.fd >= 0) close(w.fd);
+    if (w.pid > 0) {
+        kill(w.pid, SIGKILL);
+        while (waitpid(w.pid, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+    w.fd = -1;
+    w.pid = 0;
+}
+
+// 至少拿到一个, 最多 want 个; 没启动的在锁外启动
+std::vector<RemoteWorker> RemotePool::acquire(size_t want) {
+    std::vector<RemoteWorker> ws;
+    {
+        std::unique_lock<std::mutex> lk(m);
+        if (!configured) configure();
+        cv.wait(lk, [this] { return !idle.empty(); });
+        while (!idle.empty() && ws.size() < want) {
+            ws.push_back(idle.back());
+            idle.pop_back();
+        }
+    }
+    bool ok = true;
+    for (auto &w : ws)
+        if (w.fd < 0 && !start(w)) ok = false;
+    if (!ok) {
+        std::vector<bool> broken(ws.size(), true);
+        release(ws, broken);
+        throw RuntimeError("Cannot start remote worker");
+    }
+    return ws;
+}
+
+void RemotePool::release(std::vector<RemoteWorker> &ws, const std::vector<bool> &broken) {
+    for (size_t i = 0; i < ws.size(); i++)
+        if (broken[i]) stop(ws[i]);
+    std::lock_guard<std::mutex> lk(m);
+    for (auto &w : ws) idle.push_back(w);
+    ws.clear();
+    cv.notify_all();
+}
+
+RemotePool &pool() {
+    static RemotePool p;
+    return p;
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+/*
+每个 worker 同一时间只有一个请求; 谁先回复就先给谁下一个
+各次调用的输出按调用顺序写出, 有调用失败时也先写出已完成的那些再报错
+*/
+std::vector<Value> runRemote(const Value &proc, const std::vector<std::vector<Value>> &calls) {
+    size_t n = calls.size();
+    std::vector<Value> results(n, Value(nullptr));
+    if (n == 0) return results;
+
+    std::string proc_bytes;
+    encodeValue(proc, proc_bytes);
+    std::vector<std::string> frames(n);
+    for (size_t i = 0; i < n; i++) {
+        putU32(frames[i], (uint32_t)proc_bytes.size());
+        frames[i] += proc_bytes;
+        encodeValue(VectorV(calls[i]), frames[i]);
+    }
+
+    std::vector<RemoteWorker> ws = pool().acquire(n);
+    std::vector<bool> broken(ws.size(), false);
+    std::vector<size_t> running(ws.size(), SIZE_MAX);
+    std::vector<std::string> outputs(n);
+    std::vector<bool> finished(n, false);
+    size_t next = 0, pending = 0;
+    bool failed = false;
+    std::string error;
+
+    auto dispatch = [&](size_t k) {
+        if (failed || next >= n) return;
+        if (!writeFrame(ws[k].fd, frames[next])) {
+            broken[k] = true;
+            failed = true;
+            error = "Remote worker died";
+            return;
+        }
+        running[k] = next++;
+        pending++;
+    };
+    for (size_t k = 0; k < ws.size(); k++) dispatch(k);
+
+    std::vector<pollfd> pfds;
+    std::vector<size_t> who;
+    std::string payload;
+    while (pending > 0) {
+        pfds.clear();
+        who.clear();
+        for (size_t k = 0; k < ws.size(); k++)
+            if (running[k] != SIZE_MAX) {
+                pfds.push_back(pollfd{ws[k].fd, POLLIN, 0});
+                who.push_back(k);
+            }
+        if (poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (size_t j = 0; j < pfds.size(); j++) {
+            if (!pfds[j].revents) continue;
+            size_t k = who[j];
+            size_t i = running[k];
+            running[k] = SIZE_MAX;
+            pending--;
+            bool ok = readFrame(ws[k].fd, payload) && payload.size() >= 5;
+            const unsigned char *p = reinterpret_cast<const unsigned char*>(payload.data());
+            size_t out_len = ok ? getU32(p + 1) : 0;
+            if (!ok || out_len > payload.size() - 5) {
+                broken[k] = true;
+                failed = true;
+                error = "Remote worker died";
+                continue;
+            }
+            outputs[i].assign(payload, 5, out_len);
+            finished[i] = true;
+            size_t pos = 5 + out_len;
+            if (p[0] == REPLY_OK) {
+                try {
+                    results[i] = decodeValue(payload, pos);
+                } catch (const RuntimeError &e) {
+                    failed = true;
+                    error = e.message();
+                }
+            } else if (!failed) {
+                failed = true;
+                error = payload.substr(pos);
+            }
+            dispatch(k);
+        }
+    }
+    // poll 出错时还在跑的请求收不回来了, 那些连接不能再用
+    for (size_t k = 0; k < ws.size(); k++)
+        if (running[k] != SIZE_MAX) {
+            broken[k] = true;
+            failed = true;
+            error = "Remote worker died";
+        }
+    pool().release(ws, broken);
+
+    std::ostream &os = current_output ? *current_output : std::cout;
+    for (size_t i = 0; i < n; i++)
+        if (finished[i]) os << outputs[i];
+    if (failed) throw RuntimeError(error);
+    return results;
+}
+
+} // namespace
+
+int runWorker(const std::string &where, const std::function<void(Interpreter &)> &setup) {
+    if (!where.empty() && where.find_first_not_of("0123456789") == std::string::npos) {
+        serveWorker(atoi(where.c_str()), setup);
+        return 0;
+    }
+    int lfd = listenUnix(where);
+    if (lfd < 0) return 1;
+    signal(SIGCHLD, SIG_IGN);
+    while (1) {
+        int cfd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "code: accept failed on " << where << std::endl;
+            return 1;
+        }
+        // 每个连接一个进程, 一个连接里的程序崩了不影响别的连接
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(lfd);
+            serveWorker(cfd, setup);
+            _exit(0);
+        }
+        close(cfd);
+    }
+}
+
+Value RemoteApply::evalRator(const std::vector<Value> &args) { // remote-apply
+    if (args.empty())
+        throw RuntimeError("Wrong number of remote-apply");
+    if (args[0]->v_type != V_PROC)
+        throw RuntimeError("remote-apply: expected a procedure");
+    std::vector<std::vector<Value>> calls(1, std::vector<Value>(args.begin() + 1, args.end()));
+    return runRemote(args[0], calls)[0];
+}
+
+Value RemoteMap::evalRator(const Value &proc, const Value &seq) { // remote-map
+    if (proc->v_type != V_PROC)
+        throw RuntimeError("remote-map: expected a procedure");
+    std::vector<std::vector<Value>> calls;
+    bool isVector = seq->v_type == V_VECTOR;
+    if (isVector) {
+        for (auto &x : static_cast<Vector*>(seq.get())->elems)
+            calls.push_back(std::vector<Value>(1, x));
+    } else {
+        Value cur = seq;
+        while (cur->v_type == V_PAIR) {
+            Pair *p = static_cast<Pair*>(cur.get());
+            calls.push_back(std::vector<Value>(1, p->car));
+            cur = p->cdr;
+        }
+        if (cur->v_type != V_NULL)
+            throw RuntimeError("Not a proper list in remote-map");
+    }
+    std::vector<Value> out = runRemote(proc, calls);
+    if (isVector) return VectorV(out);
+    Value list = NullV();
+    for (size_t i = out.size(); i > 0; i--)
+        list = PairV(out[i - 1], list);
+    return list;
+}
@@ -0,0 +1,45 @@
+#ifndef REMOTE
+#define REMOTE
+
+/**
+ * @file remote.hpp
+ * @brief Worker processes for remote-apply and remote-map
+ *
+ * A worker is `code --worker FD|PATH`. With a file descriptor it serves
+ * the already connected socket it inherited and exits at EOF; with a path
+ * it listens on that Unix socket and forks a server per connection.
+ *
+ * Each request is one frame (see wire.hpp) holding the encoded procedure
+ * (u32 length, then the bytes) followed by the encoded argument vector. The
+ * reply is a u8 status (0 ok, 1 error), the u32-length-prefixed text the
+ * procedure displayed, then the encoded result or the error message.
+ *
+ * A worker keeps the last pure procedure it decoded, so remote-map does not
+ * re-parse the same closure for every element.
+ *
+ * By default the calling process starts one worker per hardware thread on
+ * first use, connected through socketpairs; a worker that dies only fails
+ * the calls it was running and is restarted on the next one.
+ */
+
+#include <functional>
+#include <string>
+
+class Interpreter;
+
+/**
+ * @brief Workers to use: a count of local processes to start, or
+ * comma-separated socket paths of running `code --worker PATH`
+ * Empty means one local process per hardware thread. Read on first use.
+ */
+extern std::string remote_workers;
+
+/**
+ * @brief Body of `code --worker`
+ * @param setup run on the interpreter of each connection before its first
+ * request (code installs its built-in prelude here)
+ * @return nonzero if the socket could not be set up
+ */
+int runWorker(const std::string &where, const std::function<void(Interpreter &)> &setup);
+
+#endif // REMOTE
@@ -0,0 +1,714 @@
+/**
+ * @file serialize.cpp
+ * @brief Value and closure encoding: Expr back to syntax, varints, back references
+ */
+
+#include "serialize.hpp"
+#include "expr.hpp"
+#include "persistent.hpp"
+#include "RE.hpp"
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+enum Tag : unsigned char {
+    T_INT, T_RATIONAL, T_TRUE, T_FALSE, T_SYM, T_STRING, T_NULL, T_VOID,
+    T_LIST, T_VECTOR, T_PROC, T_PRIMITIVE, T_PMAP, T_PVECTOR, T_REF, T_UNSET
+};
+
+// load 的缓存文件也用这套语法编码, 改了要同时改 loadcache.cpp 里的 CACHE_VERSION
+enum SyntaxTag : unsigned char {
+    S_NUMBER, S_RATIONAL, S_TRUE, S_FALSE, S_SYMBOL, S_STRING, S_LIST
+};
+
+// ============================================================================
+// Expr -> Syntax
+// ============================================================================
+
+// 原语和关键字按 ExprType 反查名字; 同一个类型有别名时哪个都行
+const std::map<ExprType, std::string> &exprNames() {
+    static const std::map<ExprType, std::string> names = [] {
+        std::map<ExprType, std::string> m;
+        for (auto &p : primitives) m.emplace(p.second, p.first);
+        for (auto &p : reserved_words) m.emplace(p.second, p.first);
+        return m;
+    }();
+    return names;
+}
+
+Syntax symbol(const std::string &s) {
+    return Syntax(new SymbolSyntax(s));
+}
+
+Syntax unparse(ExprBase *e);
+
+Syntax form(const std::string &head, const std::vector<Expr> &rest) {
+    List *l = new List();
+    Syntax stx(l);
+    l->stxs.push_back(symbol(head));
+    for (auto &x : rest) l->stxs.push_back(unparse(x.get()));
+    return stx;
+}
+
+Syntax bindingForm(const std::string &head, const std::vector<std::pair<std::string, Expr>> &bind,
+                   const Expr &body) {
+    List *l = new List();
+    Syntax stx(l);
+    l->stxs.push_back(symbol(head));
+    List *bl = new List();
+    l->stxs.push_back(Syntax(bl));
+    for (auto &b : bind) {
+        List *one = new List();
+        bl->stxs.push_back(Syntax(one));
+        one->stxs.push_back(symbol(b.first));
+        one->stxs.push_back(unparse(b.second.get()));
+    }
+    l->stxs.push_back(unparse(body.get()));
+    return stx;
+}
+
+Syntax paramList(const std::vector<std::string> &xs) {
+    List *l = new List();
+    Syntax stx(l);
+    for (auto &x : xs) l->stxs.push_back(symbol(x));
+    return stx;
+}
+
+/*
+把解析好的 Expr 还原成等价的语法树, 对端重新解析
+特殊形式逐个还原, 原语统一按 (名字 操作数...) 还原, 和 purity.cpp 的遍历方式一样
+*/
+Syntax unparse(ExprBase *e) {
+    switch (e->e_type) {
+        case E_FIXNUM:
+            return Syntax(new Number(static_cast<Fixnum*>(e)->n));
+        case E_RATIONAL: {
+            RationalNum *r = static_cast<RationalNum*>(e);
+            return Syntax(new RationalSyntax(r->numerator, r->denominator));
+        }
+        case E_STRING:
+            return Syntax(new StringSyntax(*static_cast<StringExpr*>(e)->s));
+        case E_TRUE:
+            return Syntax(new TrueSyntax());
+        case E_FALSE:
+            return Syntax(new FalseSyntax());
+        case E_VOID:
+            return form("void", {});
+        case E_EXIT:
+            return form("exit", {});
+        case E_VAR:
+            return symbol(static_cast<Var*>(e)->x);
+        case E_AND:
+            return form("and", static_cast<AndVar*>(e)->rands);
+        case E_OR:
+            return form("or", static_cast<OrVar*>(e)->rands);
+        case E_BEGIN:
+            return form("begin", static_cast<Begin*>(e)->es);
+        case E_QUOTE: {
+            List *l = new List();
+            Syntax stx(l);
+            l->stxs.push_back(symbol("quote"));
+            l->stxs.push_back(static_cast<Quote*>(e)->s);
+            return stx;
+        }
+        case E_IF: {
+            If *x = static_cast<If*>(e);
+            return form("if", {x->cond, x->conseq, x->alter});
+        }
+        case E_COND: {
+            List *l = new List();
+            Syntax stx(l);
+            l->stxs.push_back(symbol("cond"));
+            for (auto &clause : static_cast<Cond*>(e)->clauses) {
+                List *c = new List();
+                l->stxs.push_back(Syntax(c));
+                for (auto &x : clause) c->stxs.push_back(unparse(x.get()));
+            }
+            return stx;
+        }
+        case E_APPLY: {
+            Apply *x = static_cast<Apply*>(e);
+            List *l = new List();
+            Syntax stx(l);
+            l->stxs.push_back(unparse(x->rator.get()));
+            for (auto &r : x->rand) l->stxs.push_back(unparse(r.get()));
+            return stx;
+        }
+        case E_LAMBDA: {
+            Lambda *x = static_cast<Lambda*>(e);
+            List *l = new List();
+            Syntax stx(l);
+            l->stxs.push_back(symbol("lambda"));
+            l->stxs.push_back(paramList(x->x));
+            l->stxs.push_back(unparse(x->e.get()));
+            return stx;
+        }
+        case E_LAZY_BODY:
+            return unparse(static_cast<LazyBody*>(e)->force());
+        case E_DEFINE: {
+            Define *x = static_cast<Define*>(e);
+            List *l = new List();
+            Syntax stx(l);
+            l->stxs.push_back(symbol("define"));
+            l->stxs.push_back(symbol(x->var));
+            l->stxs.push_back(unparse(x->e.get()));
+            return stx;
+        }
+        case E_SET: {
+            Set *x = static_cast<Set*>(e);
+            List *l = new List();
+            Syntax stx(l);
+            l->stxs.push_back(symbol("set!"));
+            l->stxs.push_back(symbol(x->var));
+            l->stxs.push_back(unparse(x->e.get()));
+            return stx;
+        }
+        case E_LET:
+            return bindingForm("let", static_cast<Let*>(e)->bind, static_cast<Let*>(e)->body);
+        case E_LETREC:
+            return bindingForm("letrec", static_cast<Letrec*>(e)->bind, static_cast<Letrec*>(e)->body);
+        case E_PARALLEL_LET:
+            return bindingForm("parallel-let", static_cast<ParallelLet*>(e)->bind,
+                               static_cast<ParallelLet*>(e)->body);
+        case E_DELAY:
+            return form("delay", {static_cast<Delay*>(e)->e});
+        case E_DELAY_FORCE:
+            return form("delay-force", {static_cast<DelayForce*>(e)->e});
+        case E_CONS_STREAM: {
+            ConsStream *x = static_cast<ConsStream*>(e);
+            return form("cons-stream", {x->car, x->cdr});
+        }
+        case E_FUTURE:
+            return form("future", {static_cast<FutureExpr*>(e)->e});
+        case E_NATIVE:
+        case E_LOAD_EXTENSION:
+            throw RuntimeError("Cannot send a native procedure to a worker");
+        case E_RECORD_CTOR: case E_RECORD_PRED: case E_RECORD_GET: case E_RECORD_SET:
+        case E_DEFINE_RECORD:
+            throw RuntimeError("Cannot send a record definition to a worker");
+        default:
+            break;
+    }
+    auto name = exprNames().find(e->e_type);
+    if (name == exprNames().end())
+        throw RuntimeError("Cannot send this expression to a worker");
+    if (Unary *u = dynamic_cast<Unary*>(e))
+        return form(name->second, {u->rand});
+    if (Binary *b = dynamic_cast<Binary*>(e))
+        return form(name->second, {b->rand1, b->rand2});
+    if (Variadic *v = dynamic_cast<Variadic*>(e))
+        return form(name->second, v->rands);
+    throw RuntimeError("Cannot send this expression to a worker");
+}
+
+// 函数体里出现的所有符号 (quote 里的除外), 是自由变量的超集
+void mentionedNames(const Syntax &stx, std::set<std::string> &names) {
+    if (SymbolSyntax *s = dynamic_cast<SymbolSyntax*>(stx.get())) {
+        names.insert(s->s);
+        return;
+    }
+    List *l = dynamic_cast<List*>(stx.get());
+    if (!l) return;
+    if (!l->stxs.empty()) {
+        SymbolSyntax *head = dynamic_cast<SymbolSyntax*>(l->stxs[0].get());
+        if (head && head->s == "quote") return;
+    }
+    for (auto &x : l->stxs) mentionedNames(x, names);
+}
+
+// ============================================================================
+// Encoder
+// ============================================================================
+
+class Encoder {
+public:
+    explicit Encoder(std::string &out) : out(out) {}
+    void value(const Value &v);
+    void name(const std::string &s) { str(s); }
+    void count(size_t n) { varint(n); }
+    void syntax(const Syntax &stx);
+
+    /** @brief Closures stop copying their environment at any of these nodes */
+    std::unordered_set<const AssocList*> globals;
+
+private:
+    std::string &out;
+    std::unordered_map<const ValueBase*, uint32_t> ids;
+
+    void byte(unsigned char c) { out.push_back((char)c); }
+    void varint(uint64_t x) {
+        while (x >= 0x80) {
+            byte((unsigned char)(x | 0x80));
+            x >>= 7;
+        }
+        byte((unsigned char)x);
+    }
+    void sint(int64_t x) { varint(((uint64_t)x << 1) ^ (uint64_t)(x >> 63)); }
+    void str(const char *p, size_t n) {
+        varint(n);
+        out.append(p, n);
+    }
+    void str(const std::string &s) { str(s.data(), s.size()); }
+
+    // 见过的可变对象写成回指, 否则登记一个新编号
+    bool backref(const Value &v) {
+        auto it = ids.find(v.get());
+        if (it != ids.end()) {
+            byte(T_REF);
+            varint(it->second);
+            return true;
+        }
+        ids.emplace(v.get(), (uint32_t)ids.size());
+        return false;
+    }
+
+    void list(const Value &v);
+    void procedure(const Value &v);
+};
+
+void Encoder::syntax(const Syntax &stx) {
+    SyntaxBase *s = stx.get();
+    if (Number *n = dynamic_cast<Number*>(s)) {
+        byte(S_NUMBER);
+        sint(n->n);
+    } else if (RationalSyntax *r = dynamic_cast<RationalSyntax*>(s)) {
+        byte(S_RATIONAL);
+        sint(r->numerator);
+        sint(r->denominator);
+    } else if (dynamic_cast<TrueSyntax*>(s)) {
+        byte(S_TRUE);
+    } else if (dynamic_cast<FalseSyntax*>(s)) {
+        byte(S_FALSE);
+    } else if (SymbolSyntax *y = dynamic_cast<SymbolSyntax*>(s)) {
+        byte(S_SYMBOL);
+        str(y->s);
+    } else if (StringSyntax *t = dynamic_cast<StringSyntax*>(s)) {
+        byte(S_STRING);
+        str(t->s);
+    } else if (List *l = dynamic_cast<List*>(s)) {
+        byte(S_LIST);
+        varint(l->stxs.size());
+        for (auto &x : l->stxs) syntax(x);
+    } else {
+        throw RuntimeError("Cannot encode syntax");
+    }
+}
+
+/*
+表的脊一次写完: 先数出还没见过的连续序对, 全部登记, 再逐个写 car, 最后写尾巴
+长表不会把栈用完, car 里指回脊上后面的序对也能解出来
+*/
+void Encoder::list(const Value &v) {
+    std::vector<Pair*> spine;
+    Value cur = v;
+    while (cur->v_type == V_PAIR && !ids.count(cur.get())) {
+        ids.emplace(cur.get(), (uint32_t)ids.size());
+        spine.push_back(static_cast<Pair*>(cur.get()));
+        cur = spine.back()->cdr;
+    }
+    byte(T_LIST);
+    varint(spine.size());
+    for (Pair *p : spine) value(p->car);
+    value(cur);
+}
+
+void Encoder::procedure(const Value &v) {
+    Procedure *proc = static_cast<Procedure*>(v.get());
+    std::string prim = primitiveName(proc);
+    if (!prim.empty()) {
+        byte(T_PRIMITIVE);
+        str(prim);
+        return;
+    }
+    if (backref(v)) return;
+    Syntax body = unparse(proc->e.get());
+    std::set<std::string> names;
+    mentionedNames(body, names);
+    for (auto &x : proc->parameters) names.erase(x);
+
+    // 只带函数体提到的绑定, 每个名字取环境链上最近的那个; 到了全局环境就不再往下带
+    std::vector<AssocList*> bindings;
+    for (AssocList *node = proc->env.get(); node && !names.empty(); node = node->next.get()) {
+        if (globals.count(node)) break;
+        if (names.erase(node->x)) bindings.push_back(node);
+    }
+
+    byte(T_PROC);
+    varint(proc->parameters.size());
+    for (auto &x : proc->parameters) str(x);
+    varint(bindings.size());
+    for (AssocList *node : bindings) {
+        str(node->x);
+        value(node->v);
+    }
+    syntax(body);
+}
+
+void Encoder::value(const Value &v) {
+    if (!v.get()) {
+        byte(T_UNSET);
+        return;
+    }
+    switch (v->v_type) {
+        case V_INT:
+            byte(T_INT);
+            sint(static_cast<Integer*>(v.get())->n);
+            return;
+        case V_RATIONAL: {
+            Rational *r = static_cast<Rational*>(v.get());
+            byte(T_RATIONAL);
+            sint(r->numerator);
+            sint(r->denominator);
+            return;
+        }
+        case V_BOOL:
+            byte(static_cast<Boolean*>(v.get())->b ? T_TRUE : T_FALSE);
+            return;
+        case V_SYM:
+            byte(T_SYM);
+            str(static_cast<Symbol*>(v.get())->s);
+            return;
+        case V_STRING: {
+            String *s = static_cast<String*>(v.get());
+            byte(T_STRING);
+            str(s->data(), s->size());
+            return;
+        }
+        case V_NULL:
+            byte(T_NULL);
+            return;
+        case V_VOID:
+            byte(T_VOID);
+            return;
+        case V_PAIR:
+            if (ids.count(v.get())) backref(v);
+            else list(v);
+            return;
+        case V_VECTOR: {
+            if (backref(v)) return;
+            Vector *vec = static_cast<Vector*>(v.get());
+            byte(T_VECTOR);
+            varint(vec->elems.size());
+            for (auto &x : vec->elems) value(x);
+            return;
+        }
+        case V_PROC:
+            procedure(v);
+            return;
+        case V_PMAP: {
+            std::vector<std::pair<Value, Value>> entries;
+            pmapEntries(static_cast<PMap*>(v.get()), entries);
+            byte(T_PMAP);
+            varint(entries.size());
+            for (auto &kv : entries) {
+                value(kv.first);
+                value(kv.second);
+            }
+            return;
+        }
+        case V_PVECTOR: {
+            std::vector<Value> elems;
+            pvectorElems(static_cast<PVector*>(v.get()), elems);
+            byte(T_PVECTOR);
+            varint(elems.size());
+            for (auto &x : elems) value(x);
+            return;
+        }
+        case V_PROMISE:
+            throw RuntimeError("Cannot encode a promise");
+        case V_RECORD:
+            throw RuntimeError("Cannot encode a record");
+        default:
+            throw RuntimeError("Cannot encode this value");
+    }
+}
+
+// ============================================================================
+// Decoder
+// ============================================================================
+
+class Decoder {
+public:
+    Decoder(std::string_view in, size_t &pos) : in(in), pos(pos), root(nullptr), frozen(nullptr) {}
+    Value value();
+    std::string name() { return str(); }
+    size_t number() { return count(); }
+    Syntax syntax();
+
+    /**
+     * @brief Environment decoded closures are built on
+     * Their bodies wait until the first call to be parsed, and are then
+     * parsed as if the global environment bound only the names in names.
+     */
+    void rootAt(const Assoc &env, const Assoc &names) {
+        root = env;
+        frozen = names;
+        lazy = true;
+    }
+
+private:
+    std::string_view in;
+    size_t &pos;
+    Assoc root;
+    Assoc frozen;              ///< Names lazy bodies are parsed against, values unused
+    bool lazy = false;
+    std::vector<Value> objs;   ///< In the order the encoder numbered them
+
+    unsigned char byte() {
+        if (pos >= in.size()) throw RuntimeError("Truncated encoding");
+        return (unsigned char)in[pos++];
+    }
+    uint64_t varint() {
+        uint64_t x = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            unsigned char c = byte();
+            x |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80)) return x;
+        }
+        throw RuntimeError("Bad varint in encoding");
+    }
+    int sint() {
+        uint64_t z = varint();
+        return (int)(int64_t)((z >> 1) ^ (~(z & 1) + 1));
+    }
+    size_t count() {
+        uint64_t n = varint();
+        if (n > in.size() - pos) throw RuntimeError("Truncated encoding");
+        return (size_t)n;
+    }
+    std::string str() {
+        size_t n = count();
+        std::string s(in.substr(pos, n));
+        pos += n;
+        return s;
+    }
+
+    Value procedure();
+};
+
+Syntax Decoder::syntax() {
+    switch (byte()) {
+        case S_NUMBER:
+            return Syntax(new Number(sint()));
+        case S_RATIONAL: {
+            int num = sint();
+            int den = sint();
+            return Syntax(new RationalSyntax(num, den));
+        }
+        case S_TRUE:
+            return Syntax(new TrueSyntax());
+        case S_FALSE:
+            return Syntax(new FalseSyntax());
+        case S_SYMBOL:
+            return symbol(str());
+        case S_STRING:
+            return Syntax(new StringSyntax(str()));
+        case S_LIST: {
+            size_t n = count();
+            List *l = new List();
+            Syntax stx(l);
+            for (size_t i = 0; i < n; i++) l->stxs.push_back(syntax());
+            return stx;
+        }
+        default:
+            throw RuntimeError("Bad syntax tag in encoding");
+    }
+}
+
+/*
+先建空壳登记编号 (捕获的绑定里可能指回自己), 再解出绑定, 最后在重建的环境里解析函数体
+形参用占位值挂到环境上, 和 parser 处理 lambda 的方式一样
+推迟解析的函数体不挂在全局环境上, 而是挂在 frozen 上: 之后重新定义的 car 之类不会改变它的解析结果
+*/
+Value Decoder::procedure() {
+    std::vector<std::string> params(count());
+    for (auto &x : params) x = str();
+    Value proc = ProcedureV(params, Expr(nullptr), empty());
+    objs.push_back(proc);
+    Assoc env = root;
+    Assoc scope = lazy ? frozen : root;
+    size_t n = count();
+    for (size_t i = 0; i < n; i++) {
+        std::string name = str();
+        Value v = value();
+        env = extend(name, v, env);
+        if (lazy) scope = extend(name, VoidV(), scope);
+    }
+    Syntax body = syntax();
+    if (!lazy) scope = env;
+    for (auto &x : params) scope = extend(x, IntegerV(0), scope);
+    Procedure *p = static_cast<Procedure*>(proc.get());
+    if (lazy)
+        p->e = Expr(new LazyBody({body}, scope));
+    else
+        p->e = body->parse(scope);
+    p->env = env;
+    return proc;
+}
+
+Value Decoder::value() {
+    switch (byte()) {
+        case T_INT:
+            return IntegerV(sint());
+        case T_RATIONAL: {
+            int num = sint();
+            int den = sint();
+            return RationalV(num, den);
+        }
+        case T_TRUE:
+            return BooleanV(true);
+        case T_FALSE:
+            return BooleanV(false);
+        case T_SYM:
+            return SymbolV(str());
+        case T_STRING:
+            return StringV(str());
+        case T_NULL:
+            return NullV();
+        case T_VOID:
+            return VoidV();
+        case T_UNSET:
+            return Value(nullptr);
+        case T_LIST: {
+            size_t n = count();
+            std::vector<Value> spine;
+            spine.reserve(n);
+            for (size_t i = 0; i < n; i++) {
+                spine.push_back(PairV(Value(nullptr), Value(nullptr)));
+                objs.push_back(spine.back());
+            }
+            for (size_t i = 0; i < n; i++)
+                static_cast<Pair*>(spine[i].get())->car = value();
+            Value tail = value();
+            for (size_t i = n; i > 0; i--) {
+                static_cast<Pair*>(spine[i - 1].get())->cdr = tail;
+                tail = spine[i - 1];
+            }
+            return tail;
+        }
+        case T_VECTOR: {
+            size_t n = count();
+            Value vec = VectorV(std::vector<Value>(n, Value(nullptr)));
+            objs.push_back(vec);
+            Vector *dst = static_cast<Vector*>(vec.get());
+            for (size_t i = 0; i < n; i++) dst->elems[i] = value();
+            return vec;
+        }
+        case T_PROC:
+            return procedure();
+        case T_PRIMITIVE: {
+            Var prim(str());
+            Assoc env = empty();
+            return prim.eval(env);
+        }
+        case T_PMAP: {
+            size_t n = count();
+            Value m = PMapV(HamtRef(nullptr), 0);
+            for (size_t i = 0; i < n; i++) {
+                Value k = value();
+                Value v = value();
+                m = pmapSet(static_cast<PMap*>(m.get()), k, v);
+            }
+            return m;
+        }
+        case T_PVECTOR: {
+            size_t n = count();
+            std::vector<Value> elems;
+            elems.reserve(n);
+            for (size_t i = 0; i < n; i++) elems.push_back(value());
+            return PVectorV(elems);
+        }
+        case T_REF: {
+            uint64_t id = varint();
+            if (id >= objs.size()) throw RuntimeError("Bad reference in encoding");
+            return objs[(size_t)id];
+        }
+        default:
+            throw RuntimeError("Bad value tag in encoding");
+    }
+}
+
+} // namespace
+
+void bodyNames(ExprBase *body, std::set<std::string> &names) {
+    mentionedNames(unparse(body), names);
+}
+
+void encodeValue(const Value &v, std::string &out) {
+    Encoder e(out);
+    e.value(v);
+}
+
+Value decodeValue(const std::string &in, size_t &pos) {
+    Decoder d(in, pos);
+    return d.value();
+}
+
+void encodeSyntax(const Syntax &stx, std::string &out) {
+    Encoder e(out);
+    e.syntax(stx);
+}
+
+Syntax decodeSyntax(std::string_view in, size_t &pos) {
+    Decoder d(in, pos);
+    return d.syntax();
+}
+
+/*
+名字先全部写完再写值: 解码时先把名字都绑上, 全局环境的头就定下来了,
+闭包再接到它上面; 所有值共用一个编码器, 不同绑定之间的共享也保留
+*/
+void encodeGlobals(const Assoc &globals, std::string &out) {
+    Encoder e(out);
+    std::vector<AssocList*> bindings;
+    std::unordered_set<std::string> seen;
+    for (AssocList *node = globals.get(); node; node = node->next.get()) {
+        e.globals.insert(node);
+        if (!seen.insert(node->x).second) continue;
+        // 原生过程由宿主程序自己再绑一次
+        const Value &v = node->v;
+        if (v.get() && v->v_type == V_PROC && static_cast<Procedure*>(v.get())->e->e_type == E_NATIVE)
+            continue;
+        bindings.push_back(node);
+    }
+    e.count(bindings.size());
+    for (AssocList *node : bindings)
+        e.name(node->x);
+    for (AssocList *node : bindings) {
+        try {
+            e.value(node->v);
+        } catch (const RuntimeError &err) {
+            throw RuntimeError(node->x + ": " + err.message());
+        }
+    }
+}
+
+void decodeGlobals(std::string_view in, size_t &pos, Assoc &env) {
+    Decoder d(in, pos);
+    size_t n = d.number();
+    std::vector<std::string> names(n);
+    for (auto &x : names) {
+        x = d.name();
+        if (find(x, env).get()) continue;
+        // 别的线程上的 future 可能正在查这个环境
+        EnvWriteLock lock;
+        if (!env.get()) env = extend(x, Value(nullptr), env);
+        else env->next = extend(x, Value(nullptr), env->next);
+    }
+    // 解析只关心原语和关键字的名字有没有被绑定; 记下存映像时的样子
+    Assoc frozen = empty();
+    for (auto &x : names)
+        if (primitives.count(x) || reserved_words.count(x))
+            frozen = extend(x, VoidV(), frozen);
+    // 函数体的语法都放进一个 arena, 等最后一个函数体解析完就整块释放
+    std::shared_ptr<Arena> nodes = Arena::make<SyntaxBase>();
+    Arena::Scope scope(SyntaxBase::arena, nodes.get());
+    d.rootAt(env, frozen);
+    for (auto &x : names)
+        modify(x, d.value(), env);
+}
@@ -0,0 +1,80 @@
+#ifndef SERIALIZE
+#define SERIALIZE
+
+/**
+ * @file serialize.hpp
+ * @brief Compact binary encoding of values, including closures
+ *
+ * A closure is written as its parameter list, the bindings of its captured
+ * environment that the body refers to, and its body turned back into syntax.
+ * The decoder re-parses the body in the rebuilt environment, so the result
+ * behaves like the original without sharing any Expr node with it. Bindings
+ * are copied: a set! on a captured variable only affects the copy.
+ *
+ * Sharing and cycles among pairs, vectors and procedures are preserved
+ * within one encoded value. Primitives used as values (e.g. car) are sent
+ * by name.
+ *
+ * Integers are zigzag varints and strings are length-prefixed, so small
+ * data costs a byte or two per atom.
+ */
+
+#include "value.hpp"
+#include <set>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Appends the encoding of v to out
+ * @throws RuntimeError for promises, records, futures, tasks, channels,
+ * isolates, string builders and native procedures
+ */
+void encodeValue(const Value &v, std::string &out);
+
+/**
+ * @brief Decodes one value starting at pos and advances pos past it
+ * @throws RuntimeError on malformed input
+ */
+Value decodeValue(const std::string &in, size_t &pos);
+
+/**
+ * @brief Adds every symbol body mentions outside quote to names
+ * A superset of its free variables; closures are encoded with the captured
+ * bindings named here.
+ * @throws RuntimeError if body cannot be turned back into syntax
+ */
+void bodyNames(ExprBase *body, std::set<std::string> &names);
+
+/**
+ * @brief Appends the encoding of one syntax tree, as closure bodies are written
+ */
+void encodeSyntax(const Syntax &stx, std::string &out);
+
+/**
+ * @brief Decodes one syntax tree starting at pos and advances pos past it
+ * The nodes go to the current syntax arena, if any.
+ * @throws RuntimeError on malformed input
+ */
+Syntax decodeSyntax(std::string_view in, size_t &pos);
+
+/**
+ * @brief Appends every binding of a global environment, as find() sees them
+ * Closures stop at the global environment instead of copying it, so they
+ * can be rooted in another one. Native procedures are left out: the
+ * embedding program binds them itself.
+ * @throws RuntimeError naming the first binding that cannot be encoded
+ */
+void encodeGlobals(const Assoc &globals, std::string &out);
+
+/**
+ * @brief Defines (or updates) the bindings encoded by encodeGlobals in env
+ * Decoded closures are rooted at env and their bodies are parsed on their
+ * first call (see LazyBody), so nothing is parsed here. They are parsed as
+ * the encoded environment was: a primitive or keyword name (car, if, ...)
+ * means the binding if it was one of the encoded globals and the built-in
+ * otherwise, whatever env binds by the time of the call.
+ * @throws RuntimeError on malformed input
+ */
+void decodeGlobals(std::string_view in, size_t &pos, Assoc &env);
+
+#endif // SERIALIZE
@@ -0,0 +1,561 @@
+/**
+ * @file server.cpp
+ * @brief Unix socket server and prefork workers: sessions and framing
+ */
+
+#include "server.hpp"
+#include "interpreter.hpp"
+#include "threadpool.hpp"
+#include "wire.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+bool writeResponse(int fd, int status, uint32_t eval_us, const std::string &text) {
+    std::string frame;
+    frame.reserve(text.size() + 9);
+    putU32(frame, (uint32_t)(text.size() + 5));
+    frame.push_back((char)status);
+    putU32(frame, eval_us);
+    frame += text;
+    return writeFull(fd, frame.data(), frame.size());
+}
+
+uint32_t microsSince(Clock::time_point t0) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+}
+
+EvalLimits sessionLimits(const ServerOptions &opt) {
+    EvalLimits lim;
+    lim.max_steps = opt.max_steps;
+    lim.max_depth = opt.max_depth;
+    return lim;
+}
+
+// 先跑 main 给的 setup (内置 prelude, --image), 出错就不启动
+bool setUp(const ServerOptions &opt, Interpreter &interp) {
+    if (!opt.setup) return true;
+    try {
+        opt.setup(interp);
+        return true;
+    } catch (const RuntimeError &e) {
+        std::cerr << "code: " << e.message() << std::endl;
+        return false;
+    }
+}
+
+struct Session {
+    std::ostringstream out;
+    Interpreter interp;
+    const std::vector<Expr> *prelude;  ///< Replayed before the first request, or nullptr
+
+    // 线程化的服务器用: epoll 线程收进来的字节和已经凑齐的请求
+    std::mutex m;
+    std::string input;
+    std::deque<std::string> requests;
+    bool eof = false;
+
+    Session(const std::vector<Expr> *prelude, const ServerOptions &opt)
+        : interp(out, sessionLimits(opt)), prelude(prelude) {
+        if (opt.setup) opt.setup(interp);
+    }
+    Session(const Interpreter &base) : interp(base, out), prelude(nullptr) {}
+
+    /*
+    跑一个请求, 返回帧里的状态, 输出留在 out 里
+    */
+    int evaluate(const std::string &source) {
+        out.str("");
+        out.clear();
+        try {
+            if (prelude) {
+                interp.run(*prelude);
+                prelude = nullptr;
+                out.str("");
+            }
+            Reader in(source);
+            Interpreter::ReplResult r = interp.repl(in, false);
+            return r.exited ? 2 : r.errors ? 1 : 0;
+        } catch (const RuntimeError &) {
+            out << "RuntimeError\n";
+        } catch (const std::exception &e) {
+            out << e.what() << "\n";
+        }
+        return 1;
+    }
+};
+
+std::mutex log_mutex;
+
+void logRequest(const char *who, long id, size_t bytes, int status, uint32_t eval_us, uint32_t total_us) {
+    std::lock_guard<std::mutex> lk(log_mutex);
+    std::cerr << "serve: " << who << " " << id << " request " << bytes << " bytes, status " << status
+              << ", eval " << eval_us << "us, total " << total_us << "us" << std::endl;
+}
+
+// ============================================================================
+// Threaded server
+// ============================================================================
+
+struct Server {
+    ServerOptions opt;
+    std::vector<Expr> prelude;
+    int epfd = -1;
+    std::mutex sessions_mutex;
+    std::unordered_map<int, std::unique_ptr<Session>> sessions;
+
+    Session *lookup(int fd) {
+        std::lock_guard<std::mutex> lk(sessions_mutex);
+        auto it = sessions.find(fd);
+        return it == sessions.end() ? nullptr : it->second.get();
+    }
+
+    // 先删会话再关 fd: 关掉之后同一个编号可能马上被 accept 拿去用
+    void close(int fd) {
+        std::lock_guard<std::mutex> lk(sessions_mutex);
+        sessions.erase(fd);
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+    }
+
+    void rearm(int fd) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    bool receive(int fd);
+    void handle(int fd);
+    int run(int lfd);
+};
+
+/*
+一个连接同一时间只有一个请求在跑: 连接用 EPOLLONESHOT 注册,
+epoll 线程不阻塞地把能读的都读进会话, 凑齐了完整的请求才交给 worker,
+worker 把请求都处理完才重新挂回 epoll; 只发了半个请求的连接不占 worker
+返回 true 表示有请求要交给 worker
+*/
+bool Server::receive(int fd) {
+    Session *s = lookup(fd);
+    if (!s) return false;
+    char buf[1 << 14];
+    bool eof = false;
+    std::string received;
+    while (1) {
+        ssize_t k = recv(fd, buf, sizeof buf, MSG_DONTWAIT);
+        if (k > 0) {
+            received.append(buf, (size_t)k);
+            continue;
+        }
+        if (k < 0 && errno == EINTR) continue;
+        eof = !(k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+        break;
+    }
+    int got;
+    bool pending;
+    {
+        std::lock_guard<std::mutex> lk(s->m);
+        s->input += received;
+        std::string source;
+        while ((got = takeFrame(s->input, source)) == 1)
+            s->requests.push_back(std::move(source));
+        s->eof = eof;
+        pending = !s->requests.empty();
+    }
+    // 对方只关了写的一半时, 已经收齐的请求还是照常回复
+    if (got < 0 || (eof && !pending)) {
+        close(fd);
+        return false;
+    }
+    if (!pending) rearm(fd);
+    return pending;
+}
+
+void Server::handle(int fd) {
+    Session *s = lookup(fd);
+    if (!s) return;
+    while (1) {
+        std::string source;
+        {
+            std::lock_guard<std::mutex> lk(s->m);
+            if (s->requests.empty()) break;
+            source = std::move(s->requests.front());
+            s->requests.pop_front();
+        }
+        Clock::time_point t0 = Clock::now();
+        int status = s->evaluate(source);
+        uint32_t eval_us = microsSince(t0);
+        bool sent = writeResponse(fd, status, eval_us, s->out.str());
+        if (opt.log)
+            logRequest("fd", fd, source.size(), status, eval_us, microsSince(t0));
+        if (!sent || status == 2) {
+            close(fd);
+            return;
+        }
+    }
+    if (s->eof)
+        close(fd);
+    else
+        rearm(fd);
+}
+
+// 不读回复的客户端最多让 worker 在 send 上等这么久
+const int SEND_TIMEOUT_SEC = 10;
+
+int Server::run(int lfd) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+    ThreadPool pool(opt.workers);
+    epoll_event events[64];
+    while (1) {
+        int n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == lfd) {
+                int cfd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (cfd < 0) continue;
+                timeval tv{SEND_TIMEOUT_SEC, 0};
+                setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+                std::unique_ptr<Session> session;
+                try {
+                    session.reset(new Session(&prelude, opt));
+                } catch (const RuntimeError &e) {
+                    std::cerr << "code: " << e.message() << std::endl;
+                    ::close(cfd);
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> lk(sessions_mutex);
+                    sessions[cfd] = std::move(session);
+                }
+                epoll_event cev{};
+                cev.events = EPOLLIN | EPOLLONESHOT;
+                cev.data.fd = cfd;
+                epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
+            } else if (receive(fd)) {
+                Server *sv = this;
+                pool.submit([sv, fd]() {
+                    try {
+                        sv->handle(fd);
+                    } catch (...) {
+                        sv->close(fd);
+                    }
+                });
+            }
+        }
+    }
+    ::close(lfd);
+    return 1;
+}
+
+// ============================================================================
+// Prefork
+// ============================================================================
+
+// prefork 的父进程之后要 fork, 线程池不能在这里起来, 所以不并行读
+bool loadBase(const ServerOptions &opt, Interpreter &base) {
+    if (!setUp(opt, base)) return false;
+    if (opt.prelude.empty()) return true;
+    try {
+        base.load(opt.prelude, false);
+        return true;
+    } catch (const RuntimeError &e) {
+        std::cerr << "code: prelude " << opt.prelude << ": " << e.message() << std::endl;
+        return false;
+    }
+}
+
+/*
+fork 之前先把缓冲区里的东西写出去, 不然每个子进程都会再写一遍
+*/
+pid_t forkWorker() {
+    std::cout.flush();
+    std::cerr.flush();
+    return fork();
+}
+
+void serveConnection(int cfd, const Interpreter &base, bool log) {
+    Session s(base);
+    std::string source;
+    while (readFrame(cfd, source)) {
+        Clock::time_point t0 = Clock::now();
+        int status = s.evaluate(source);
+        uint32_t eval_us = microsSince(t0);
+        bool sent = writeResponse(cfd, status, eval_us, s.out.str());
+        if (log)
+            logRequest("pid", (long)getpid(), source.size(), status, eval_us, microsSince(t0));
+        if (!sent || status == 2) break;
+    }
+}
+
+/*
+每个进程一次服务一个连接, 多个进程在同一个监听 socket 上 accept
+会话在从 worker fork 出来的子进程里跑: set! 改到 prelude 的绑定、set-car! 改到 prelude 的数据
+都只改了子进程自己的页, 连接结束就没了, 下一个连接看到的还是准备好的样子
+*/
+void acceptLoop(int lfd, const Interpreter &base, bool log) {
+    while (1) {
+        int cfd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        pid_t pid = forkWorker();
+        if (pid == 0) {
+            close(lfd);
+            serveConnection(cfd, base, log);
+            _exit(0);
+        }
+        close(cfd);
+        if (pid < 0) continue;
+        while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+}
+
+int serveForked(const ServerOptions &opt, int lfd) {
+    std::ostringstream discard;
+    Interpreter base(discard);
+    if (!loadBase(opt, base)) return 1;
+    // 会话从 base 拷限制
+    base.limits() = sessionLimits(opt);
+
+    std::map<pid_t, bool> workers;
+    auto spawn = [&]() {
+        pid_t pid = forkWorker();
+        if (pid == 0) {
+            acceptLoop(lfd, base, opt.log);
+            _exit(0);
+        }
+        if (pid > 0) workers[pid] = true;
+    };
+    for (unsigned i = 0; i < opt.workers; i++) spawn();
+
+    // 被信号杀掉的 worker 换一个新的顶上
+    int st;
+    pid_t pid;
+    while ((pid = waitpid(-1, &st, 0)) > 0 || (pid < 0 && errno == EINTR)) {
+        if (pid < 0) continue;
+        workers.erase(pid);
+        if (WIFSIGNALED(st)) spawn();
+        if (workers.empty()) break;
+    }
+    close(lfd);
+    return 1;
+}
+
+struct Worker {
+    pid_t pid;
+    int fd;
+    long job = -1;   ///< Index of the script being run, -1 when idle
+};
+
+bool runScript(int fd, const std::string &path, const Interpreter &base) {
+    std::ostringstream os;
+    int status = 0;
+    Reader in(std::string_view{});
+    if (!in.open(path)) {
+        status = 1;
+    } else {
+        try {
+            Interpreter job(base, os);
+            job.repl(in, false);
+        } catch (const std::exception &e) {
+            os << "\n" << e.what() << "\n";
+            status = 1;
+        }
+    }
+    return writeResponse(fd, status, 0, os.str());
+}
+
+// 子进程: 从 socketpair 收脚本路径, 回复 状态 + 输出; 和 acceptLoop 一样每个脚本在自己 fork 出的进程里跑
+void scriptLoop(int fd, const Interpreter &base) {
+    std::string path;
+    while (readFrame(fd, path)) {
+        pid_t pid = forkWorker();
+        if (pid == 0)
+            _exit(runScript(fd, path, base) ? 0 : 1);
+        int st = 0;
+        while (pid > 0 && waitpid(pid, &st, 0) < 0 && errno == EINTR) {}
+        // 脚本把进程弄崩了也要回一个失败, 不然父进程一直等这个任务
+        if (pid < 0 || !WIFEXITED(st)) {
+            if (!writeResponse(fd, 1, 0, "")) return;
+        } else if (WEXITSTATUS(st) != 0) {
+            return;
+        }
+    }
+}
+
+} // namespace
+
+int serveUnixSocket(const ServerOptions &opt) {
+    int lfd = listenUnix(opt.socket_path);
+    if (lfd < 0) return 1;
+    if (opt.prefork)
+        return serveForked(opt, lfd);
+
+    Server server;
+    server.opt = opt;
+    // prelude 只解析一次, 每个新会话把解析好的表达式再求值一遍;
+    // 解析用的环境和会话一样先跑过 setup
+    std::ostringstream discard;
+    Interpreter scratch(discard);
+    if (!setUp(opt, scratch)) {
+        close(lfd);
+        return 1;
+    }
+    if (!opt.prelude.empty()) {
+        try {
+            scratch.load(opt.prelude, server.prelude);
+        } catch (const RuntimeError &e) {
+            std::cerr << "code: prelude " << opt.prelude << ": " << e.message() << std::endl;
+            close(lfd);
+            return 1;
+        }
+    }
+    return server.run(lfd);
+}
+
+/*
+父进程只做分发: 从 stdin 读路径, 交给空闲的 worker, 结果按输入顺序写到 stdout
+*/
+int dispatchPrefork(const ServerOptions &opt) {
+    std::ostringstream discard;
+    Interpreter base(discard);
+    if (!loadBase(opt, base)) return 1;
+
+    std::vector<Worker> workers;
+    for (unsigned i = 0; i < std::max(1u, opt.workers); i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) break;
+        pid_t pid = forkWorker();
+        if (pid == 0) {
+            close(sv[0]);
+            for (Worker &w : workers) close(w.fd);
+            scriptLoop(sv[1], base);
+            _exit(0);
+        }
+        close(sv[1]);
+        if (pid < 0) {
+            close(sv[0]);
+            break;
+        }
+        workers.push_back(Worker{pid, sv[0]});
+    }
+    if (workers.empty()) {
+        std::cerr << "code: cannot start workers" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> paths;            // 所有读到的路径, 下标就是任务号
+    size_t next_job = 0, next_out = 0;
+    std::map<size_t, std::pair<int, std::string>> results;
+    std::string pending;
+    bool eof = false;
+    int status = 0;
+    size_t busy = 0;
+
+    while (1) {
+        for (Worker &w : workers) {
+            if (w.job >= 0 || w.fd < 0 || next_job >= paths.size()) continue;
+            std::string frame;
+            putU32(frame, (uint32_t)paths[next_job].size());
+            frame += paths[next_job];
+            if (!writeFull(w.fd, frame.data(), frame.size())) {
+                close(w.fd);
+                w.fd = -1;
+                continue;
+            }
+            w.job = (long)next_job++;
+            busy++;
+        }
+        for (auto it = results.find(next_out); it != results.end(); it = results.find(next_out)) {
+            std::cout << it->second.second;
+            std::cout.flush();
+            if (it->second.first != 0) {
+                std::cerr << "code: failed to run " << paths[next_out] << std::endl;
+                status = 1;
+            }
+            results.erase(it);
+            next_out++;
+        }
+        if (eof && busy == 0 && next_job >= paths.size()) break;
+        if (busy == 0 && next_job < paths.size()) {
+            std::cerr << "code: all workers exited" << std::endl;
+            return 1;
+        }
+
+        std::vector<pollfd> fds;
+        if (!eof) fds.push_back(pollfd{0, POLLIN, 0});
+        for (Worker &w : workers)
+            if (w.job >= 0) fds.push_back(pollfd{w.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (pollfd &p : fds) {
+            if (!p.revents) continue;
+            if (p.fd == 0) {
+                char buf[4096];
+                ssize_t k = read(0, buf, sizeof(buf));
+                if (k <= 0) {
+                    eof = true;
+                    k = 0;
+                }
+                pending.append(buf, (size_t)k);
+                size_t nl;
+                while ((nl = pending.find('\n')) != std::string::npos || (eof && !pending.empty())) {
+                    if (nl == std::string::npos) nl = pending.size();
+                    std::string line = pending.substr(0, nl);
+                    pending.erase(0, std::min(nl + 1, pending.size()));
+                    if (!line.empty()) paths.push_back(line);
+                }
+                continue;
+            }
+            for (Worker &w : workers) {
+                if (w.fd != p.fd || w.job < 0) continue;
+                std::string reply;
+                if (readFrame(w.fd, reply) && reply.size() >= 5)
+                    results[(size_t)w.job] = {reply[0], reply.substr(5)};
+                else {
+                    // worker 死了: 这个任务算失败, 之后不再用它
+                    results[(size_t)w.job] = {1, ""};
+                    close(w.fd);
+                    w.fd = -1;
+                }
+                w.job = -1;
+                busy--;
+            }
+        }
+    }
+
+    for (Worker &w : workers) {
+        if (w.fd >= 0) close(w.fd);
+        waitpid(w.pid, nullptr, 0);
+    }
+    return status;
+}
@@ -0,0 +1,74 @@
+#ifndef SERVER
+#define SERVER
+
+/**
+ * @file server.hpp
+ * @brief Evaluation server on a Unix domain socket (code --serve path)
+ *
+ * Every connection is a session with its own global environment. A prelude
+ * file is parsed once at startup; each new session re-evaluates the parsed
+ * forms, which is cheap since they are mostly definitions. Requests are
+ * evaluated on a pool of worker threads, one request per connection at a
+ * time.
+ *
+ * With prefork, the prelude is instead evaluated once in the parent, which
+ * then forks the workers. They inherit the prepared environment through
+ * copy-on-write pages. A worker serves each connection in a child forked
+ * for it, so whatever a session mutates, including the prelude's
+ * bindings, is gone when the connection ends; a new session costs a fork
+ * of an already prepared process. Pool threads do not survive fork, so the
+ * parent reads the prelude without the thread pool, and the prelude must
+ * not use futures or --parallel-args itself.
+ *
+ * Requests are gathered without blocking as they arrive, so a client that
+ * sends part of a frame ties up no worker. Sessions run under step and
+ * depth limits (see EvalLimits); a request that exceeds them fails with
+ * status 1 and the session stays usable.
+ *
+ * Framing (all integers big-endian):
+ *   request:  u32 length, then length bytes of Scheme source
+ *   response: u32 length, then u8 status, u32 evaluation time in
+ *             microseconds and the REPL output of the source (no prompts)
+ * Status is 0 on success, 1 if some form raised an error and 2 if the
+ * source called (exit); the server closes the connection after status 2.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class Interpreter;
+
+struct ServerOptions {
+    std::string socket_path;
+    std::string prelude;     ///< Loaded into every session; empty for none
+    unsigned workers = 1;    ///< Threads, or processes with prefork
+    bool prefork = false;
+    bool log = true;         ///< Per-request latency lines on stderr
+    uint64_t max_steps = 100000000;   ///< Procedure calls per form; 0 for no limit
+    size_t max_depth = 10000;         ///< Nested calls; 0 for no limit
+
+    /**
+     * @brief Run on every interpreter the server creates from scratch, before
+     * the prelude is loaded (code installs its built-in prelude here)
+     * A RuntimeError from it at startup stops the server; later, it only
+     * refuses the connection.
+     */
+    std::function<void(Interpreter &)> setup;
+};
+
+/**
+ * @brief Serves until the process is killed
+ * @return nonzero if the socket or the prelude could not be set up
+ */
+int serveUnixSocket(const ServerOptions &);
+
+/**
+ * @brief Runs the script paths read from stdin, one per line, on forked workers
+ * Outputs are written to stdout in input order, as with --batch.
+ * @return 1 if the prelude or some script could not be read
+ */
+int dispatchPrefork(const ServerOptions &);
+
+#endif // SERVER
@@ -1,11 +1,53 @@
 #include "syntax.hpp"
+#include "RE.hpp"
+#include "threadpool.hpp"
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <thread>
 #include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-Syntax::Syntax(SyntaxBase *stx) : ptr(stx) {}
+thread_local Arena *SyntaxBase::arena = nullptr;
+
+Syntax::Syntax(SyntaxBase *stx) : ptr(Arena::wrap(stx)) {}
 SyntaxBase* Syntax::operator->() const { return ptr.get(); }
 SyntaxBase& Syntax::operator*() { return *ptr; }
 SyntaxBase* Syntax::get() const { return ptr.get(); }
+Syntax Syntax::retained() const {
+  Syntax r(nullptr);
+  r.ptr = Arena::retain(ptr);
+  return r;
+}
+
+Syntax copySyntax(const Syntax &stx) {
+  Arena::Scope heap(SyntaxBase::arena, nullptr);
+  SyntaxBase *b = stx.get();
+  if (auto *n = dynamic_cast<Number*>(b)) return Syntax(new Number(n->n));
+  if (auto *r = dynamic_cast<RationalSyntax*>(b)) return Syntax(new RationalSyntax(r->numerator, r->denominator));
+  if (dynamic_cast<TrueSyntax*>(b)) return Syntax(new TrueSyntax());
+  if (dynamic_cast<FalseSyntax*>(b)) return Syntax(new FalseSyntax());
+  if (auto *y = dynamic_cast<SymbolSyntax*>(b)) return Syntax(new SymbolSyntax(y->s));
+  if (auto *t = dynamic_cast<StringSyntax*>(b)) return Syntax(new StringSyntax(t->s));
+  List *src = static_cast<List*>(b);
+  List *lst = new List();
+  Syntax res(lst);
+  lst->stxs.reserve(src->stxs.size());
+  for (const Syntax &item : src->stxs)
+    lst->stxs.push_back(copySyntax(item));
+  return res;
+}
 
 Number::Number(int n) : n(n) {}
 void Number::show(std::ostream &os) {
@@ -38,53 +80,150 @@ void StringSyntax::show(std::ostream &os) {
 List::List() {}
 void List::show(std::ostream &os) {
     os << '(';
-    for (auto stx : stxs) {
+    for (const Syntax &stx : stxs) {
         stx->show(os);
         os << ' ';
     }
     os << ')';
 }
 
-std::istream &readSpace(std::istream &is) {
-  while (true) {
-    // 跳过空白字符
-    while (isspace(is.peek()))
-      is.get();
-    
-    // 检查是否是注释
-    if (is.peek() == ';') {
-      // 跳过注释直到行末
-      while (is.peek() != '\n' && is.peek() != EOF)
-        is.get();
-      // 继续循环以跳过注释后的空白字符
-    } else {
-      // 没有更多空白字符或注释，退出循环
-      break;
+namespace {
+
+enum : unsigned char { C_SPACE = 1, C_DELIM = 2 };
+
+// 空白和结束一个记号的字符; 按 unsigned char 查, 非 ASCII 字节都是普通字符
+struct CharClass {
+    unsigned char t[256] = {};
+    CharClass() {
+        for (unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'}) t[c] = C_SPACE | C_DELIM;
+        for (unsigned char c : {'(', ')', '[', ']', ';'}) t[c] = C_DELIM;
+    }
+};
+const CharClass char_class;
+
+inline bool isSpace(char c) { return char_class.t[(unsigned char)c] & C_SPACE; }
+inline bool isDelim(char c) { return char_class.t[(unsigned char)c] & C_DELIM; }
+
+// 读到缓冲区末尾但输入还没完: 补一块再从这个表达式开头重读
+struct NeedMore {};
+
+const size_t BLOCK_SIZE = 1 << 16;
+
+// 流水线的读线程等输入时也等停止信号, 这样交互输入上 (exit) 之后不会卡住
+bool waitInput(int fd, int wake) {
+  pollfd p[2] = {{fd, POLLIN, 0}, {wake, POLLIN, 0}};
+  while (poll(p, 2, -1) < 0)
+    if (errno != EINTR) return true;
+  return !(p[1].revents & POLLIN);
+}
+
+// 小于这个的输入不分块, 分块读的启动开销不值得
+const size_t PARALLEL_MIN = 1 << 20;
+const size_t CHUNK_SIZE = 1 << 18;
+
+/*
+在顶层表达式之间找切点, 每段至少 target 字节, 只切在深度为 0 的换行后面
+字符串、注释和 ' 的处理和 item() 一致: 只有在一项开头的 " 才开始字符串,
+符号中间的 " 和 ' 都只是普通字符; 多余的 ) 和 item() 一样不计深度
+*/
+std::vector<size_t> splitTopLevel(const char *s, size_t len, size_t target) {
+  std::vector<size_t> ends;
+  size_t start = 0;
+  size_t depth = 0;
+  bool at_item = true;
+  size_t i = 0;
+  while (i < len) {
+    char c = s[i];
+    if (c == '"' && at_item) {
+      i++;
+      while (i < len && s[i] != '"')
+        i += s[i] == '\\' ? 2 : 1;
+      i++;
+      continue;
+    }
+    if (c == ';') {
+      const char *nl = static_cast<const char*>(memchr(s + i, '\n', len - i));
+      i = nl ? (size_t)(nl - s) : len;
+      at_item = true;
+      continue;
     }
+    if (c == '(' || c == '[') {
+      depth++;
+    } else if (c == ')' || c == ']') {
+      if (depth > 0) depth--;
+    } else if (c == '\n' && depth == 0 && i + 1 - start >= target) {
+      ends.push_back(i + 1);
+      start = i + 1;
+    }
+    if (isDelim(c))
+      at_item = true;
+    else if (c != '\'')
+      at_item = false;
+    i++;
   }
-  return is;
+  if (start < len)
+    ends.push_back(len);
+  return ends;
 }
 
-Syntax readList(std::istream &is);
+} // namespace
+
+// 读好的一个表达式, 或者读它时的错误
+struct Reader::Form {
+  Syntax stx;
+  std::exception_ptr error;
+};
+
+struct Reader::Pipeline {
+  std::mutex m;
+  std::condition_variable ready;  ///< Queue got an item, or input ended
+  std::condition_variable room;   ///< Queue has space, or stop was asked
+  std::deque<Form> queue;
+  size_t depth = 1;
+  bool done = false;              ///< Reader thread saw the end and exited
+  bool stop = false;
+  bool reader_waiting = false;
+  bool caller_waiting = false;
+  int wake[2] = {-1, -1};
+  std::thread thread;
+};
+
+/*
+分块读: 每块交给线程池读成一串 Form, 最多 window 块同时在读,
+调用方按顺序取; 等前面一块时也帮线程池干活
+*/
+struct Reader::Chunks {
+  struct Chunk {
+    std::vector<Form> forms;
+    std::exception_ptr error;      ///< The chunk could not be read at all
+    std::atomic<bool> done{false};
+  };
+  std::vector<size_t> ends;        ///< End offset of every chunk
+  size_t begin = 0;                ///< Start of the next chunk to submit
+  size_t submitted = 0;
+  size_t window = 1;
+  std::deque<std::shared_ptr<Chunk>> reading;  ///< Front is the chunk being served
+  size_t next = 0;                 ///< Next form of the front chunk
+};
 
 // Helper function to try parsing as integer or rational
-bool tryParseNumber(const std::string &s, int &result) {
+bool tryParseNumber(std::string_view s, int &result) {
   bool neg = false;
   int n = 0;
-  int i = 0;
-  
+  size_t i = 0;
+
   // Single '+' or '-' are not numbers
   if (s.size() == 1 && (s[0] == '+' || s[0] == '-'))
     return false;
-  
+
   // Handle sign
-  if (s[0] == '-') {
+  if (!s.empty() && s[0] == '-') {
     i += 1;
     neg = true;
-  } else if (s[0] == '+') {
+  } else if (!s.empty() && s[0] == '+') {
     i += 1;
   }
-  
+
   // Check if all remaining characters are digits
   for (; i < s.size(); i++) {
     if ('0' <= s[i] && s[i] <= '9') {
@@ -93,132 +232,476 @@ bool tryParseNumber(const std::string &s, int &result) {
       return false;  // Not a valid number
     }
   }
-  
+
   result = neg ? -n : n;
   return true;
 }
 
 // Helper function to try parsing as rational number
-bool tryParseRational(const std::string &s, int &numerator, int &denominator) {
+bool tryParseRational(std::string_view s, int &numerator, int &denominator) {
   size_t slash_pos = s.find('/');
-  if (slash_pos == std::string::npos || slash_pos == 0 || slash_pos == s.size() - 1) {
+  if (slash_pos == std::string_view::npos || slash_pos == 0 || slash_pos == s.size() - 1) {
     return false; // No slash or slash at beginning/end
   }
-  
-  std::string num_str = s.substr(0, slash_pos);
-  std::string den_str = s.substr(slash_pos + 1);
-  
+
   // Parse numerator (can be negative)
-  if (!tryParseNumber(num_str, numerator)) {
+  if (!tryParseNumber(s.substr(0, slash_pos), numerator)) {
     return false;
   }
-  
+
   // Parse denominator (must be positive)
-  if (!tryParseNumber(den_str, denominator) || denominator <= 0) {
+  if (!tryParseNumber(s.substr(slash_pos + 1), denominator) || denominator <= 0) {
     return false;
   }
-  
+
   return true;
 }
 
 // Helper function to create identifier/symbol syntax
-Syntax createIdentifierSyntax(const std::string &s) {
+static Syntax atomSyntax(std::string_view s) {
+  int numerator, denominator;
+  if (tryParseRational(s, numerator, denominator))
+    return Syntax(new RationalSyntax(numerator, denominator));
+  int number_value;
+  if (tryParseNumber(s, number_value))
+    return Syntax(new Number(number_value));
   if (s == "#t")
     return Syntax(new TrueSyntax());
   if (s == "#f")
     return Syntax(new FalseSyntax());
-  return Syntax(new SymbolSyntax(s));
+  return Syntax(new SymbolSyntax(std::string(s)));
 }
 
-// no leading space
-Syntax readItem(std::istream &is) {
-  if (is.peek() == '(' || is.peek() == '[') {
-    is.get();
-    return readList(is);
+Reader::Reader(std::string_view text) : data(text.data()), len(text.size()) {}
+
+Reader::Reader(std::istream &in) : data(nullptr), len(0), eof(false), in(&in) {}
+
+Reader::Reader(int fd) : data(nullptr), len(0), eof(false), fd(fd) {}
+
+Reader::~Reader() {
+  stopPipeline();
+  stopChunks();
+  release();
+}
+
+void Reader::release() {
+  if (map) munmap(map, map_len);
+  if (own_fd) close(fd);
+  map = nullptr;
+  own_fd = false;
+  fd = -1;
+  in = nullptr;
+}
+
+/*
+普通文件整个映射进来, 一次就是全部输入
+映射不了的 (空文件、管道之类) 退回到按块读
+*/
+bool Reader::open(const std::string &path) {
+  stopPipeline();
+  stopChunks();
+  release();
+  int f = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (f < 0)
+    return false;
+  struct stat st;
+  if (fstat(f, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+    if (m != MAP_FAILED) {
+      close(f);
+      madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+      map = m;
+      map_len = (size_t)st.st_size;
+      data = static_cast<const char*>(m);
+      len = map_len;
+      pos = 0;
+      eof = true;
+      return true;
+    }
+  }
+  block.clear();
+  data = block.data();
+  len = pos = 0;
+  fd = f;
+  own_fd = true;
+  eof = false;
+  return true;
+}
+
+/*
+丢掉已经读完的部分, 再读至少一块; 未读完的部分很长时 (一个很大的表达式) 按它的长度读,
+这样重读的总量和表达式长度成线性关系
+*/
+bool Reader::refill() {
+  if (eof)
+    return false;
+  // 开了流水线时 refill 在读线程上, 由 waitForm 在调用者线程上刷
+  if (flush_out && !pipe)
+    flush_out->flush();
+  block.erase(0, pos);
+  pos = 0;
+  size_t want = block.size() > BLOCK_SIZE ? block.size() : BLOCK_SIZE;
+  size_t old = block.size();
+  block.resize(old + want);
+  size_t got = 0;
+  while (got < want) {
+    ssize_t k;
+    if (in) {
+      in->read(&block[old + got], (std::streamsize)(want - got));
+      k = in->gcount();
+      if (k == 0 && !in->eof() && in->fail()) k = -1;
+    } else if (wake >= 0 && !waitInput(fd, wake)) {
+      k = 0;
+    } else {
+      k = ::read(fd, &block[old + got], want - got);
+      if (k < 0 && errno == EINTR) continue;
+    }
+    if (k <= 0) {
+      eof = true;
+      break;
+    }
+    got += (size_t)k;
+    // 终端和管道读到多少算多少, 别为了凑满一块卡住交互输入
+    if (!in) break;
   }
-  if (is.peek() == '\'')
+  block.resize(old + got);
+  data = block.data();
+  len = block.size();
+  return got > 0 || !eof;
+}
+
+size_t Reader::skipSpace(size_t i) {
+  while (1) {
+    while (i < len && isSpace(data[i]))
+      i++;
+    if (i < len && data[i] == ';') {
+      const char *nl = static_cast<const char*>(memchr(data + i, '\n', len - i));
+      i = nl ? (size_t)(nl - data) : len;
+      continue;
+    }
+    if (i == len && !eof)
+      throw NeedMore();
+    return i;
+  }
+}
+
+/*
+读线程一直读到输入结束或者被叫停, 队列满了就等; 读错了把异常放进队列,
+由 read() 在同样的位置抛出
+满了要等取走一半才叫醒读线程, 空了才叫醒调用方, 两边按批交接而不是一个一个切换
+*/
+void Reader::pipeline(size_t depth) {
+  if (pipe || chunks)
+    return;
+  pipe.reset(new Pipeline);
+  Pipeline *p = pipe.get();
+  p->depth = depth ? depth : 1;
+  if (pipe2(p->wake, O_CLOEXEC) == 0)
+    wake = p->wake[0];
+  p->thread = std::thread([this, p] {
+    while (1) {
+      Syntax stx(nullptr);
+      std::exception_ptr error;
+      bool end = false;
+      try {
+        end = scanEnd();
+        if (!end) stx = readForm();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::unique_lock<std::mutex> lk(p->m);
+      while (!end && !p->stop && p->queue.size() >= p->depth) {
+        p->reader_waiting = true;
+        p->room.wait(lk);
+        p->reader_waiting = false;
+      }
+      if (end || p->stop) {
+        p->done = true;
+        p->ready.notify_all();
+        return;
+      }
+      p->queue.push_back({stx, error});
+      if (p->caller_waiting)
+        p->ready.notify_one();
+    }
+  });
+}
+
+void Reader::stopPipeline() {
+  if (!pipe)
+    return;
   {
-    is.get();
-    // 读取单引号后的语法元素
-    Syntax quoted_syntax = readItem(is);
-    
-    // 创建 (quote <syntax>) 的列表结构
-    List *quote_list = new List();
-    quote_list->stxs.push_back(Syntax(new SymbolSyntax("quote")));
-    quote_list->stxs.push_back(quoted_syntax);
-    
-    return Syntax(quote_list);
+    std::lock_guard<std::mutex> lk(pipe->m);
+    pipe->stop = true;
   }
-  // 处理字符串字面量
-  if (is.peek() == '"') {
-    is.get(); // 消费开始的双引号
-    std::string str;
-    while (is.peek() != '"' && is.peek() != EOF) {
-      char c = is.get();
-      if (c == '\\') {
-        // 处理转义字符
-        char next = is.get();
-        switch (next) {
-          case 'n': str.push_back('\n'); break;
-          case 't': str.push_back('\t'); break;
-          case 'r': str.push_back('\r'); break;
-          case '\\': str.push_back('\\'); break;
-          case '"': str.push_back('"'); break;
-          default: str.push_back(next); break;
+  pipe->room.notify_all();
+  if (pipe->wake[1] >= 0) {
+    char c = 0;
+    ssize_t k = ::write(pipe->wake[1], &c, 1);
+    (void)k;
+  }
+  pipe->thread.join();
+  for (int f : pipe->wake)
+    if (f >= 0) close(f);
+  wake = -1;
+  pipe.reset();
+}
+
+void Reader::parallel() {
+  if (pipe || chunks || !eof || len - pos < PARALLEL_MIN || ThreadPool::globalWorkers() <= 1)
+    return;
+  chunks.reset(new Chunks);
+  Chunks &c = *chunks;
+  c.ends = splitTopLevel(data + pos, len - pos, CHUNK_SIZE);
+  for (size_t &e : c.ends)
+    e += pos;
+  c.begin = pos;
+  c.window = 2 * (size_t)ThreadPool::global().size();
+  pos = len;
+  submitChunks();
+}
+
+void Reader::submitChunks() {
+  Chunks &c = *chunks;
+  while (c.reading.size() < c.window && c.submitted < c.ends.size()) {
+    std::shared_ptr<Chunks::Chunk> chunk = std::make_shared<Chunks::Chunk>();
+    std::string_view text(data + c.begin, c.ends[c.submitted] - c.begin);
+    c.begin = c.ends[c.submitted++];
+    c.reading.push_back(chunk);
+    ThreadPool::global().submit([chunk, text] {
+      try {
+        Reader sub(text);
+        while (!sub.atEnd()) {
+          Form f{Syntax(nullptr), nullptr};
+          try {
+            f.stx = sub.read();
+          } catch (...) {
+            f.error = std::current_exception();
+          }
+          chunk->forms.push_back(std::move(f));
         }
-      } else {
-        str.push_back(c);
+      } catch (...) {
+        chunk->error = std::current_exception();
       }
+      chunk->done.store(true, std::memory_order_release);
+    });
+  }
+}
+
+// 等到下一个表达式所在的块读完; 没有下一个了返回 true
+bool Reader::chunkEnd() {
+  Chunks &c = *chunks;
+  ThreadPool &pool = ThreadPool::global();
+  while (!c.reading.empty()) {
+    Chunks::Chunk &front = *c.reading.front();
+    while (!front.done.load(std::memory_order_acquire))
+      if (!pool.runPending()) std::this_thread::yield();
+    if (front.error) {
+      front.forms.push_back({Syntax(nullptr), front.error});
+      front.error = nullptr;
     }
-    if (is.peek() == '"') {
-      is.get(); // 消费结束的双引号
-    }
-    return Syntax(new StringSyntax(str));
+    if (c.next < front.forms.size())
+      return false;
+    c.reading.pop_front();
+    c.next = 0;
+    submitChunks();
   }
-  
-  // Read token
-  std::string s;
-  do {
-    int c = is.peek();
-    if (c == '(' || c == ')' ||
-        c == '[' || c == ']' || 
-        c == ';' ||  // 添加分号作为分隔符
-        isspace(c) ||
-        c == EOF)
-      break;
-    is.get();
-    s.push_back(c);
-  } while (true);
-  
-  // Try parsing as rational first
-  int numerator, denominator;
-  if (tryParseRational(s, numerator, denominator)) {
-    return Syntax(new RationalSyntax(numerator, denominator));
+  return true;
+}
+
+// 已经交出去的块还在读这块缓冲区, 等它们读完才能解除映射
+void Reader::stopChunks() {
+  if (!chunks)
+    return;
+  ThreadPool &pool = ThreadPool::global();
+  for (auto &chunk : chunks->reading)
+    while (!chunk->done.load(std::memory_order_acquire))
+      if (!pool.runPending()) std::this_thread::yield();
+  chunks.reset();
+}
+
+bool Reader::atEnd() {
+  if (chunks)
+    return chunkEnd();
+  if (!pipe)
+    return scanEnd();
+  std::unique_lock<std::mutex> lk(pipe->m);
+  waitForm(lk);
+  return pipe->queue.empty();
+}
+
+void Reader::waitForm(std::unique_lock<std::mutex> &lk) {
+  if (flush_out && pipe->queue.empty() && !pipe->done) {
+    lk.unlock();
+    flush_out->flush();
+    lk.lock();
   }
-  
-  // Try parsing as integer
-  int number_value;
-  if (tryParseNumber(s, number_value)) {
-    return Syntax(new Number(number_value));
+  while (pipe->queue.empty() && !pipe->done) {
+    pipe->caller_waiting = true;
+    pipe->ready.wait(lk);
+    pipe->caller_waiting = false;
+  }
+}
+
+Syntax Reader::read() {
+  if (chunks) {
+    if (chunkEnd())
+      return readForm();
+    Form it = std::move(chunks->reading.front()->forms[chunks->next++]);
+    if (it.error)
+      std::rethrow_exception(it.error);
+    return it.stx;
+  }
+  if (!pipe)
+    return readForm();
+  Form it{Syntax(nullptr), nullptr};
+  bool wake_reader;
+  {
+    std::unique_lock<std::mutex> lk(pipe->m);
+    waitForm(lk);
+    // 读线程已经退出, 剩下的这次在本线程读, 和不开流水线时一样
+    if (pipe->queue.empty()) {
+      lk.unlock();
+      return readForm();
+    }
+    it = std::move(pipe->queue.front());
+    pipe->queue.pop_front();
+    wake_reader = pipe->reader_waiting && pipe->queue.size() <= pipe->depth / 2;
   }
-  
-  // Not a number, treat as identifier/symbol
-  return createIdentifierSyntax(s);
+  if (wake_reader)
+    pipe->room.notify_one();
+  if (it.error)
+    std::rethrow_exception(it.error);
+  return it.stx;
 }
 
-Syntax readList(std::istream &is) {
-    List *stx = new List();
-    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ')')
-        stx->stxs.push_back(readItem(is));
-    is.get(); // ')'
-    return Syntax(stx);
+bool Reader::scanEnd() {
+  while (1) {
+    try {
+      pos = skipSpace(pos);
+      return pos == len;
+    } catch (NeedMore &) {
+      refill();
+    }
+  }
 }
 
-Syntax readSyntax(std::istream &is) {
-  return readItem(readSpace(is));
+// 每个顶层表达式一个 arena, 解析完没人留着它就整块释放
+Syntax Reader::readForm() {
+  while (1) {
+    size_t i = pos;
+    std::shared_ptr<Arena> nodes = Arena::make<SyntaxBase>();
+    Arena::Scope scope(SyntaxBase::arena, nodes.get());
+    try {
+      Syntax stx = item(i);
+      pos = i;
+      return stx.retained();
+    } catch (NeedMore &) {
+      refill();
+    } catch (const RuntimeError &) {
+      pos = i;
+      throw;
+    }
+  }
+}
+
+// no leading space
+Syntax Reader::item(size_t &i) {
+  if (i == len) {
+    if (!eof)
+      throw NeedMore();
+    return atomSyntax(std::string_view());
+  }
+  char c = data[i];
+  if (c == ')' || c == ']') {
+    i++;
+    throw RuntimeError("Unexpected )");
+  }
+  if (c == '(' || c == '[') {
+    i++;
+    return list(i);
+  }
+  if (c == '\'') {
+    i++;
+    // 创建 (quote <syntax>) 的列表结构
+    List *quote_list = new List();
+    Syntax stx(quote_list);
+    quote_list->stxs.push_back(Syntax(new SymbolSyntax("quote")));
+    quote_list->stxs.push_back(item(i));
+    return stx;
+  }
+  // 字符串字面量: 没有转义的一段直接整段拷贝
+  if (c == '"') {
+    i++;
+    std::string str;
+    while (1) {
+      size_t j = i;
+      while (j < len && data[j] != '"' && data[j] != '\\')
+        j++;
+      str.append(data + i, j - i);
+      i = j;
+      if (i == len) {
+        if (!eof)
+          throw NeedMore();
+        break;
+      }
+      if (data[i] == '"') {
+        i++;
+        break;
+      }
+      if (i + 1 == len) {
+        if (!eof)
+          throw NeedMore();
+        i++;
+        break;
+      }
+      char next = data[i + 1];
+      i += 2;
+      switch (next) {
+        case 'n': str.push_back('\n'); break;
+        case 't': str.push_back('\t'); break;
+        case 'r': str.push_back('\r'); break;
+        case 'x': {
+          // \x41; 按十六进制给出字符, write 这样写其他控制字符
+          size_t k = i;
+          while (k < len && isxdigit((unsigned char)data[k]))
+            k++;
+          if (k == len && !eof)
+            throw NeedMore();
+          if (k > i && k < len && data[k] == ';') {
+            str.push_back((char)strtoul(std::string(data + i, k - i).c_str(), nullptr, 16));
+            i = k + 1;
+          } else {
+            str.push_back('x');
+          }
+          break;
+        }
+        default: str.push_back(next); break;
+      }
+    }
+    return Syntax(new StringSyntax(str));
+  }
+  size_t j = i;
+  while (j < len && !isDelim(data[j]))
+    j++;
+  if (j == len && !eof)
+    throw NeedMore();
+  std::string_view token(data + i, j - i);
+  i = j;
+  return atomSyntax(token);
 }
 
-std::istream &operator>>(std::istream &is, Syntax &stx) {
-  stx = readSyntax(is);
-  return is;
+Syntax Reader::list(size_t &i) {
+  List *lst = new List();
+  Syntax stx(lst);
+  while (1) {
+    i = skipSpace(i);
+    if (i == len)
+      throw RuntimeError("Unexpected end of input");
+    if (data[i] == ')' || data[i] == ']') {
+      i++;
+      return stx;
+    }
+    lst->stxs.push_back(item(i));
+  }
 }
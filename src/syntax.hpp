@@ -3,13 +3,22 @@
 
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <vector>
 #include "Def.hpp"
+#include "arena.hpp"
 
 struct SyntaxBase {
     virtual Expr parse(Assoc &) = 0;
     virtual void show(std::ostream &) = 0;
     virtual ~SyntaxBase() = default;
+
+    /** @brief Arena new syntax nodes go to on this thread (see arena.hpp), or nullptr */
+    static thread_local Arena *arena;
+    static void *operator new(size_t n) { return Arena::allocate(arena, n); }
+    static void operator delete(void *p) { Arena::release(p); }
 };
 
 struct Syntax {
@@ -19,8 +28,16 @@ struct Syntax {
     SyntaxBase& operator*();
     SyntaxBase* get() const;
     Expr parse(Assoc &);
+    /** @brief Same node, keeping its arena alive */
+    Syntax retained() const;
 };
 
+/**
+ * @brief Deep copy of a syntax tree on the heap
+ * Used by quote, so a quoted datum does not keep its whole form's arena.
+ */
+Syntax copySyntax(const Syntax &);
+
 struct Number : SyntaxBase {
     int n;
     Number(int);
@@ -69,7 +86,103 @@ struct List : SyntaxBase {
     virtual void show(std::ostream &) override;
 };
 
-Syntax readSyntax(std::istream &);
+/**
+ * @brief Reads syntax out of one contiguous buffer
+ *
+ * Files are mmap'd. Streams and file descriptors are read in large blocks,
+ * and a form that runs past the end of a block is re-read once more input
+ * has arrived, so an interactive stdin still works one form at a time.
+ * Characters are classified through a table and tokens are string_views
+ * into the buffer; only symbols and strings are copied, into their nodes.
+ */
+class Reader {
+public:
+    explicit Reader(std::string_view text);   ///< text must outlive the reader
+    explicit Reader(std::istream &in);
+    explicit Reader(int fd);
+    ~Reader();
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    /**
+     * @brief Reads from the file at path instead, mmap'ing it when possible
+     * @return false if the file cannot be opened
+     */
+    bool open(const std::string &path);
+
+    /**
+     * @brief Reads ahead on a thread of its own from now on
+     * Up to depth forms are read into a queue while the caller evaluates;
+     * read() then takes them in order, rethrowing read errors in place.
+     * Only reading moves to the thread: parsing still happens on the caller,
+     * so it sees the definitions made by the forms before. Call after open().
+     */
+    void pipeline(size_t depth = 16);
+
+    /**
+     * @brief Reads the rest of a large in-memory input on the thread pool
+     * The input is cut between top-level forms and the pieces are read
+     * concurrently, a bounded number ahead of the caller; read() still
+     * returns the forms, and raises read errors, in input order. Does
+     * nothing for small or streamed input, or when the global pool has a
+     * single worker (see --threads). Call after open().
+     */
+    void parallel();
+
+    /**
+     * @brief Flushes os whenever the reader is about to wait for more input
+     * So buffered output reaches an interactive user before the prompt
+     * blocks. os is flushed on the caller's thread; nullptr stops it.
+     */
+    void flushBeforeWait(std::ostream *os) { flush_out = os; }
+
+    /**
+     * @brief Skips whitespace and comments
+     * @return true if no form is left
+     */
+    bool atEnd();
+
+    /**
+     * @brief Reads one form into a fresh arena, freed once the form is dropped
+     * @throws RuntimeError for a stray closing parenthesis, or for an
+     * unclosed list, which uses up the rest of the input
+     */
+    Syntax read();
+
+private:
+    const char *data;     ///< Unread input is [data + pos, data + len)
+    size_t len;
+    size_t pos = 0;
+    bool eof = true;      ///< No more input beyond len
+    std::string block;    ///< Buffered input of a stream or fd
+    std::istream *in = nullptr;
+    int fd = -1;
+    bool own_fd = false;
+    void *map = nullptr;
+    size_t map_len = 0;
+    struct Form;
+    struct Pipeline;
+    std::unique_ptr<Pipeline> pipe;
+    int wake = -1;        ///< Readable once a pipelined reader should stop
+    struct Chunks;
+    std::unique_ptr<Chunks> chunks;
+    std::ostream *flush_out = nullptr;
+
+    bool refill();
+    void release();
+    void stopPipeline();
+    void waitForm(std::unique_lock<std::mutex> &lk);
+    void submitChunks();
+    bool chunkEnd();
+    void stopChunks();
+    bool scanEnd();
+    Syntax readForm();
+    size_t skipSpace(size_t i);
+    Syntax item(size_t &i);
+    Syntax list(size_t &i);
+};
+
+bool tryParseNumber(std::string_view, int &);
+bool tryParseRational(std::string_view, int &, int &);
 
-std::istream &operator>>(std::istream &, Syntax);
 #endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+/**
+ * @file threadpool.cpp
+ * @brief Chase-Lev deques and the work-stealing worker loop
+ */
+
+#include "threadpool.hpp"
+#include <algorithm>
+
+// 当前线程在哪个池里是第几个 worker; 池外线程为 -1
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local int current_index = -1;
+
+// ============================================================================
+// WorkDeque
+// ============================================================================
+
+WorkDeque::Ring::Ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<Job*>[capacity]) {}
+
+WorkDeque::WorkDeque() : top(0), bottom(0) {
+    rings.emplace_back(new Ring(64));
+    ring.store(rings.back().get(), std::memory_order_relaxed);
+}
+
+void WorkDeque::push(Job *job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring *r = ring.load(std::memory_order_relaxed);
+    if (b - t > r->mask) {
+        // 满了就换一个两倍大的环; 旧环留着, 小偷可能还在读
+        Ring *bigger = new Ring((r->mask + 1) * 2);
+        for (int64_t i = t; i < b; i++) bigger->put(i, r->get(i));
+        rings.emplace_back(bigger);
+        ring.store(bigger, std::memory_order_release);
+        r = bigger;
+    }
+    r->put(b, job);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+Job *WorkDeque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring *r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job *job = r->get(b);
+    if (t == b) {
+        // 只剩最后一个, 和小偷抢
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job *WorkDeque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+    Ring *r = ring.load(std::memory_order_acquire);
+    Job *job = r->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+// ============================================================================
+// ThreadPool
+// ============================================================================
+
+ThreadPool::ThreadPool(unsigned workers) : pending(0), sleeping(0), stop(false) {
+    if (workers == 0) workers = 1;
+    for (unsigned i = 0; i < workers; i++)
+        deques.emplace_back(new WorkDeque());
+    for (unsigned i = 0; i < workers; i++)
+        threads.emplace_back(&ThreadPool::workerLoop, this, (int)i);
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+// 正在跑的任务在下一个检查点看到 stop 就放弃, 所以 join 不用等它们算完
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(sleep_mutex);
+        stop.store(true);
+    }
+    wake.notify_all();
+    for (auto &t : threads) t.join();
+    threads.clear();
+    // 没来得及跑的任务直接丢掉; 只有 worker 才 pop 自己的 deque, 它们都已经退出了
+    for (auto &d : deques)
+        while (Job *j = d->pop()) delete j;
+    std::lock_guard<std::mutex> lk(inject_mutex);
+    for (Job *j : inject) delete j;
+    inject.clear();
+}
+
+static std::atomic<bool> global_started(false);
+static std::atomic<unsigned> global_workers(0);   // 0: 每个核一个
+
+unsigned ThreadPool::globalWorkers() {
+    unsigned n = global_workers.load(std::memory_order_relaxed);
+    return n ? n : std::thread::hardware_concurrency();
+}
+
+void ThreadPool::setGlobalWorkers(unsigned n) {
+    global_workers.store(n, std::memory_order_relaxed);
+}
+
+ThreadPool &ThreadPool::global() {
+    static ThreadPool pool(globalWorkers());
+    global_started.store(true, std::memory_order_release);
+    return pool;
+}
+
+void ThreadPool::shutdownGlobal() {
+    if (global_started.load(std::memory_order_acquire))
+        global().shutdown();
+}
+
+bool ThreadPool::cancelling() {
+    return current_pool && current_pool->stop.load(std::memory_order_relaxed);
+}
+
+void ThreadPool::submit(Job job) {
+    Job *j = new Job(std::move(job));
+    pending.fetch_add(1);
+    if (current_pool == this) {
+        deques[current_index]->push(j);
+    } else {
+        std::lock_guard<std::mutex> lk(inject_mutex);
+        inject.push_back(j);
+    }
+    if (sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lk(sleep_mutex); }
+        wake.notify_one();
+    }
+}
+
+Job *ThreadPool::findJob(int self) {
+    Job *j = nullptr;
+    if (self >= 0 && (j = deques[self]->pop())) return j;
+    {
+        std::lock_guard<std::mutex> lk(inject_mutex);
+        if (!inject.empty()) {
+            j = inject.front();
+            inject.pop_front();
+            return j;
+        }
+    }
+    // 从随便一个位置开始轮流偷
+    size_t n = deques.size();
+    size_t start = (size_t)(self >= 0 ? self + 1 : std::hash<std::thread::id>()(std::this_thread::get_id()));
+    for (size_t k = 0; k < n; k++) {
+        size_t victim = (start + k) % n;
+        if ((int)victim == self) continue;
+        if ((j = deques[victim]->steal())) return j;
+    }
+    return nullptr;
+}
+
+bool ThreadPool::runPending() {
+    Job *j = findJob(current_pool == this ? current_index : -1);
+    if (!j) return false;
+    pending.fetch_sub(1);
+    (*j)();
+    delete j;
+    return true;
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &body) {
+    if (n == 0) return;
+    struct Shared {
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        std::vector<std::exception_ptr> errors;
+        explicit Shared(size_t n) : next(0), done(0), errors(n) {}
+    };
+    std::shared_ptr<Shared> sh = std::make_shared<Shared>(n);
+    // 每个帮手都从同一个计数器领下标, 谁快谁多干; 领完了就不会再碰 body
+    const std::function<void(size_t)> *fn = &body;
+    auto work = [sh, fn, n]() {
+        size_t i;
+        while ((i = sh->next.fetch_add(1)) < n) {
+            try {
+                (*fn)(i);
+            } catch (...) {
+                sh->errors[i] = std::current_exception();
+            }
+            sh->done.fetch_add(1, std::memory_order_release);
+        }
+    };
+    size_t helpers = std::min(n - 1, (size_t)size());
+    for (size_t k = 0; k < helpers; k++) submit(work);
+    work();
+    while (sh->done.load(std::memory_order_acquire) < n) {
+        if (!runPending()) std::this_thread::yield();
+    }
+    for (auto &e : sh->errors)
+        if (e) std::rethrow_exception(e);
+}
+
+void ThreadPool::workerLoop(int self) {
+    current_pool = this;
+    current_index = self;
+    while (!stop.load()) {
+        if (runPending()) continue;
+        std::unique_lock<std::mutex> lk(sleep_mutex);
+        sleeping.fetch_add(1);
+        wake.wait(lk, [this] { return stop.load() || pending.load() > 0; });
+        sleeping.fetch_sub(1);
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef THREADPOOL
+#define THREADPOOL
+
+/**
+ * @file threadpool.hpp
+ * @brief Work-stealing thread pool used by futures
+ *
+ * Every worker owns a Chase-Lev deque: the owner pushes and pops at the
+ * bottom without locking while idle workers steal from the top. Jobs
+ * submitted from threads outside the pool go through a small locked
+ * injection queue. Threads waiting on a result call runPending() so that
+ * they keep doing useful work instead of blocking a core.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Job;
+
+/**
+ * @brief Lock-free single-owner / multi-thief deque (Chase-Lev)
+ */
+class WorkDeque {
+    struct Ring {
+        int64_t mask;
+        std::unique_ptr<std::atomic<Job*>[]> slots;
+        explicit Ring(int64_t capacity);
+        Job *get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, Job *j) { slots[i & mask].store(j, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<Ring*> ring;
+    std::vector<std::unique_ptr<Ring>> rings;  ///< Current ring plus retired ones thieves may still read
+
+public:
+    WorkDeque();
+    void push(Job *);   ///< Owner only
+    Job *pop();         ///< Owner only, LIFO
+    Job *steal();       ///< Any thread, FIFO
+};
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned workers);
+    ~ThreadPool();
+
+    /**
+     * @brief Queues a job; it must not throw
+     */
+    void submit(Job job);
+
+    /**
+     * @brief Runs one queued job on the calling thread
+     * @return false when nothing was available
+     */
+    bool runPending();
+
+    /**
+     * @brief Calls body(0) .. body(n-1) across the pool and waits for all
+     * The calling thread takes part. If any call throws, the exception of
+     * the lowest index is rethrown once every call has finished.
+     */
+    void parallelFor(size_t n, const std::function<void(size_t)> &body);
+
+    unsigned size() const { return (unsigned)threads.size(); }
+
+    /**
+     * @brief Number of workers currently asleep for lack of work
+     */
+    unsigned idleWorkers() const { return (unsigned)sleeping.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Process-wide pool, started on first use with globalWorkers() workers
+     */
+    static ThreadPool &global();
+
+    /**
+     * @brief Worker count of the process-wide pool, without starting it
+     * One per core unless setGlobalWorkers() chose otherwise.
+     */
+    static unsigned globalWorkers();
+
+    /**
+     * @brief Overrides the worker count of the process-wide pool (--threads)
+     * Only has an effect before the pool is first used.
+     */
+    static void setGlobalWorkers(unsigned);
+
+    /**
+     * @brief Stops the process-wide pool if it was started
+     * Jobs not yet started are dropped and running ones are asked to stop
+     * (see cancelling()), so exit does not wait for futures nobody touches.
+     * Call before the streams those jobs write to go away.
+     */
+    static void shutdownGlobal();
+
+    /**
+     * @brief True on a worker of a pool that is shutting down
+     * Long-running jobs poll this at evaluation checkpoints and give up.
+     */
+    static bool cancelling();
+
+private:
+    std::vector<std::unique_ptr<WorkDeque>> deques;
+    std::vector<std::thread> threads;
+    std::mutex inject_mutex;
+    std::deque<Job*> inject;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<long> pending;
+    std::atomic<int> sleeping;
+    std::atomic<bool> stop;
+
+    Job *findJob(int self);
+    void workerLoop(int self);
+    void shutdown();
+};
+
+#endif // THREADPOOL
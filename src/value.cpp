@@ -7,6 +7,7 @@
  */
 
 #include "value.hpp"
+#include <charconv>
 
 // ============================================================================
 // Base ValueBase Implementation
@@ -71,7 +72,56 @@ Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
     return Assoc(new AssocList(x, v, lst));
 }
 
+/*
+future 之间共享环境: 一边 define / set! 改 next 或 v 这两个 shared_ptr, 一边 find 顺着它们复制,
+不加锁就是数据竞争, 读到的可能是正在被释放的结点
+锁跟着程序走: 每个 REPL / 脚本有自己的 EnvSync, 只有真的把求值交给别的线程的程序才打开它,
+其他程序 (别的 batch 文件、server 会话、isolate) 的 find 只多读一次 thread_local 和一个原子变量
+*/
+EnvSync::EnvSync() : shared(false) {}
+
+thread_local EnvSync *current_env_sync = nullptr;
+
+EnvSyncScope::EnvSyncScope(EnvSync *s) : saved(current_env_sync) {
+    current_env_sync = s;
+}
+
+EnvSyncScope::~EnvSyncScope() {
+    current_env_sync = saved;
+}
+
+std::shared_ptr<EnvSync> shareEnvironments() {
+    // 没有登记过程序的线程 (直接调 eval 的嵌入者) 共用这一个
+    static std::shared_ptr<EnvSync> unowned = std::make_shared<EnvSync>();
+    if (!current_env_sync) current_env_sync = unowned.get();
+    EnvSync *s = current_env_sync;
+    s->shared.store(true, std::memory_order_release);
+    return s->shared_from_this();
+}
+
+static EnvSync *sharedSync() {
+    EnvSync *s = current_env_sync;
+    return s && s->shared.load(std::memory_order_acquire) ? s : nullptr;
+}
+
+EnvWriteLock::EnvWriteLock() : locked(sharedSync()) {
+    if (locked) locked->links.lock();
+}
+
+EnvWriteLock::~EnvWriteLock() {
+    if (locked) locked->links.unlock();
+}
+
+MutationLock::MutationLock() : locked(sharedSync()) {
+    if (locked) locked->mutation.lock();
+}
+
+MutationLock::~MutationLock() {
+    if (locked) locked->mutation.unlock();
+}
+
 void modify(const std::string &x, const Value &v, Assoc &lst) {
+    EnvWriteLock lock;
     for (auto i = lst; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
             i->v = v;
@@ -80,7 +130,7 @@ void modify(const std::string &x, const Value &v, Assoc &lst) {
     }
 }
 
-Value find(const std::string &x, Assoc &l) {
+static Value findUnlocked(const std::string &x, Assoc &l) {
     for (auto i = l; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
             return i->v;
@@ -89,6 +139,14 @@ Value find(const std::string &x, Assoc &l) {
     return Value(nullptr);
 }
 
+Value find(const std::string &x, Assoc &l) {
+    if (EnvSync *s = sharedSync()) {
+        std::shared_lock<std::shared_mutex> lock(s->links);
+        return findUnlocked(x, l);
+    }
+    return findUnlocked(x, l);
+}
+
 // ============================================================================
 // Simple Value Types Implementation
 // ============================================================================
@@ -107,8 +165,14 @@ Value VoidV() {
 // Integer
 Integer::Integer(int n) : ValueBase(V_INT), n(n) {}
 
+// 数字最常打印, 用 to_chars 直接写, 不经过 locale 和格式状态
+static void writeInt(std::ostream &os, int n) {
+    char buf[16];
+    os.write(buf, std::to_chars(buf, buf + sizeof buf, n).ptr - buf);
+}
+
 void Integer::show(std::ostream &os) {
-    os << n;
+    writeInt(os, n);
 }
 
 Value IntegerV(int n) {
@@ -146,10 +210,10 @@ Rational::Rational(int num, int den) : ValueBase(V_RATIONAL) {
 }
 
 void Rational::show(std::ostream &os) {
-    if (denominator == 1) {
-        os << numerator;
-    } else {
-        os << numerator << "/" << denominator;
+    writeInt(os, numerator);
+    if (denominator != 1) {
+        os.put('/');
+        writeInt(os, denominator);
     }
 }
 
@@ -180,16 +244,71 @@ Value SymbolV(const std::string &s) {
 }
 
 // String
-String::String(const std::string &s) : ValueBase(V_STRING), s(s) {}
+String::String(const std::string &s)
+    : ValueBase(V_STRING), buf(std::make_shared<const std::string>(s)), off(0), len(s.size()) {}
+
+String::String(const std::shared_ptr<const std::string> &buf, size_t off, size_t len)
+    : ValueBase(V_STRING), buf(buf), off(off), len(len) {}
 
+const char *String::data() const {
+    return buf->data() + off;
+}
+
+size_t String::size() const {
+    return len;
+}
+
+std::string String::str() const {
+    return std::string(data(), len);
+}
+
+// 不用转义的一段整段写; \n \t \r 之外的控制字符写成 \x十六进制;
 void String::show(std::ostream &os) {
-    os << "\"" << s << "\"";
+    os << '"';
+    const char *p = data(), *end = p + len;
+    while (1) {
+        const char *q = p;
+        while (q < end && *q != '"' && *q != '\\' && (unsigned char)*q >= 0x20 && *q != 0x7f)
+            q++;
+        os.write(p, q - p);
+        if (q == end) break;
+        switch (*q) {
+            case '"': os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\n': os << "\\n"; break;
+            case '\t': os << "\\t"; break;
+            case '\r': os << "\\r"; break;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                unsigned char c = (unsigned char)*q;
+                char esc[] = {'\\', 'x', hex[c >> 4], hex[c & 15], ';'};
+                os.write(esc, sizeof esc);
+            }
+        }
+        p = q + 1;
+    }
+    os << '"';
 }
 
 Value StringV(const std::string &s) {
     return Value(new String(s));
 }
 
+Value StringV(const std::shared_ptr<const std::string> &buf, size_t off, size_t len) {
+    return Value(new String(buf, off, len));
+}
+
+// StringBuilder
+StringBuilder::StringBuilder() : ValueBase(V_STRING_BUILDER) {}
+
+void StringBuilder::show(std::ostream &os) {
+    os << "#<string-builder>";
+}
+
+Value StringBuilderV() {
+    return Value(new StringBuilder());
+}
+
 // ============================================================================
 // Special Value Types Implementation
 // ============================================================================
@@ -242,9 +361,67 @@ Value PairV(const Value &car, const Value &cdr) {
     return Value(new Pair(car, cdr));
 }
 
+// Vector
+Vector::Vector(const std::vector<Value> &elems)
+    : ValueBase(V_VECTOR), elems(elems) {}
+
+void Vector::show(std::ostream &os) {
+    os << "#(";
+    for (size_t i = 0; i < elems.size(); i++) {
+        if (i != 0) os << ' ';
+        elems[i]->show(os);
+    }
+    os << ')';
+}
+
+Value VectorV(const std::vector<Value> &elems) {
+    return Value(new Vector(elems));
+}
+
+// Record
+RecordType::RecordType(const std::string &name, const std::vector<std::string> &fields)
+    : name(name), fields(fields) {}
+
+void *Record::operator new(size_t size, size_t nslots) {
+    return ::operator new(size + nslots * sizeof(Value));
+}
+
+void Record::operator delete(void *p) {
+    ::operator delete(p);
+}
+
+void Record::operator delete(void *p, size_t) {
+    ::operator delete(p);
+}
+
+Record::Record(const std::shared_ptr<RecordType> &type, const std::vector<Value> &vals)
+    : ValueBase(V_RECORD), type(type), n(vals.size()) {
+    Value *s = slots();
+    for (size_t i = 0; i < n; i++)
+        new (s + i) Value(vals[i]);
+}
+
+Record::~Record() {
+    Value *s = slots();
+    for (size_t i = 0; i < n; i++)
+        s[i].~Value();
+}
+
+Value *Record::slots() {
+    return reinterpret_cast<Value*>(this + 1);
+}
+
+void Record::show(std::ostream &os) {
+    os << "#<record " << type->name << '>';
+}
+
+Value RecordV(const std::shared_ptr<RecordType> &type, const std::vector<Value> &vals) {
+    return Value(new (vals.size()) Record(type, vals));
+}
+
 // Procedure
 Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
+    : ValueBase(V_PROC), parameters(xs), e(e.retained()), env(env), purity(0) {}
 
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
@@ -254,6 +431,87 @@ Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc
     return Value(new Procedure(xs, e, env));
 }
 
+// Promise
+PromiseBox::PromiseBox(bool done, bool lazy, const Value &value, const Expr &e, const Assoc &env)
+    : done(done), lazy(lazy), value(value), e(e.retained()), env(env) {}
+
+Promise::Promise(const std::shared_ptr<PromiseBox> &box) : ValueBase(V_PROMISE), box(box) {}
+
+void Promise::show(std::ostream &os) {
+    os << "#<promise>";
+}
+
+Value PromiseV(bool lazy, const Expr &e, const Assoc &env) {
+    return Value(new Promise(std::make_shared<PromiseBox>(false, lazy, Value(nullptr), e, env)));
+}
+
+Value ReadyPromiseV(const Value &v) {
+    return Value(new Promise(std::make_shared<PromiseBox>(true, false, v, Expr(nullptr), Assoc(nullptr))));
+}
+
+// Future
+FutureState::FutureState(const Expr &e, const Assoc &env)
+    : state(PENDING), e(e.retained()), env(env), value(nullptr), out(current_output), sync(shareEnvironments()) {}
+
+bool FutureState::claim() {
+    int expected = PENDING;
+    return state.compare_exchange_strong(expected, RUNNING);
+}
+
+Future::Future(const std::shared_ptr<FutureState> &st) : ValueBase(V_FUTURE), st(st) {}
+
+void Future::show(std::ostream &os) {
+    os << "#<future>";
+}
+
+Value FutureV(const std::shared_ptr<FutureState> &st) {
+    return Value(new Future(st));
+}
+
+// Task
+Task::Task(const std::shared_ptr<GreenTask> &task) : ValueBase(V_TASK), task(task) {}
+
+void Task::show(std::ostream &os) {
+    os << "#<task>";
+}
+
+Value TaskV(const std::shared_ptr<GreenTask> &task) {
+    return Value(new Task(task));
+}
+
+// Channel
+Channel::Channel(const std::shared_ptr<GreenChannel> &ch) : ValueBase(V_CHANNEL), ch(ch) {}
+
+void Channel::show(std::ostream &os) {
+    os << "#<channel>";
+}
+
+Value ChannelV(const std::shared_ptr<GreenChannel> &ch) {
+    return Value(new Channel(ch));
+}
+
+// Isolate
+Isolate::Isolate(const std::shared_ptr<IsolateState> &st) : ValueBase(V_ISOLATE), st(st) {}
+
+void Isolate::show(std::ostream &os) {
+    os << "#<isolate>";
+}
+
+Value IsolateV(const std::shared_ptr<IsolateState> &st) {
+    return Value(new Isolate(st));
+}
+
+// OutputPort
+OutputPort::OutputPort(const std::shared_ptr<PortState> &port) : ValueBase(V_PORT), port(port) {}
+
+void OutputPort::show(std::ostream &os) {
+    os << "#<output-port>";
+}
+
+Value OutputPortV(const std::shared_ptr<PortState> &port) {
+    return Value(new OutputPort(port));
+}
+
 // ============================================================================
 // Utility Functions Implementation
 // ============================================================================
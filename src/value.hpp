@@ -14,6 +14,10 @@
 #include <memory>
 #include <cstring>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <exception>
 
 // ============================================================================
 // Base classes and smart pointer wrappers
@@ -73,6 +77,75 @@ Assoc extend(const std::string&, const Value &, Assoc &);
 void modify(const std::string&, const Value &, Assoc &);
 Value find(const std::string &, Assoc &);
 
+/**
+ * @brief Locks of the environments of one program (one REPL or script)
+ * A program that never hands evaluation to another thread takes none of
+ * them. Futures and the parallel primitives mark the EnvSync of the
+ * program spawning them as shared; from then on the threads evaluating
+ * for that program lock it, and other programs in the process are not
+ * affected.
+ */
+struct EnvSync : std::enable_shared_from_this<EnvSync> {
+    std::shared_mutex links;    ///< Shared by find, exclusive for writes to AssocList::v and next
+    std::mutex mutation;        ///< Serializes set!, define, set-car!, display and the like
+    std::atomic<bool> shared;   ///< Set once evaluation was handed to another thread
+    EnvSync();
+};
+
+/**
+ * @brief EnvSync of the program the current thread evaluates for
+ * Set by whoever starts evaluating a program (EnvSyncScope) and by pool
+ * jobs for the program that spawned them.
+ */
+extern thread_local EnvSync *current_env_sync;
+
+/**
+ * @brief Installs an EnvSync for the current thread until destroyed
+ */
+struct EnvSyncScope {
+    EnvSync *saved;
+    explicit EnvSyncScope(EnvSync *);
+    ~EnvSyncScope();
+    EnvSyncScope(const EnvSyncScope &) = delete;
+    EnvSyncScope &operator=(const EnvSyncScope &) = delete;
+};
+
+/**
+ * @brief Marks the current program's environments as shared between threads
+ * Call before evaluation is first handed to another thread. Returns the
+ * EnvSync the jobs must install.
+ */
+std::shared_ptr<EnvSync> shareEnvironments();
+
+/**
+ * @brief Exclusive lock for writing AssocList::v or AssocList::next in place
+ * A no-op unless the current program's environments are shared. modify
+ * takes it itself.
+ */
+class EnvWriteLock {
+public:
+    EnvWriteLock();
+    ~EnvWriteLock();
+    EnvWriteLock(const EnvWriteLock &) = delete;
+    EnvWriteLock &operator=(const EnvWriteLock &) = delete;
+private:
+    EnvSync *locked;
+};
+
+/**
+ * @brief Serializes in-place mutation and output within a shared program
+ * A no-op unless the current program's environments are shared.
+ */
+class MutationLock {
+public:
+    MutationLock();
+    ~MutationLock();
+    MutationLock(const MutationLock &) = delete;
+    MutationLock &operator=(const MutationLock &) = delete;
+private:
+    EnvSync *locked;
+};
+
 // ============================================================================
 // Simple Value Types
 // ============================================================================
@@ -129,13 +202,37 @@ Value SymbolV(const std::string &);
 
 /**
  * @brief String value
+ *
+ * Strings are immutable views [off, off + len) into a shared character
+ * buffer, so literals and substrings never copy their characters.
  */
 struct String : ValueBase {
-    std::string s;
+    std::shared_ptr<const std::string> buf;  ///< Shared immutable storage
+    size_t off;                              ///< Start of this string in buf
+    size_t len;                              ///< Length in bytes
     String(const std::string &);
+    String(const std::shared_ptr<const std::string> &, size_t, size_t);
+    const char *data() const;
+    size_t size() const;
+    std::string str() const;
+    /**
+     * @brief Prints the string as write does: quoted, with ", \ and control
+     * characters escaped so the reader gives back the same string
+     */
     virtual void show(std::ostream &) override;
 };
 Value StringV(const std::string &);
+Value StringV(const std::shared_ptr<const std::string> &, size_t, size_t);
+
+/**
+ * @brief Growable string buffer for repeated appends
+ */
+struct StringBuilder : ValueBase {
+    std::string buf;
+    StringBuilder();
+    virtual void show(std::ostream &) override;
+};
+Value StringBuilderV();
 
 // ============================================================================
 // Special Value Types
@@ -176,6 +273,44 @@ struct Pair : ValueBase {
 };
 Value PairV(const Value &, const Value &);
 
+/**
+ * @brief Vector value (contiguous, fixed-length sequence)
+ */
+struct Vector : ValueBase {
+    std::vector<Value> elems;  ///< Elements
+    Vector(const std::vector<Value> &);
+    virtual void show(std::ostream &) override;
+};
+Value VectorV(const std::vector<Value> &);
+
+/**
+ * @brief Record type descriptor created by define-record-type
+ */
+struct RecordType {
+    std::string name;                 ///< Type name, used when printing
+    std::vector<std::string> fields;  ///< Field names in slot order
+    RecordType(const std::string &, const std::vector<std::string> &);
+};
+
+/**
+ * @brief Record value
+ *
+ * The slots are stored inline right after the object, so a record is a
+ * single allocation and a field access is one indexed load.
+ */
+struct Record : ValueBase {
+    std::shared_ptr<RecordType> type;
+    size_t n;                          ///< Number of slots
+    Record(const std::shared_ptr<RecordType> &, const std::vector<Value> &);
+    ~Record();
+    Value *slots();
+    virtual void show(std::ostream &) override;
+    static void *operator new(size_t, size_t);
+    static void operator delete(void *);
+    static void operator delete(void *, size_t);
+};
+Value RecordV(const std::shared_ptr<RecordType> &, const std::vector<Value> &);
+
 /**
  * @brief Procedure (function) value
  */
@@ -183,11 +318,114 @@ struct Procedure : ValueBase {
     std::vector<std::string> parameters;   ///< Parameter names
     Expr e;                                ///< Function body expression
     Assoc env;                             ///< Closure environment
+    std::atomic<uint32_t> purity;          ///< Cached effect analysis result (see purity.hpp)
     Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
     virtual void show(std::ostream &) override;
 };
 Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
 
+/**
+ * @brief Shared state of a promise
+ *
+ * Promises chained through delay-force end up sharing one box, which is
+ * what lets force run them iteratively in constant space.
+ */
+struct PromiseBox {
+    bool done;     ///< Whether value is available
+    bool lazy;     ///< Body yields another promise (delay-force)
+    Value value;   ///< Memoized result once done
+    Expr e;        ///< Body, evaluated at most once
+    Assoc env;     ///< Environment of the body
+    PromiseBox(bool, bool, const Value &, const Expr &, const Assoc &);
+};
+
+/**
+ * @brief Promise value created by delay, delay-force or make-promise
+ */
+struct Promise : ValueBase {
+    std::shared_ptr<PromiseBox> box;
+    Promise(const std::shared_ptr<PromiseBox> &);
+    virtual void show(std::ostream &) override;
+};
+Value PromiseV(bool, const Expr &, const Assoc &);
+Value ReadyPromiseV(const Value &);
+
+/**
+ * @brief Shared state of a future
+ *
+ * Whoever moves state from pending to running (a pool worker or the first
+ * toucher) evaluates the body; everyone else waits for done.
+ */
+struct FutureState {
+    enum { PENDING, RUNNING, DONE };
+    std::atomic<int> state;
+    Expr e;                     ///< Body, released once evaluated
+    Assoc env;                  ///< Environment of the body
+    Value value;                ///< Result once done
+    std::exception_ptr error;   ///< Exception raised by the body, rethrown at touch
+    std::ostream *out;          ///< current_output of the spawning thread
+    std::shared_ptr<EnvSync> sync;  ///< Locks of the spawning program
+    FutureState(const Expr &, const Assoc &);
+    bool claim();               ///< pending -> running, true for the winner
+};
+
+/**
+ * @brief Future value created by (future expr)
+ */
+struct Future : ValueBase {
+    std::shared_ptr<FutureState> st;
+    Future(const std::shared_ptr<FutureState> &);
+    virtual void show(std::ostream &) override;
+};
+Value FutureV(const std::shared_ptr<FutureState> &);
+
+struct GreenTask;
+struct GreenChannel;
+
+/**
+ * @brief Green thread created by (spawn thunk); state lives in green.hpp
+ */
+struct Task : ValueBase {
+    std::shared_ptr<GreenTask> task;
+    Task(const std::shared_ptr<GreenTask> &);
+    virtual void show(std::ostream &) override;
+};
+Value TaskV(const std::shared_ptr<GreenTask> &);
+
+/**
+ * @brief Channel between green threads of one OS thread
+ */
+struct Channel : ValueBase {
+    std::shared_ptr<GreenChannel> ch;
+    Channel(const std::shared_ptr<GreenChannel> &);
+    virtual void show(std::ostream &) override;
+};
+Value ChannelV(const std::shared_ptr<GreenChannel> &);
+
+struct IsolateState;
+
+/**
+ * @brief Handle of an isolate (see isolate.hpp); safe to share between threads
+ */
+struct Isolate : ValueBase {
+    std::shared_ptr<IsolateState> st;
+    Isolate(const std::shared_ptr<IsolateState> &);
+    virtual void show(std::ostream &) override;
+};
+Value IsolateV(const std::shared_ptr<IsolateState> &);
+
+struct PortState;
+
+/**
+ * @brief Output port: a file or a string being written (see port.hpp)
+ */
+struct OutputPort : ValueBase {
+    std::shared_ptr<PortState> port;
+    OutputPort(const std::shared_ptr<PortState> &);
+    virtual void show(std::ostream &) override;
+};
+Value OutputPortV(const std::shared_ptr<PortState> &);
+
 // ============================================================================
 // Utility Functions
 // ============================================================================
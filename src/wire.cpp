@@ -0,0 +1,112 @@
+/**
+ * @file wire.cpp
+ * @brief Blocking socket I/O and length-prefixed frames
+ */
+
+#include "wire.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+const uint32_t MAX_FRAME = 64u << 20;
+
+bool readFull(int fd, void *buf, size_t n) {
+    char *p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t k = read(fd, p, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        n -= (size_t)k;
+    }
+    return true;
+}
+
+bool writeFull(int fd, const void *buf, size_t n) {
+    const char *p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        p += k;
+        n -= (size_t)k;
+    }
+    return true;
+}
+
+void putU32(std::string &s, uint32_t x) {
+    s.push_back((char)(x >> 24));
+    s.push_back((char)(x >> 16));
+    s.push_back((char)(x >> 8));
+    s.push_back((char)x);
+}
+
+uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+bool readFrame(int fd, std::string &payload) {
+    unsigned char hdr[4];
+    if (!readFull(fd, hdr, 4)) return false;
+    uint32_t len = getU32(hdr);
+    if (len > MAX_FRAME) return false;
+    payload.assign(len, '\0');
+    return len == 0 || readFull(fd, &payload[0], len);
+}
+
+bool writeFrame(int fd, const std::string &payload) {
+    std::string frame;
+    frame.reserve(payload.size() + 4);
+    putU32(frame, (uint32_t)payload.size());
+    frame += payload;
+    return writeFull(fd, frame.data(), frame.size());
+}
+
+int takeFrame(std::string &buf, std::string &payload) {
+    if (buf.size() < 4) return 0;
+    uint32_t len = getU32(reinterpret_cast<const unsigned char*>(buf.data()));
+    if (len > MAX_FRAME) return -1;
+    if (buf.size() - 4 < len) return 0;
+    payload.assign(buf, 4, len);
+    buf.erase(0, 4 + (size_t)len);
+    return 1;
+}
+
+static bool unixAddress(const std::string &path, sockaddr_un &addr) {
+    addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    std::strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+int listenUnix(const std::string &path) {
+    sockaddr_un addr;
+    if (!unixAddress(path, addr)) {
+        std::cerr << "code: socket path too long: " << path << std::endl;
+        return -1;
+    }
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path.c_str());
+    if (lfd < 0 || bind(lfd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 128) < 0) {
+        std::cerr << "code: cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (lfd >= 0) close(lfd);
+        return -1;
+    }
+    return lfd;
+}
+
+int connectUnix(const std::string &path) {
+    sockaddr_un addr;
+    if (!unixAddress(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,62 @@
+#ifndef WIRE
+#define WIRE
+
+/**
+ * @file wire.hpp
+ * @brief Blocking socket I/O and length-prefixed frames
+ *
+ * Shared by the evaluation server, its scripted test client and the
+ * remote worker protocol (remote.hpp). A frame is a u32 big-endian length
+ * followed by that many bytes.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Largest frame readFrame accepts
+ */
+extern const uint32_t MAX_FRAME;
+
+/**
+ * @brief Reads exactly n bytes, retrying after signals
+ * @return false on EOF or error
+ */
+bool readFull(int fd, void *buf, size_t n);
+
+/**
+ * @brief Writes all n bytes; a closed peer is an error, not SIGPIPE
+ */
+bool writeFull(int fd, const void *buf, size_t n);
+
+void putU32(std::string &, uint32_t);
+uint32_t getU32(const unsigned char *);
+
+/**
+ * @return false on EOF, error or a frame longer than MAX_FRAME
+ */
+bool readFrame(int fd, std::string &payload);
+
+bool writeFrame(int fd, const std::string &payload);
+
+/**
+ * @brief Moves the first complete frame at the front of buf into payload
+ * For input gathered without blocking, as it arrives.
+ * @return 1 if a frame was taken, 0 if buf holds only part of one, -1 if
+ * the frame is longer than MAX_FRAME
+ */
+int takeFrame(std::string &buf, std::string &payload);
+
+/**
+ * @brief Binds and listens on a Unix socket, replacing a stale socket file
+ * @return the listening fd, or -1 after printing the reason to stderr
+ */
+int listenUnix(const std::string &path);
+
+/**
+ * @return a connected fd, or -1
+ */
+int connectUnix(const std::string &path);
+
+#endif // WIRE
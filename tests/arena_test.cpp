@@ -0,0 +1,64 @@
+/**
+ * @file arena_test.cpp
+ * @brief Memory held by parsed code: REPL forms and their Expr arenas
+ *
+ * Every REPL form is parsed into its own arena, which a definition keeps
+ * alive through its closure. These checks bound the arena bytes left
+ * behind per definition, so a large fixed first chunk does not come back.
+ * Run by ctest; prints each failed check and exits non-zero if any failed.
+ */
+
+#include "interpreter.hpp"
+#include "arena.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// 在 REPL 里跑 source, 返回跑完以后各个 arena 多占的字节数
+static long replBytes(Interpreter &interp, const std::string &source) {
+    size_t before = Arena::liveBytes();
+    std::istringstream in(source);
+    interp.repl(in, false);
+    return (long)Arena::liveBytes() - (long)before;
+}
+
+int main() {
+    const int N = 2000;
+    // 一个小定义的 Expr 树不到 400 字节
+    const long PER_DEFINE = 1024;
+
+    std::ostringstream out;
+    Interpreter interp(out);
+
+    std::ostringstream defines;
+    for (int i = 0; i < N; i++)
+        defines << "(define (f" << i << " x) (+ x " << i << "))\n";
+    long held = replBytes(interp, defines.str());
+    check(held <= PER_DEFINE * N,
+          std::to_string(N) + " REPL defines hold " + std::to_string(held) + " arena bytes, expected at most "
+          + std::to_string(PER_DEFINE * N));
+
+    out.str("");
+    replBytes(interp, "(f1999 1)");
+    check(out.str() == "2000\n", "last definition still callable, printed \"" + out.str() + "\"");
+
+    // 没有被留下来的表达式, 它的 arena 求值完就释放
+    std::ostringstream calls;
+    for (int i = 0; i < N; i++)
+        calls << "(f" << i << " " << i << ")\n";
+    held = replBytes(interp, calls.str());
+    check(held == 0, "forms that keep nothing hold " + std::to_string(held) + " arena bytes");
+
+    if (failures)
+        std::cerr << failures << " arena check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file embed_test.cpp
+ * @brief Embedding checks: native procedures registered from C++ and called from Scheme
+ *
+ * Run by ctest; prints each failed check and exits non-zero if any failed.
+ */
+
+#include "interpreter.hpp"
+#include "native.hpp"
+#include "RE.hpp"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+static std::string shown(Interpreter &interp, const std::string &source) {
+    std::ostringstream os;
+    interp.eval(source).show(os);
+    return os.str();
+}
+
+// source 必须抛出 message 开头的 RuntimeError
+static void checkError(Interpreter &interp, const std::string &source, const std::string &message) {
+    try {
+        interp.eval(source);
+        check(false, source + " did not raise");
+    } catch (const RuntimeError &e) {
+        check(e.message().compare(0, message.size(), message) == 0,
+              source + " raised \"" + e.message() + "\", expected \"" + message + "\"");
+    }
+}
+
+static int scale(int x, int k) { return x * k; }
+
+int main() {
+    std::ostringstream out;
+    Interpreter interp(out);
+    interp.define_native("scale", &scale);
+    interp.define_native("half", [](double x) { return x / 2; });
+    interp.define_native("greet", [](std::string who) { return "hello " + who; });
+    int calls = 0;
+    interp.define_native("tick!", [&calls]() { calls++; });
+    interp.define_native("fail", [](int) -> int { throw std::out_of_range("too far"); });
+    interp.define_native("count-args", -1, [](const std::vector<Value> &args) {
+        return IntegerV((int)args.size());
+    });
+
+    check(shown(interp, "(scale 6 7)") == "42", "typed native called from Scheme");
+    check(shown(interp, "(define (twice f x) (f (f x))) (twice (lambda (x) (scale x 3)) 2)") == "18",
+          "native called from a Scheme procedure");
+    check(shown(interp, "(half 3)") == "3/2", "double result converted to an exact number");
+    check(shown(interp, "(greet \"you\")") == "\"hello you\"", "string argument and result");
+    check(shown(interp, "(count-args 1 'a \"b\")") == "3", "raw native with any arity");
+    interp.eval("(tick!) (tick!)");
+    check(calls == 2, "void native runs once per call");
+
+    checkError(interp, "(scale \"6\" 7)", "Wrong typename in scale, expected integer");
+    checkError(interp, "(greet 1)", "Wrong typename in greet, expected string");
+    checkError(interp, "(scale 6)", "Wrong number of arguments for scale");
+    checkError(interp, "(fail 1)", "fail: too far");
+    // 出错以后解释器照常可用, Scheme 里重新 define 也会盖掉原生过程
+    check(shown(interp, "(define (scale x k) (+ x k)) (scale 6 7)") == "13", "redefined from Scheme");
+
+    if (failures)
+        std::cerr << failures << " embedding check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file mkprelude.cpp
+ * @brief Build step turning lib/prelude.scm into an embedded heap image
+ *
+ * mkprelude PRELUDE.scm OUT.cpp
+ * Evaluates PRELUDE.scm in a fresh interpreter, so a prelude that does not
+ * parse or evaluate fails the build, and writes OUT.cpp defining the
+ * prelude_image array declared in prelude.hpp.
+ */
+
+#include "interpreter.hpp"
+#include "image.hpp"
+#include "RE.hpp"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: mkprelude PRELUDE.scm OUT.cpp" << std::endl;
+        return 2;
+    }
+    std::string image;
+    try {
+        std::ostringstream out;
+        Interpreter interp(out);
+        interp.load(argv[1]);
+        image = encodeImage(interp.environment());
+    } catch (const RuntimeError &e) {
+        std::cerr << "mkprelude: " << argv[1] << ": " << e.message() << std::endl;
+        return 1;
+    }
+
+    std::string cpp = "// Generated by mkprelude from " + std::string(argv[1]) + "; do not edit\n"
+                      "#include \"prelude.hpp\"\n\n"
+                      "const unsigned char prelude_image[] = {";
+    char byte[16];
+    for (size_t i = 0; i < image.size(); i++) {
+        std::snprintf(byte, sizeof byte, "%s0x%02x,", i % 16 ? " " : "\n    ",
+                      (unsigned char)image[i]);
+        cpp += byte;
+    }
+    cpp += "\n};\n\nconst size_t prelude_image_size = " + std::to_string(image.size()) + ";\n";
+    try {
+        replaceFile(argv[2], cpp);
+    } catch (const RuntimeError &e) {
+        std::cerr << "mkprelude: " << e.message() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file serve_client.cpp
+ * @brief Scripted client for code --serve, used by score/serve-test.sh
+ *
+ * serve_client SOCKET < SCRIPT
+ * Each line of SCRIPT is sent as one request on the current connection and
+ * the reply is printed as "status N" followed by the output. A few lines
+ * are commands instead:
+ *   new     close the connection and open a fresh one (a new session)
+ *   stall   open another connection that sends two bytes of a header and
+ *           nothing more, kept open until the end
+ *   empty   send a request with no source
+ *   split S send S as one frame written in two pieces, 50ms apart
+ * A missing reply prints "closed" or "timeout".
+ */
+
+#include "wire.hpp"
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+const int REPLY_TIMEOUT_SEC = 5;
+
+// 服务器可能还在启动, 连不上就稍等再试
+int connectRetry(const std::string &path) {
+    for (int tries = 0; tries < 100; tries++) {
+        int fd = connectUnix(path);
+        if (fd >= 0) {
+            timeval tv{REPLY_TIMEOUT_SEC, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+            return fd;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return -1;
+}
+
+bool sendRequest(int fd, const std::string &source, bool split) {
+    std::string frame;
+    putU32(frame, (uint32_t)source.size());
+    frame += source;
+    if (!split)
+        return writeFull(fd, frame.data(), frame.size());
+    size_t half = frame.size() / 2;
+    if (!writeFull(fd, frame.data(), half)) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return writeFull(fd, frame.data() + half, frame.size() - half);
+}
+
+void printReply(int fd) {
+    unsigned char hdr[4];
+    if (!readFull(fd, hdr, 4)) {
+        std::cout << (errno == EAGAIN || errno == EWOULDBLOCK ? "timeout" : "closed") << "\n";
+        return;
+    }
+    std::string reply(getU32(hdr), '\0');
+    if (reply.size() < 5 || !readFull(fd, &reply[0], reply.size())) {
+        std::cout << "closed\n";
+        return;
+    }
+    std::cout << "status " << (int)reply[0] << "\n" << reply.substr(5);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: serve_client SOCKET < SCRIPT" << std::endl;
+        return 2;
+    }
+    std::string path = argv[1];
+    int fd = connectRetry(path);
+    if (fd < 0) {
+        std::cerr << "serve_client: cannot connect to " << path << std::endl;
+        return 1;
+    }
+    std::vector<int> stalled;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line == "new") {
+            close(fd);
+            fd = connectRetry(path);
+            if (fd < 0) {
+                std::cerr << "serve_client: cannot reconnect to " << path << std::endl;
+                return 1;
+            }
+        } else if (line == "stall") {
+            int s = connectRetry(path);
+            if (s >= 0 && writeFull(s, "\0\0", 2)) stalled.push_back(s);
+        } else {
+            bool split = line.compare(0, 6, "split ") == 0;
+            std::string source = line == "empty" ? "" : split ? line.substr(6) : line;
+            errno = 0;
+            if (sendRequest(fd, source, split))
+                printReply(fd);
+            else
+                std::cout << "closed\n";
+        }
+        std::cout.flush();
+    }
+    for (int s : stalled) close(s);
+    close(fd);
+    return 0;
+}